@@ -10,4 +10,7 @@ set code=%cd%
 if not exist "bin" mkdir bin
 pushd bin
 cl %opts% %code%\src\codegen_unity.cpp -Fecodegen.exe -Fdcodegen.pdb
+cl %opts% %code%\src\codegen_bench_unity.cpp -Fecodegen_bench.exe -Fdcodegen_bench.pdb
+cl %opts% -c %code%\src\codegen_library_unity.cpp -Focodegen_library.obj -Fdcodegen_library.pdb
+lib -nologo codegen_library.obj -OUT:codegen.lib
 popd
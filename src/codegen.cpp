@@ -1,5 +1,6 @@
 #include "codegen_parse_write.h"
 #include "codegen_parse_inspect.h"
+#include "codegen_snapshot.h"
 #include "codegen_lex_base.h"
 #include "platform.h"
 
@@ -12,12 +13,23 @@ struct command_options
     char *OutputDirectory;
     bool DoNotRun;
     bool UseDebugFiles;
+    bool Pipelined;
+    bool ParallelImports;
+    char *SnapshotFile;
+    bool CompileModule;
 };
 
 static inline
 void PrintUsage()
 {
-    printf("Usage: codegen inputfile -O outputdir\n");
+    printf("Usage: codegen inputfile -O outputdir [-P] [-J] [-S snapshotfile]\n");
+    printf("       codegen inputfile -M\n");
+    printf("    -P  Lex on other threads while parsing, for very large input files.\n");
+    printf("    -J  Parse imported files on other threads.\n");
+    printf("    -S  Load the resolved input from the snapshot file if none of the input files\n");
+    printf("        changed since it was written, otherwise parse them and write it.\n");
+    printf("    -M  Precompile the input file into a module next to it, imports of the file\n");
+    printf("        load the module instead of parsing it while the file doesn't change.\n");
 }
 
 static inline
@@ -27,6 +39,10 @@ bool CreateCommandOptions(int argc, char **argv, command_options *Options)
     Options->OutputDirectory = 0;
     Options->DoNotRun = false;
     Options->UseDebugFiles = false;
+    Options->Pipelined = false;
+    Options->ParallelImports = false;
+    Options->SnapshotFile = 0;
+    Options->CompileModule = false;
     
     if (argc == 1)
     {
@@ -76,6 +92,35 @@ bool CreateCommandOptions(int argc, char **argv, command_options *Options)
         {
             Options->UseDebugFiles = true;
         }
+        else if (strcmp(argv[I], "-P") == 0 ||
+                 strcmp(argv[I], "/P") == 0)
+        {
+            Options->Pipelined = true;
+        }
+        else if (strcmp(argv[I], "-J") == 0 ||
+                 strcmp(argv[I], "/J") == 0)
+        {
+            Options->ParallelImports = true;
+        }
+        else if (strcmp(argv[I], "-S") == 0 ||
+                 strcmp(argv[I], "/S") == 0)
+        {
+            int Next = I + 1;
+            if (Next >= argc)
+            {
+                printf("Invalid command line: Expected file name after \"%s\"\n", argv[I]);
+                PrintUsage();
+                return false;
+            }
+            
+            Options->SnapshotFile = argv[Next];
+            I = Next;
+        }
+        else if (strcmp(argv[I], "-M") == 0 ||
+                 strcmp(argv[I], "/M") == 0)
+        {
+            Options->CompileModule = true;
+        }
         else if(argv[I][0] == '/' ||
                 argv[I][0] == '-')
         {
@@ -116,7 +161,8 @@ bool CreateCommandOptions(int argc, char **argv, command_options *Options)
         return false;
     }
     
-    if (!Options->OutputDirectory)
+    // A module is written next to the input file.
+    if (!Options->OutputDirectory && !Options->CompileModule)
     {
         printf("Invalid command line: Output directory required.\n");
         PrintUsage();
@@ -152,7 +198,11 @@ bool GenFile(inspect_data *Data,
         return false;
     }
     
-    if (!EvaluateTemplate(&WriteParser, Data->GlobalScope.Dict))
+    bool Result = EvaluateTemplate(&WriteParser, Data);
+    fclose(WriteParser.Output);
+    FreeParser(&WriteParser);
+    
+    if (!Result)
     {
         return false;
     }
@@ -175,23 +225,49 @@ int main(int argc, char **argv)
         return CODEGEN_SUCCESS;
     }
     
+    if (Options.CompileModule)
+    {
+        return CompileModule(Options.InputFile) ? CODEGEN_SUCCESS : CODEGEN_FAILURE;
+    }
+    
     inspect_data Data;
     CreateInspectData(&Data);
     
     if (!Options.UseDebugFiles)
     {
         inspect_parser InspectParser;
-        if (!CreateParser(Options.InputFile, &InspectParser))
-        {
-            FreeInspectData(&Data);
-            return CODEGEN_FAILURE;
-        }
+        bool Loaded = Options.SnapshotFile &&
+            LoadSnapshot(Options.SnapshotFile, Options.InputFile, &Data);
         
-        if (!ParseInspect(&InspectParser, &Data))
+        if (!Loaded)
         {
-            FreeInspectData(&Data);
-            FreeParser(&InspectParser);
-            return CODEGEN_FAILURE;
+            bool Created = Options.Pipelined ?
+                CreatePipelinedParser(Options.InputFile, &InspectParser) :
+                CreateParser(Options.InputFile, &InspectParser);
+        
+            if (!Created)
+            {
+                FreeInspectData(&Data);
+                return CODEGEN_FAILURE;
+            }
+        
+            if (Options.ParallelImports)
+            {
+                ParseImportsInParallel(&InspectParser);
+            }
+        
+            if (!ParseInspect(&InspectParser, &Data))
+            {
+                FreeInspectData(&Data);
+                FreeParser(&InspectParser);
+                return CODEGEN_FAILURE;
+            }
+        
+            // Only a cache, the output can still be generated without it.
+            if (Options.SnapshotFile)
+            {
+                WriteSnapshot(Options.SnapshotFile, Options.InputFile, &InspectParser, &Data);
+            }
         }
         
         char *HeaderFileName = GenerateOutputFilename(Options.InputFile,
@@ -210,22 +286,35 @@ int main(int argc, char **argv)
         if (!GenFile(&Data, "codegen/templates/data.header", HeaderFileName))
         {
             FreeInspectData(&Data);
-            FreeParser(&InspectParser);
+            if (!Loaded)
+            {
+                FreeParser(&InspectParser);
+            }
             printf("%s -- FAILED\n", HeaderFileName);
+            free(HeaderFileName);
+            free(SourceFileName);
             return CODEGEN_FAILURE;
         }
         
         if (!GenFile(&Data, "codegen/templates/data.source", SourceFileName))
         {
             FreeInspectData(&Data);
-            FreeParser(&InspectParser);
+            if (!Loaded)
+            {
+                FreeParser(&InspectParser);
+            }
             printf("%s -- FAILED\n", HeaderFileName);
+            free(HeaderFileName);
+            free(SourceFileName);
             return CODEGEN_FAILURE;
         }
         
         free(HeaderFileName);
         free(SourceFileName);
-        FreeParser(&InspectParser);
+        if (!Loaded)
+        {
+            FreeParser(&InspectParser);
+        }
     }
     else
     {
@@ -257,6 +346,7 @@ int main(int argc, char **argv)
             FreeInspectData(&Data);
             FreeParser(&InspectParser);
             printf("%s -- FAILED\n", OutputFilename);
+            free(OutputFilename);
             return CODEGEN_FAILURE;
         }
         
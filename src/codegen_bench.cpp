@@ -0,0 +1,2468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "codegen_parse_write.h"
+#include "codegen_parse_inspect.h"
+#include "codegen_lex_base.h"
+#include "codegen_library.h"
+#include "compiler_utils.h"
+#include "platform.h"
+
+#define BENCH_SUCCESS 0
+#define BENCH_FAILURE 1
+
+#define BENCH_MAX_SIZES 16
+#define BENCH_PATH_SIZE 1024
+
+#define MICRO_MAX_THRESHOLDS 16
+#define MICRO_DEFAULT_SIZE 1000
+#define MICRO_DEFAULT_THRESHOLD 10
+
+// Slowdowns smaller than this are timer noise, whatever the percentage says.
+#define MICRO_NOISE_SECONDS 0.0005
+
+// End-to-end scaling benchmark. Generates synthetic .ins corpora of increasing size
+// and runs the full pipeline (lex, parse, resolve, render data.header/data.source)
+// over each of them. -parallel parses the imported files of each corpus on other threads,
+// -threads sets how many threads types and attributes are resolved on (every core by default).
+//
+// With -micro it instead times each pipeline stage in isolation over a single corpus,
+// optionally writing the results as json and comparing them against a stored baseline.
+//
+// With -golden it renders every template over a directory of schemas and checks the
+// output byte for byte (and the time it took) against a recorded golden run.
+
+struct corpus_options
+{
+    int StructCount;
+    int FieldsPerStruct;
+    int AttributeDensity; // Percentage of fields (and structs) that carry attributes.
+    int ImportFanOut;
+    int ListNesting;
+    uint32 Seed;
+    
+    // Writes the import declarations inline so the whole corpus is a single file.
+    bool Flatten;
+};
+
+// Allowed slowdown of a stage (or of every stage when Name is null) before it counts
+// as a regression against the baseline.
+struct micro_threshold
+{
+    const char *Name;
+    size_t NameLength;
+    int Percent;
+};
+
+struct bench_options
+{
+    const char *WorkingDirectory;
+    const char *TemplateDirectory;
+    
+    int Sizes[BENCH_MAX_SIZES];
+    int SizeCount;
+    int Iterations;
+    
+    corpus_options Corpus;
+    bool ParallelImports;
+    int ResolveThreads; // 0 for one per core.
+    
+    bool Micro;
+    bool Library;
+    
+    const char *GoldenSchemas;
+    const char *GoldenDirectory; // Defaults to GoldenSchemas.
+    bool Record;
+    
+    const char *JsonOutput;
+    const char *Baseline;
+    micro_threshold Thresholds[MICRO_MAX_THRESHOLDS];
+    int ThresholdCount;
+    int DefaultThreshold;
+    
+    bool DoNotRun;
+};
+
+struct pipeline_timing
+{
+    float64 Parse;
+    float64 Render;
+    uint64 OutputBytes;
+};
+
+static inline
+void PrintUsage()
+{
+    printf("Usage: codegen_bench [-O workdir] [-T templatedir] [-structs 10,100,...]\n"
+           "                     [-fields n] [-attributes percent] [-imports n]\n"
+           "                     [-nesting n] [-iterations n] [-seed n] [-parallel]\n"
+           "                     [-threads n]\n"
+           "                     [-micro] [-json out.json] [-baseline base.json]\n"
+           "                     [-library]\n"
+           "                     [-golden schemadir [-expected goldendir] [-record]]\n"
+           "                     [-threshold percent | -threshold name=percent]\n");
+}
+
+static inline
+bool IsSwitch(const char *Argument, const char *Name)
+{
+    return (Argument[0] == '-' || Argument[0] == '/') && strcmp(&Argument[1], Name) == 0;
+}
+
+static
+bool ParseSizeList(const char *Text, bench_options *Options)
+{
+    Options->SizeCount = 0;
+    
+    const char *At = Text;
+    while (*At)
+    {
+        if (Options->SizeCount == BENCH_MAX_SIZES)
+        {
+            printf("Invalid command line: At most %i corpus sizes can be given.\n", BENCH_MAX_SIZES);
+            return false;
+        }
+        
+        char *End;
+        long Size = strtol(At, &End, 10);
+        if (End == At || Size <= 0)
+        {
+            printf("Invalid command line: Bad corpus size list \"%s\".\n", Text);
+            return false;
+        }
+        
+        Options->Sizes[Options->SizeCount++] = (int)Size;
+        
+        At = End;
+        if (*At == ',')
+        {
+            ++At;
+        }
+    }
+    
+    return Options->SizeCount > 0;
+}
+
+static
+bool ParseIntArgument(int argc, char **argv, int *I, int *Result)
+{
+    int Next = *I + 1;
+    if (Next >= argc)
+    {
+        printf("Invalid command line: Expected a number after \"%s\"\n", argv[*I]);
+        return false;
+    }
+    
+    char *End;
+    long Value = strtol(argv[Next], &End, 10);
+    if (*End != '\0' || Value < 0)
+    {
+        printf("Invalid command line: \"%s\" is not a valid value for \"%s\"\n", argv[Next], argv[*I]);
+        return false;
+    }
+    
+    *Result = (int)Value;
+    *I = Next;
+    return true;
+}
+
+static
+bool ParseThreshold(const char *Text, bench_options *Options)
+{
+    micro_threshold Threshold;
+    Threshold.Name = 0;
+    Threshold.NameLength = 0;
+    
+    const char *Value = Text;
+    const char *Separator = strchr(Text, '=');
+    if (Separator)
+    {
+        Threshold.Name = Text;
+        Threshold.NameLength = (size_t)(Separator - Text);
+        Value = Separator + 1;
+    }
+    
+    char *End;
+    long Percent = strtol(Value, &End, 10);
+    if (End == Value || *End != '\0' || Percent < 0 || (Separator && Threshold.NameLength == 0))
+    {
+        printf("Invalid command line: Bad threshold \"%s\"\n", Text);
+        return false;
+    }
+    
+    Threshold.Percent = (int)Percent;
+    
+    if (!Threshold.Name)
+    {
+        Options->DefaultThreshold = Threshold.Percent;
+        return true;
+    }
+    
+    if (Options->ThresholdCount == MICRO_MAX_THRESHOLDS)
+    {
+        printf("Invalid command line: At most %i stage thresholds can be given.\n", MICRO_MAX_THRESHOLDS);
+        return false;
+    }
+    
+    Options->Thresholds[Options->ThresholdCount++] = Threshold;
+    return true;
+}
+
+static
+bool CreateBenchOptions(int argc, char **argv, bench_options *Options)
+{
+    Options->WorkingDirectory = "codegen_bench_corpus";
+    Options->TemplateDirectory = "codegen/templates";
+    Options->Iterations = 5;
+    Options->ParallelImports = false;
+    Options->ResolveThreads = 0;
+    Options->Micro = false;
+    Options->Library = false;
+    Options->GoldenSchemas = 0;
+    Options->GoldenDirectory = 0;
+    Options->Record = false;
+    Options->JsonOutput = 0;
+    Options->Baseline = 0;
+    Options->ThresholdCount = 0;
+    Options->DefaultThreshold = MICRO_DEFAULT_THRESHOLD;
+    Options->DoNotRun = false;
+    
+    static const int DefaultSizes[] = { 10, 100, 1000, 10000, 100000 };
+    for (int I = 0; I < (int)ARRAY_SIZE(DefaultSizes); ++I)
+    {
+        Options->Sizes[I] = DefaultSizes[I];
+    }
+    Options->SizeCount = (int)ARRAY_SIZE(DefaultSizes);
+    
+    Options->Corpus.StructCount = 0;
+    Options->Corpus.FieldsPerStruct = 8;
+    Options->Corpus.AttributeDensity = 50;
+    Options->Corpus.ImportFanOut = 4;
+    Options->Corpus.ListNesting = 2;
+    Options->Corpus.Seed = 1;
+    Options->Corpus.Flatten = false;
+    
+    bool SizesGiven = false;
+    for (int I = 1; I < argc; ++I)
+    {
+        int Seed;
+        if (IsSwitch(argv[I], "O") || IsSwitch(argv[I], "T"))
+        {
+            int Next = I + 1;
+            if (Next >= argc)
+            {
+                printf("Invalid command line: Expected directory name after \"%s\"\n", argv[I]);
+                PrintUsage();
+                return false;
+            }
+            
+            if (IsSwitch(argv[I], "O"))
+            {
+                Options->WorkingDirectory = argv[Next];
+            }
+            else
+            {
+                Options->TemplateDirectory = argv[Next];
+            }
+            
+            I = Next;
+        }
+        else if (IsSwitch(argv[I], "structs"))
+        {
+            if (I + 1 >= argc || !ParseSizeList(argv[I + 1], Options))
+            {
+                PrintUsage();
+                return false;
+            }
+            
+            SizesGiven = true;
+            ++I;
+        }
+        else if (IsSwitch(argv[I], "fields"))
+        {
+            if (!ParseIntArgument(argc, argv, &I, &Options->Corpus.FieldsPerStruct)) return false;
+        }
+        else if (IsSwitch(argv[I], "attributes"))
+        {
+            if (!ParseIntArgument(argc, argv, &I, &Options->Corpus.AttributeDensity)) return false;
+        }
+        else if (IsSwitch(argv[I], "imports"))
+        {
+            if (!ParseIntArgument(argc, argv, &I, &Options->Corpus.ImportFanOut)) return false;
+        }
+        else if (IsSwitch(argv[I], "nesting"))
+        {
+            if (!ParseIntArgument(argc, argv, &I, &Options->Corpus.ListNesting)) return false;
+        }
+        else if (IsSwitch(argv[I], "iterations"))
+        {
+            if (!ParseIntArgument(argc, argv, &I, &Options->Iterations)) return false;
+        }
+        else if (IsSwitch(argv[I], "seed"))
+        {
+            if (!ParseIntArgument(argc, argv, &I, &Seed)) return false;
+            Options->Corpus.Seed = (uint32)Seed;
+        }
+        else if (IsSwitch(argv[I], "micro"))
+        {
+            Options->Micro = true;
+        }
+        else if (IsSwitch(argv[I], "library"))
+        {
+            Options->Library = true;
+        }
+        else if (IsSwitch(argv[I], "parallel"))
+        {
+            Options->ParallelImports = true;
+        }
+        else if (IsSwitch(argv[I], "threads"))
+        {
+            if (!ParseIntArgument(argc, argv, &I, &Options->ResolveThreads)) return false;
+        }
+        else if (IsSwitch(argv[I], "json") || IsSwitch(argv[I], "baseline") ||
+                 IsSwitch(argv[I], "golden") || IsSwitch(argv[I], "expected"))
+        {
+            int Next = I + 1;
+            if (Next >= argc)
+            {
+                printf("Invalid command line: Expected file or directory name after \"%s\"\n", argv[I]);
+                PrintUsage();
+                return false;
+            }
+            
+            if (IsSwitch(argv[I], "json"))
+            {
+                Options->JsonOutput = argv[Next];
+            }
+            else if (IsSwitch(argv[I], "baseline"))
+            {
+                Options->Baseline = argv[Next];
+            }
+            else if (IsSwitch(argv[I], "golden"))
+            {
+                Options->GoldenSchemas = argv[Next];
+            }
+            else
+            {
+                Options->GoldenDirectory = argv[Next];
+            }
+            
+            I = Next;
+        }
+        else if (IsSwitch(argv[I], "record"))
+        {
+            Options->Record = true;
+        }
+        else if (IsSwitch(argv[I], "threshold"))
+        {
+            if (I + 1 >= argc || !ParseThreshold(argv[I + 1], Options))
+            {
+                PrintUsage();
+                return false;
+            }
+            
+            ++I;
+        }
+        else if (IsSwitch(argv[I], "?"))
+        {
+            Options->DoNotRun = true;
+            PrintUsage();
+        }
+        else
+        {
+            printf("Invalid command line: Unknown argument \"%s\"\n", argv[I]);
+            PrintUsage();
+            return false;
+        }
+    }
+    
+    if (Options->Iterations == 0)
+    {
+        printf("Invalid command line: At least one iteration is required.\n");
+        return false;
+    }
+    
+    if (Options->Corpus.ImportFanOut == 0)
+    {
+        // The attribute and builtin type declarations live in the first import.
+        Options->Corpus.ImportFanOut = 1;
+    }
+    
+    if (Options->Micro && Options->Library)
+    {
+        printf("Invalid command line: \"-micro\" and \"-library\" can't be used together.\n");
+        return false;
+    }
+    
+    if (Options->GoldenSchemas)
+    {
+        if (Options->Micro || Options->Library)
+        {
+            printf("Invalid command line: \"-golden\" can't be used with \"-micro\" or \"-library\".\n");
+            return false;
+        }
+        
+        if (!PLATFORM_IS_DIRECTORY(Options->GoldenSchemas))
+        {
+            printf("Invalid command line: \"%s\" is not a directory.\n", Options->GoldenSchemas);
+            return false;
+        }
+        
+        if (!Options->GoldenDirectory)
+        {
+            Options->GoldenDirectory = Options->GoldenSchemas;
+        }
+    }
+    else if (Options->Record || Options->GoldenDirectory)
+    {
+        printf("Invalid command line: \"-expected\" and \"-record\" require \"-golden\".\n");
+        return false;
+    }
+    
+    if ((Options->Micro || Options->Library) && !SizesGiven)
+    {
+        Options->Sizes[0] = MICRO_DEFAULT_SIZE;
+        Options->SizeCount = 1;
+    }
+    
+    return true;
+}
+
+/*******************************************/
+// Synthetic corpus generation
+
+static inline
+uint32 NextRandom(uint32 *State)
+{
+    // xorshift32, only needs to be deterministic for a given seed.
+    uint32 X = *State;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    *State = X;
+    return X;
+}
+
+static inline
+bool RandomChance(uint32 *State, int Percentage)
+{
+    return (int)(NextRandom(State) % 100) < Percentage;
+}
+
+static const char *BuiltinTypes[] =
+{
+    "int8", "int16", "int32", "int64",
+    "uint8", "uint16", "uint32", "uint64",
+    "float32", "float64", "bool", "string",
+};
+
+// Synthetic types declared by every import file, so the type table grows with the fan-out.
+#define TYPES_PER_IMPORT 16
+
+// Every import file but the first lives in this subdirectory and imports the first one
+// again as "../bench_types_0.ins". The root imports it too, so the corpus always has a
+// diamond whose two paths to the same file are spelled differently.
+#define IMPORT_SUBDIRECTORY "bench_imports"
+
+static
+void ImportFilename(int Index, char *Buffer, size_t Size)
+{
+    if (Index == 0)
+    {
+        snprintf(Buffer, Size, "bench_types_0.ins");
+    }
+    else
+    {
+        snprintf(Buffer, Size, IMPORT_SUBDIRECTORY "/bench_types_%i.ins", Index);
+    }
+}
+
+static
+void WriteImportDeclarations(FILE *File, int Index)
+{
+    if (Index == 0)
+    {
+        fprintf(File, "declare_attribute version(text, binary)\n");
+        fprintf(File, "declare_attribute platform(key)\n");
+        fprintf(File, "declare_attribute const_attribute()\n\n");
+        fprintf(File, "alias_attribute tool [platform(key: tool)]\n");
+        fprintf(File, "alias_attribute pc [platform(key: pc)]\n");
+        fprintf(File, "alias_attribute const [const_attribute()]\n\n");
+        
+        for (int I = 0; I < (int)ARRAY_SIZE(BuiltinTypes); ++I)
+        {
+            fprintf(File, "declare_type %s BUILTIN_%i_TD;\n", BuiltinTypes[I], I);
+        }
+        
+        fprintf(File, "declare_type list LIST_TD;\n");
+        fprintf(File, "declare_type void NONE_TD;\n\n");
+    }
+    
+    for (int I = 0; I < TYPES_PER_IMPORT; ++I)
+    {
+        fprintf(File, "declare_type imported_%i_%i IMPORTED_%i_%i_TD;\n", Index, I, Index, I);
+    }
+}
+
+static
+bool WriteImportFile(const char *Directory, int Index)
+{
+    char Filename[BENCH_PATH_SIZE];
+    char Path[BENCH_PATH_SIZE];
+    ImportFilename(Index, Filename, sizeof(Filename));
+    
+    int Length = snprintf(Path, sizeof(Path), "%s/%s", Directory, Filename);
+    if (Length < 0 || (size_t)Length >= sizeof(Path))
+    {
+        printf("Path of import file %i in \"%s\" is too long\n", Index, Directory);
+        return false;
+    }
+    
+    FILE *File = fopen(Path, "w");
+    if (!File)
+    {
+        printf("Unable to create \"%s\"\n", Path);
+        return false;
+    }
+    
+    if (Index > 0)
+    {
+        fprintf(File, "import \"../bench_types_0.ins\";\n\n");
+    }
+    
+    WriteImportDeclarations(File, Index);
+    
+    fclose(File);
+    return true;
+}
+
+static
+void WriteFieldType(FILE *File, corpus_options *Options, uint32 *Random, int StructIndex)
+{
+    int Nesting = 0;
+    if (Options->ListNesting > 0 && RandomChance(Random, 25))
+    {
+        Nesting = 1 + (int)(NextRandom(Random) % (uint32)Options->ListNesting);
+    }
+    
+    for (int I = 0; I < Nesting; ++I)
+    {
+        fprintf(File, "list<");
+    }
+    
+    uint32 Kind = NextRandom(Random) % 3;
+    if (Kind == 0 && StructIndex > 0)
+    {
+        fprintf(File, "s%u", NextRandom(Random) % (uint32)StructIndex);
+    }
+    else if (Kind == 1)
+    {
+        uint32 Import = NextRandom(Random) % (uint32)Options->ImportFanOut;
+        fprintf(File, "imported_%u_%u", Import, NextRandom(Random) % TYPES_PER_IMPORT);
+    }
+    else
+    {
+        fprintf(File, "%s", BuiltinTypes[NextRandom(Random) % ARRAY_SIZE(BuiltinTypes)]);
+    }
+    
+    for (int I = 0; I < Nesting; ++I)
+    {
+        fprintf(File, ">");
+    }
+}
+
+static
+bool WriteRootFile(const char *Path, corpus_options *Options)
+{
+    FILE *File = fopen(Path, "w");
+    if (!File)
+    {
+        printf("Unable to create \"%s\"\n", Path);
+        return false;
+    }
+    
+    uint32 Random = Options->Seed ? Options->Seed : 1;
+    
+    for (int I = 0; I < Options->ImportFanOut; ++I)
+    {
+        if (Options->Flatten)
+        {
+            WriteImportDeclarations(File, I);
+            continue;
+        }
+        
+        char Filename[BENCH_PATH_SIZE];
+        ImportFilename(I, Filename, sizeof(Filename));
+        fprintf(File, "import \"%s\";\n", Filename);
+    }
+    
+    fprintf(File, "\n");
+    
+    for (int S = 0; S < Options->StructCount; ++S)
+    {
+        if (RandomChance(&Random, Options->AttributeDensity))
+        {
+            fprintf(File, "[version(text: %i, binary: %i)]\n", S % 7, S % 3);
+        }
+        
+        fprintf(File, "struct s%i\n{\n", S);
+        
+        for (int F = 0; F < Options->FieldsPerStruct; ++F)
+        {
+            fprintf(File, "\t");
+            
+            if (RandomChance(&Random, Options->AttributeDensity))
+            {
+                switch (NextRandom(&Random) % 3)
+                {
+                    case 0: fprintf(File, "tool "); break;
+                    case 1: fprintf(File, "pc "); break;
+                    case 2: fprintf(File, "[platform(key: tool)] "); break;
+                }
+            }
+            
+            WriteFieldType(File, Options, &Random, S);
+            fprintf(File, " f%i", F);
+            
+            if (RandomChance(&Random, 20))
+            {
+                fprintf(File, " = %i", F);
+            }
+            
+            fprintf(File, ";\n");
+        }
+        
+        fprintf(File, "};\n\n");
+    }
+    
+    fclose(File);
+    return true;
+}
+
+static
+bool GenerateCorpus(const char *Directory, corpus_options *Options, char *RootPath, size_t RootPathSize)
+{
+    if (!PLATFORM_MAKE_DIRECTORY(Directory))
+    {
+        printf("Unable to create directory \"%s\"\n", Directory);
+        return false;
+    }
+    
+    if (!Options->Flatten)
+    {
+        char Subdirectory[BENCH_PATH_SIZE];
+        snprintf(Subdirectory, sizeof(Subdirectory), "%s/" IMPORT_SUBDIRECTORY, Directory);
+        if (Options->ImportFanOut > 1 && !PLATFORM_MAKE_DIRECTORY(Subdirectory))
+        {
+            printf("Unable to create directory \"%s\"\n", Subdirectory);
+            return false;
+        }
+        
+        for (int I = 0; I < Options->ImportFanOut; ++I)
+        {
+            if (!WriteImportFile(Directory, I))
+            {
+                return false;
+            }
+        }
+    }
+    
+    snprintf(RootPath, RootPathSize, "%s/bench_%i%s.ins", Directory, Options->StructCount,
+             Options->Flatten ? "_flat" : "");
+    return WriteRootFile(RootPath, Options);
+}
+
+/*******************************************/
+// Pipeline
+
+static
+bool RenderTemplate(inspect_data *Data,
+                    const char *TemplatePath,
+                    const char *OutputFilename,
+                    uint64 *OutputBytes)
+{
+    write_parser WriteParser;
+    if (!CreateParser(&WriteParser, TemplatePath, OutputFilename))
+    {
+        printf("Unable to open template \"%s\" or output \"%s\"\n", TemplatePath, OutputFilename);
+        return false;
+    }
+    
+    bool Result = EvaluateTemplate(&WriteParser, Data);
+    
+    fflush(WriteParser.Output);
+    *OutputBytes += (uint64)ftell(WriteParser.Output);
+    fclose(WriteParser.Output);
+    FreeParser(&WriteParser);
+    
+    return Result;
+}
+
+static
+bool RunPipeline(bench_options *Options, const char *RootPath, pipeline_timing *Timing)
+{
+    char HeaderTemplate[BENCH_PATH_SIZE];
+    char SourceTemplate[BENCH_PATH_SIZE];
+    char HeaderOutput[BENCH_PATH_SIZE];
+    char SourceOutput[BENCH_PATH_SIZE];
+    snprintf(HeaderTemplate, sizeof(HeaderTemplate), "%s/data.header", Options->TemplateDirectory);
+    snprintf(SourceTemplate, sizeof(SourceTemplate), "%s/data.source", Options->TemplateDirectory);
+    snprintf(HeaderOutput, sizeof(HeaderOutput), "%s/bench.gen.h", Options->WorkingDirectory);
+    snprintf(SourceOutput, sizeof(SourceOutput), "%s/bench.gen.cpp", Options->WorkingDirectory);
+    
+    Timing->OutputBytes = 0;
+    
+    float64 Begin = PLATFORM_WALL_CLOCK();
+    
+    inspect_data Data;
+    CreateInspectData(&Data);
+    
+    inspect_parser InspectParser;
+    if (!CreateParser(RootPath, &InspectParser))
+    {
+        printf("Unable to open \"%s\"\n", RootPath);
+        FreeInspectData(&Data);
+        return false;
+    }
+    
+    InspectParser.ResolveThreads = (unsigned)Options->ResolveThreads;
+    if (Options->ParallelImports)
+    {
+        ParseImportsInParallel(&InspectParser);
+    }
+    
+    if (!ParseInspect(&InspectParser, &Data))
+    {
+        FreeParser(&InspectParser);
+        FreeInspectData(&Data);
+        return false;
+    }
+    
+    Insert(Data.GlobalScope.Dict, "HeaderFile", NewStringItem("bench.gen.h"));
+    Insert(Data.GlobalScope.Dict, "SourceFile", NewStringItem("bench.gen.cpp"));
+    
+    float64 Parsed = PLATFORM_WALL_CLOCK();
+    
+    bool Result = RenderTemplate(&Data, HeaderTemplate, HeaderOutput, &Timing->OutputBytes) &&
+        RenderTemplate(&Data, SourceTemplate, SourceOutput, &Timing->OutputBytes);
+    
+    float64 Rendered = PLATFORM_WALL_CLOCK();
+    
+    FreeParser(&InspectParser);
+    FreeInspectData(&Data);
+    
+    Timing->Parse = Parsed - Begin;
+    Timing->Render = Rendered - Parsed;
+    return Result;
+}
+
+static inline
+float64 Percentile(std::vector<float64> &Sorted, int Percent)
+{
+    // Nearest-rank percentile.
+    size_t Rank = (Sorted.size() * (size_t)Percent + 99) / 100;
+    if (Rank == 0)
+    {
+        Rank = 1;
+    }
+    
+    return Sorted[Rank - 1];
+}
+
+static
+bool RunSize(bench_options *Options, int StructCount)
+{
+    corpus_options Corpus = Options->Corpus;
+    Corpus.StructCount = StructCount;
+    
+    char RootPath[BENCH_PATH_SIZE];
+    if (!GenerateCorpus(Options->WorkingDirectory, &Corpus, RootPath, sizeof(RootPath)))
+    {
+        return false;
+    }
+    
+    std::vector<float64> Totals;
+    float64 ParseSum = 0;
+    float64 RenderSum = 0;
+    uint64 OutputBytes = 0;
+    
+    for (int I = 0; I < Options->Iterations; ++I)
+    {
+        pipeline_timing Timing;
+        if (!RunPipeline(Options, RootPath, &Timing))
+        {
+            printf("Pipeline failed for \"%s\"\n", RootPath);
+            return false;
+        }
+        
+        Totals.push_back(Timing.Parse + Timing.Render);
+        ParseSum += Timing.Parse;
+        RenderSum += Timing.Render;
+        OutputBytes = Timing.OutputBytes;
+    }
+    
+    std::sort(Totals.begin(), Totals.end());
+    
+    float64 Iterations = (float64)Options->Iterations;
+    float64 MeanTotal = (ParseSum + RenderSum) / Iterations;
+    float64 Fields = (float64)StructCount * (float64)Corpus.FieldsPerStruct;
+    float64 OutputMB = (float64)OutputBytes / (1024.0 * 1024.0);
+    float64 PeakMB = (float64)PLATFORM_PEAK_MEMORY_USAGE() / (1024.0 * 1024.0);
+    
+    printf("%8i %9.0f %10.2f %10.2f %10.2f %10.2f %10.2f %12.0f %9.2f %9.1f\n",
+           StructCount,
+           Fields,
+           ParseSum / Iterations * 1000.0,
+           RenderSum / Iterations * 1000.0,
+           Percentile(Totals, 50) * 1000.0,
+           Percentile(Totals, 90) * 1000.0,
+           Percentile(Totals, 99) * 1000.0,
+           Fields / MeanTotal,
+           OutputMB / MeanTotal,
+           PeakMB);
+    fflush(stdout);
+    
+    return true;
+}
+
+/*******************************************/
+// Stage microbenchmarks
+
+struct micro_result
+{
+    std::string Name;
+    float64 Seconds; // Median over the iterations.
+    uint64 Items;
+};
+
+struct baseline_entry
+{
+    std::string Name;
+    float64 Seconds;
+};
+
+static inline
+float64 Median(std::vector<float64> &Samples)
+{
+    std::sort(Samples.begin(), Samples.end());
+    return Percentile(Samples, 50);
+}
+
+static
+bool BenchLexInspect(bench_options *Options, const char *Path, micro_result *Result)
+{
+    inspect_lexer Lexer;
+    if (!CreateLexer(Path, &Lexer))
+    {
+        printf("Unable to open \"%s\"\n", Path);
+        return false;
+    }
+    
+    std::vector<float64> Samples;
+    uint64 Tokens = 0;
+    
+    for (int I = 0; I < Options->Iterations; ++I)
+    {
+        Lexer.At = Lexer.Begin;
+        Tokens = 0;
+        
+        float64 Begin = PLATFORM_WALL_CLOCK();
+        for (;;)
+        {
+            itoken_info Token = NextToken(&Lexer);
+            ++Tokens;
+            
+            if (Token.Type == ITokenType_End || Token.Type == ITokenType_IncompleteString)
+            {
+                break;
+            }
+        }
+        Samples.push_back(PLATFORM_WALL_CLOCK() - Begin);
+    }
+    
+    FreeLexer(&Lexer);
+    
+    Result->Name = "lex_inspect";
+    Result->Seconds = Median(Samples);
+    Result->Items = Tokens;
+    return true;
+}
+
+static
+bool BenchLexWrite(bench_options *Options, micro_result *Result)
+{
+    const char *Templates[] = { "data.header", "data.source" };
+    write_lexer Lexers[ARRAY_SIZE(Templates)];
+    
+    for (int T = 0; T < (int)ARRAY_SIZE(Templates); ++T)
+    {
+        char Path[BENCH_PATH_SIZE];
+        snprintf(Path, sizeof(Path), "%s/%s", Options->TemplateDirectory, Templates[T]);
+        if (!CreateLexer(&Lexers[T], Path))
+        {
+            printf("Unable to open template \"%s\"\n", Path);
+            for (int Created = 0; Created < T; ++Created)
+            {
+                FreeLexer(&Lexers[Created]);
+            }
+            
+            return false;
+        }
+    }
+    
+    std::vector<float64> Samples;
+    uint64 Tokens = 0;
+    
+    for (int I = 0; I < Options->Iterations; ++I)
+    {
+        Tokens = 0;
+        
+        float64 Begin = PLATFORM_WALL_CLOCK();
+        for (write_lexer &Lexer : Lexers)
+        {
+            Lexer.At = Lexer.Begin;
+            Lexer.Mode = Mode_Text;
+            Lexer.Flags = 0;
+            
+            for (;;)
+            {
+                wtoken_info Info;
+                NextTokenInfo(&Lexer, &Info);
+                ++Tokens;
+                
+                if (Info.Type == WTokenType_EOF || Info.Type == WTokenType_IncompleteString)
+                {
+                    break;
+                }
+            }
+        }
+        Samples.push_back(PLATFORM_WALL_CLOCK() - Begin);
+    }
+    
+    for (write_lexer &Lexer : Lexers)
+    {
+        FreeLexer(&Lexer);
+    }
+    
+    Result->Name = "lex_write";
+    Result->Seconds = Median(Samples);
+    Result->Items = Tokens;
+    return true;
+}
+
+static
+bool BenchParseInspect(bench_options *Options, const char *Path, micro_result *Result)
+{
+    std::vector<float64> Samples;
+    uint64 Tokens = 0;
+    
+    for (int I = 0; I < Options->Iterations; ++I)
+    {
+        inspect_data Data;
+        CreateInspectData(&Data);
+        
+        inspect_parser Parser;
+        if (!CreateParser(Path, &Parser))
+        {
+            printf("Unable to open \"%s\"\n", Path);
+            FreeInspectData(&Data);
+            return false;
+        }
+        
+        // Lex the whole file up front so only the parser itself is timed. This relies on
+        // the corpus being flattened, pre-lexed tokens can't follow imports.
+        Parser.RetainTokens = true;
+        while (ReceiveNextToken(&Parser) && !CheckAt(&Parser, ITokenType_End))
+        {
+        }
+        
+        Tokens = (uint64)Parser.Stack.Populated;
+        RewindTokenStack(&Parser.Stack);
+        
+        float64 Begin = PLATFORM_WALL_CLOCK();
+        bool Parsed = ParseInspect(&Parser, &Data);
+        Samples.push_back(PLATFORM_WALL_CLOCK() - Begin);
+        
+        FreeParser(&Parser);
+        FreeInspectData(&Data);
+        
+        if (!Parsed)
+        {
+            return false;
+        }
+    }
+    
+    Result->Name = "parse_inspect";
+    Result->Seconds = Median(Samples);
+    Result->Items = Tokens;
+    return true;
+}
+
+// Parses the corpus once for the stages that run on resolved data.
+static
+bool ParseForStage(const char *Path, inspect_parser *Parser, inspect_data *Data)
+{
+    CreateInspectData(Data);
+    
+    if (!CreateParser(Path, Parser))
+    {
+        printf("Unable to open \"%s\"\n", Path);
+        FreeInspectData(Data);
+        return false;
+    }
+    
+    if (!ParseInspect(Parser, Data))
+    {
+        FreeParser(Parser);
+        FreeInspectData(Data);
+        return false;
+    }
+    
+    return true;
+}
+
+static
+uint64 CountFields(inspect_parser *Parser)
+{
+    uint64 Fields = 0;
+    for (inspect_data_item &StructItem : *Parser->StructList.List)
+    {
+        Fields += GetSlot(StructItem.Dict, StructSlot_Fields).List->size();
+    }
+    
+    return Fields;
+}
+
+// Lexing and parsing together, either on one thread or with the lexer running ahead on
+// another one.
+static
+bool BenchLexParseInspect(bench_options *Options, const char *Path, bool Pipelined, micro_result *Result)
+{
+    std::vector<float64> Samples;
+    uint64 Fields = 0;
+    
+    for (int I = 0; I < Options->Iterations; ++I)
+    {
+        inspect_data Data;
+        CreateInspectData(&Data);
+        
+        float64 Begin = PLATFORM_WALL_CLOCK();
+        
+        inspect_parser Parser;
+        bool Created = Pipelined ? CreatePipelinedParser(Path, &Parser) : CreateParser(Path, &Parser);
+        if (!Created)
+        {
+            printf("Unable to open \"%s\"\n", Path);
+            FreeInspectData(&Data);
+            return false;
+        }
+        
+        bool Parsed = ParseInspect(&Parser, &Data);
+        Samples.push_back(PLATFORM_WALL_CLOCK() - Begin);
+        
+        Fields = CountFields(&Parser);
+        FreeParser(&Parser);
+        FreeInspectData(&Data);
+        
+        if (!Parsed)
+        {
+            return false;
+        }
+    }
+    
+    Result->Name = Pipelined ? "lex_parse_pipelined" : "lex_parse_inspect";
+    Result->Seconds = Median(Samples);
+    Result->Items = Fields;
+    return true;
+}
+
+static
+bool BenchResolveTypes(bench_options *Options, const char *Path, micro_result *Result)
+{
+    inspect_data Data;
+    inspect_parser Parser;
+    if (!ParseForStage(Path, &Parser, &Data))
+    {
+        return false;
+    }
+    
+    uint64 Fields = CountFields(&Parser);
+    Parser.ResolveThreads = (unsigned)Options->ResolveThreads;
+    
+    // Resolving again just overwrites the "Info" references, so every run does the
+    // same amount of work.
+    std::vector<float64> Samples;
+    bool Resolved = true;
+    for (int I = 0; I < Options->Iterations && Resolved; ++I)
+    {
+        float64 Begin = PLATFORM_WALL_CLOCK();
+        Resolved = ResolveTypes(&Parser);
+        Samples.push_back(PLATFORM_WALL_CLOCK() - Begin);
+    }
+    
+    FreeParser(&Parser);
+    FreeInspectData(&Data);
+    
+    Result->Name = "resolve_types";
+    Result->Seconds = Median(Samples);
+    Result->Items = Fields;
+    return Resolved;
+}
+
+#define LOOKUP_CHAIN_DEPTH 8
+#define LOOKUP_KEYS_PER_SCOPE 16
+#define LOOKUP_ROUNDS 2000
+
+// Times Lookup through a chain of nested scopes, the way the evaluator walks from
+// the innermost foreach scope out to the global dict. Hits are spread over every
+// level of the chain, misses always walk the whole chain.
+static
+bool BenchLookup(bench_options *Options, micro_result *HitResult, micro_result *MissResult)
+{
+    inspect_dict *Scopes[LOOKUP_CHAIN_DEPTH];
+    std::vector<std::string> HitKeys;
+    std::vector<std::string> MissKeys;
+    
+    char Key[64];
+    for (int Level = 0; Level < LOOKUP_CHAIN_DEPTH; ++Level)
+    {
+        Scopes[Level] = NewDict();
+        Scopes[Level]->Parent = Level > 0 ? Scopes[Level - 1] : 0;
+        
+        for (int I = 0; I < LOOKUP_KEYS_PER_SCOPE; ++I)
+        {
+            snprintf(Key, sizeof(Key), "scope_%i_key_%i", Level, I);
+            Insert(Scopes[Level], Key, NewIntItem(I));
+            HitKeys.push_back(Key);
+            
+            snprintf(Key, sizeof(Key), "missing_%i_key_%i", Level, I);
+            MissKeys.push_back(Key);
+        }
+    }
+    
+    inspect_dict *Innermost = Scopes[LOOKUP_CHAIN_DEPTH - 1];
+    uint64 Expected = (uint64)LOOKUP_ROUNDS * HitKeys.size();
+    bool Valid = true;
+    
+    micro_result *Results[] = { HitResult, MissResult };
+    std::vector<std::string> *Keys[] = { &HitKeys, &MissKeys };
+    for (int Pass = 0; Pass < 2; ++Pass)
+    {
+        std::vector<float64> Samples;
+        for (int I = 0; I < Options->Iterations; ++I)
+        {
+            uint64 Found = 0;
+            
+            float64 Begin = PLATFORM_WALL_CLOCK();
+            for (int Round = 0; Round < LOOKUP_ROUNDS; ++Round)
+            {
+                for (std::string &Name : *Keys[Pass])
+                {
+                    inspect_data_item Value;
+                    Found += Lookup(Innermost, Name, &Value) ? 1 : 0;
+                }
+            }
+            Samples.push_back(PLATFORM_WALL_CLOCK() - Begin);
+            
+            // Also keeps the lookups from being optimized away.
+            if (Found != (Pass == 0 ? Expected : 0))
+            {
+                printf("Lookup benchmark found %llu of %llu keys\n",
+                       (unsigned long long)Found, (unsigned long long)Expected);
+                Valid = false;
+            }
+        }
+        
+        Results[Pass]->Name = Pass == 0 ? "lookup_hit" : "lookup_miss";
+        Results[Pass]->Seconds = Median(Samples);
+        Results[Pass]->Items = (uint64)LOOKUP_ROUNDS * Keys[Pass]->size();
+    }
+    
+    for (inspect_dict *Scope : Scopes)
+    {
+        FreeInspectDict(Scope);
+        delete Scope;
+    }
+    
+    return Valid;
+}
+
+static
+bool BenchEvaluateTemplate(bench_options *Options, const char *Path, micro_result *Result)
+{
+    inspect_data Data;
+    inspect_parser Parser;
+    if (!ParseForStage(Path, &Parser, &Data))
+    {
+        return false;
+    }
+    
+    Insert(Data.GlobalScope.Dict, "HeaderFile", NewStringItem("bench.gen.h"));
+    Insert(Data.GlobalScope.Dict, "SourceFile", NewStringItem("bench.gen.cpp"));
+    
+    const char *Templates[] = { "data.header", "data.source" };
+    
+    // NOTE: Output goes to the null device so there is no byte count to report,
+    // throughput is given per field like the end-to-end run.
+    std::vector<float64> Samples;
+    bool Evaluated = true;
+    
+    // One write parser is reused for every template and iteration, like a long running
+    // process would.
+    write_parser WriteParser;
+    bool Created = false;
+    
+    for (int I = 0; I < Options->Iterations && Evaluated; ++I)
+    {
+        float64 Elapsed = 0;
+        
+        for (int T = 0; T < (int)ARRAY_SIZE(Templates) && Evaluated; ++T)
+        {
+            char TemplatePath[BENCH_PATH_SIZE];
+            snprintf(TemplatePath, sizeof(TemplatePath), "%s/%s", Options->TemplateDirectory, Templates[T]);
+            
+            bool Started;
+            if (Created)
+            {
+                Started = ResetParser(&WriteParser, TemplatePath, PLATFORM_NULL_DEVICE);
+            }
+            else
+            {
+                Started = CreateParser(&WriteParser, TemplatePath, PLATFORM_NULL_DEVICE);
+            }
+            
+            if (!Started)
+            {
+                printf("Unable to open template \"%s\"\n", TemplatePath);
+                Evaluated = false;
+                break;
+            }
+            
+            Created = true;
+            
+            float64 Begin = PLATFORM_WALL_CLOCK();
+            Evaluated = EvaluateTemplate(&WriteParser, &Data);
+            fflush(WriteParser.Output);
+            Elapsed += PLATFORM_WALL_CLOCK() - Begin;
+            
+            fclose(WriteParser.Output);
+        }
+        
+        Samples.push_back(Elapsed);
+    }
+    
+    if (Created)
+    {
+        FreeParser(&WriteParser);
+    }
+    
+    Result->Name = "evaluate_template";
+    Result->Seconds = Median(Samples);
+    Result->Items = CountFields(&Parser);
+    
+    FreeParser(&Parser);
+    FreeInspectData(&Data);
+    
+    return Evaluated;
+}
+
+static inline
+float64 NanosecondsPerItem(micro_result *Result)
+{
+    return Result->Items ? Result->Seconds * 1000000000.0 / (float64)Result->Items : 0.0;
+}
+
+static
+int NameWidth(std::vector<micro_result> &Results)
+{
+    size_t Width = 18;
+    for (micro_result &Result : Results)
+    {
+        Width = std::max(Width, Result.Name.size());
+    }
+    
+    return (int)Width;
+}
+
+static
+bool WriteTimingJson(const char *Filename, bench_options *Options, std::vector<micro_result> &Results)
+{
+    FILE *File = fopen(Filename, "w");
+    if (!File)
+    {
+        printf("Unable to create \"%s\"\n", Filename);
+        return false;
+    }
+    
+    fprintf(File, "{\n");
+    fprintf(File, "    \"version\": 1,\n");
+    fprintf(File, "    \"iterations\": %i,\n", Options->Iterations);
+    fprintf(File, "    \"benchmarks\": [\n");
+    
+    for (size_t I = 0; I < Results.size(); ++I)
+    {
+        micro_result &Result = Results[I];
+        fprintf(File, "        { \"name\": \"%s\", \"seconds\": %.9f, \"items\": %llu, \"ns_per_item\": %.3f }%s\n",
+                Result.Name.c_str(),
+                Result.Seconds,
+                (unsigned long long)Result.Items,
+                NanosecondsPerItem(&Result),
+                I + 1 < Results.size() ? "," : "");
+    }
+    
+    fprintf(File, "    ]\n");
+    fprintf(File, "}\n");
+    
+    fclose(File);
+    return true;
+}
+
+// NOTE: Only reads back what WriteTimingJson writes, this is not a general json parser.
+static
+bool ReadBaseline(const char *Filename, std::vector<baseline_entry> *Entries)
+{
+    char *Text = ReadEntireFileAndTerminate(Filename);
+    if (!Text)
+    {
+        printf("Unable to read baseline \"%s\"\n", Filename);
+        return false;
+    }
+    
+    const char *NameKey = "\"name\"";
+    const char *SecondsKey = "\"seconds\"";
+    
+    char *At = Text;
+    while ((At = strstr(At, NameKey)) != 0)
+    {
+        char *NameBegin = strchr(At + strlen(NameKey), '"');
+        char *NameEnd = NameBegin ? strchr(NameBegin + 1, '"') : 0;
+        char *Seconds = NameEnd ? strstr(NameEnd, SecondsKey) : 0;
+        char *Value = Seconds ? strchr(Seconds + strlen(SecondsKey), ':') : 0;
+        if (!Value)
+        {
+            printf("Malformed baseline \"%s\"\n", Filename);
+            free(Text);
+            return false;
+        }
+        
+        baseline_entry Entry;
+        Entry.Name.assign(NameBegin + 1, NameEnd);
+        Entry.Seconds = strtod(Value + 1, &At);
+        Entries->push_back(Entry);
+    }
+    
+    free(Text);
+    return true;
+}
+
+static
+int ThresholdFor(bench_options *Options, const char *Name)
+{
+    for (int I = 0; I < Options->ThresholdCount; ++I)
+    {
+        micro_threshold &Threshold = Options->Thresholds[I];
+        if (strlen(Name) == Threshold.NameLength &&
+            strncmp(Name, Threshold.Name, Threshold.NameLength) == 0)
+        {
+            return Threshold.Percent;
+        }
+    }
+    
+    return Options->DefaultThreshold;
+}
+
+// Returns false if any result got slower than its threshold allows.
+static
+bool CompareAgainstBaseline(bench_options *Options, const char *BaselineFile, std::vector<micro_result> &Results)
+{
+    std::vector<baseline_entry> Baseline;
+    if (!ReadBaseline(BaselineFile, &Baseline))
+    {
+        return false;
+    }
+    
+    int Width = NameWidth(Results);
+    printf("\nbaseline: %s\n", BaselineFile);
+    printf("%-*s %12s %12s %9s %9s\n", Width, "name", "base ms", "current ms", "delta", "allowed");
+    
+    bool Passed = true;
+    for (micro_result &Result : Results)
+    {
+        baseline_entry *Entry = 0;
+        for (baseline_entry &Candidate : Baseline)
+        {
+            if (Candidate.Name == Result.Name)
+            {
+                Entry = &Candidate;
+                break;
+            }
+        }
+        
+        if (!Entry || Entry->Seconds <= 0.0)
+        {
+            printf("%-*s %12s %12.3f %9s %9s\n", Width, Result.Name.c_str(), "-", Result.Seconds * 1000.0, "-", "-");
+            continue;
+        }
+        
+        int Threshold = ThresholdFor(Options, Result.Name.c_str());
+        float64 Delta = (Result.Seconds - Entry->Seconds) / Entry->Seconds * 100.0;
+        bool Regressed = Delta > (float64)Threshold &&
+            Result.Seconds - Entry->Seconds > MICRO_NOISE_SECONDS;
+        
+        printf("%-*s %12.3f %12.3f %+8.1f%% %8i%%%s\n",
+               Width,
+               Result.Name.c_str(),
+               Entry->Seconds * 1000.0,
+               Result.Seconds * 1000.0,
+               Delta,
+               Threshold,
+               Regressed ? "  REGRESSION" : "");
+        
+        Passed = Passed && !Regressed;
+    }
+    
+    return Passed;
+}
+
+static
+void PrintResults(std::vector<micro_result> &Results)
+{
+    int Width = NameWidth(Results);
+    printf("%-*s %12s %12s %12s\n", Width, "name", "median ms", "items", "ns/item");
+    for (micro_result &Result : Results)
+    {
+        printf("%-*s %12.3f %12llu %12.2f\n",
+               Width,
+               Result.Name.c_str(),
+               Result.Seconds * 1000.0,
+               (unsigned long long)Result.Items,
+               NanosecondsPerItem(&Result));
+    }
+    fflush(stdout);
+}
+
+static
+bool RunMicro(bench_options *Options)
+{
+    corpus_options Corpus = Options->Corpus;
+    Corpus.StructCount = Options->Sizes[0];
+    Corpus.Flatten = true;
+    
+    char RootPath[BENCH_PATH_SIZE];
+    if (!GenerateCorpus(Options->WorkingDirectory, &Corpus, RootPath, sizeof(RootPath)))
+    {
+        return false;
+    }
+    
+    std::vector<micro_result> Results(9);
+    bool Succeeded = BenchLexInspect(Options, RootPath, &Results[0]) &&
+        BenchLexWrite(Options, &Results[1]) &&
+        BenchParseInspect(Options, RootPath, &Results[2]) &&
+        BenchLexParseInspect(Options, RootPath, false, &Results[3]) &&
+        BenchLexParseInspect(Options, RootPath, true, &Results[4]) &&
+        BenchResolveTypes(Options, RootPath, &Results[5]) &&
+        BenchLookup(Options, &Results[6], &Results[7]) &&
+        BenchEvaluateTemplate(Options, RootPath, &Results[8]);
+    
+    if (!Succeeded)
+    {
+        printf("Stage benchmark failed for \"%s\"\n", RootPath);
+        return false;
+    }
+    
+    PrintResults(Results);
+    
+    if (Options->JsonOutput && !WriteTimingJson(Options->JsonOutput, Options, Results))
+    {
+        return false;
+    }
+    
+    if (Options->Baseline)
+    {
+        return CompareAgainstBaseline(Options, Options->Baseline, Results);
+    }
+    
+    return true;
+}
+
+/*******************************************/
+// Golden corpus
+
+struct golden_template
+{
+    const char *Template;
+    const char *Extension;
+};
+
+// The same templates and output names the codegen tool itself uses.
+static const golden_template GoldenTemplates[] =
+{
+    { "data.header", ".gen.h" },
+    { "data.source", ".gen.cpp" },
+};
+
+#define GOLDEN_TIMING_FILE "golden_timing.json"
+#define GOLDEN_CONTEXT_LENGTH 80
+
+static
+bool ReadFileBytes(const char *Path, std::string *Contents)
+{
+    FILE *File = fopen(Path, "rb");
+    if (!File)
+    {
+        return false;
+    }
+    
+    fseek(File, 0, SEEK_END);
+    long Size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    
+    Contents->resize((size_t)Size);
+    size_t Read = Size > 0 ? fread(&(*Contents)[0], 1, (size_t)Size, File) : 0;
+    fclose(File);
+    
+    return Read == (size_t)Size;
+}
+
+static
+bool WriteFileBytes(const char *Path, std::string &Contents)
+{
+    FILE *File = fopen(Path, "wb");
+    if (!File)
+    {
+        printf("Unable to create \"%s\"\n", Path);
+        return false;
+    }
+    
+    size_t Written = fwrite(Contents.data(), 1, Contents.size(), File);
+    fclose(File);
+    
+    return Written == Contents.size();
+}
+
+static
+void InsertOutputNames(inspect_data *Data, const char *SchemaName)
+{
+    Insert(Data->GlobalScope.Dict, "HeaderFile",
+           ReceiveStringItem(ReplaceExtension(SchemaName, GoldenTemplates[0].Extension)));
+    Insert(Data->GlobalScope.Dict, "SourceFile",
+           ReceiveStringItem(ReplaceExtension(SchemaName, GoldenTemplates[1].Extension)));
+}
+
+// Prints the line of Text that contains Offset, marking the offset with a caret.
+static
+void PrintContext(const char *Label, std::string &Text, size_t Offset)
+{
+    size_t Begin = Offset < Text.size() ? Offset : Text.size();
+    while (Begin > 0 && Text[Begin - 1] != '\n' && Offset - Begin < GOLDEN_CONTEXT_LENGTH)
+    {
+        --Begin;
+    }
+    
+    size_t End = Begin;
+    while (End < Text.size() && Text[End] != '\n' && End - Begin < 2 * GOLDEN_CONTEXT_LENGTH)
+    {
+        ++End;
+    }
+    
+    printf("    %-9s \"%.*s\"\n", Label, (int)(End - Begin), Text.data() + Begin);
+    printf("    %-9s  %*s^\n", "", (int)(Offset - Begin), "");
+}
+
+// Renders the template again with an output probe set on the diverging byte and
+// reports which template token wrote it, and for which model item.
+static
+void ExplainDivergence(const char *SchemaPath,
+                       const char *SchemaName,
+                       const char *TemplatePath,
+                       const char *OutputPath,
+                       size_t Offset)
+{
+    inspect_data Data;
+    inspect_parser Parser;
+    if (!ParseForStage(SchemaPath, &Parser, &Data))
+    {
+        return;
+    }
+    
+    InsertOutputNames(&Data, SchemaName);
+    
+    write_parser WriteParser;
+    if (CreateParser(&WriteParser, TemplatePath, OutputPath))
+    {
+        WriteParser.Probe.Offset = (long)Offset;
+        EvaluateTemplate(&WriteParser, &Data);
+        
+        output_probe &Probe = WriteParser.Probe;
+        if (Probe.Hit)
+        {
+            wtoken_info &Template = Probe.Token;
+            printf("    template: ");
+            PrintLocation(&Template);
+            printf("%.*s\n", (int)Template.Length, TokenText(&Template));
+            
+            if (Probe.HasModel)
+            {
+                itoken_info &Source = Probe.Model;
+                printf("    model:    ");
+                PrintLocation(&Source);
+                printf("%.*s\n", (int)Source.Length, TokenText(&Source));
+            }
+            else
+            {
+                printf("    model:    (not inside a struct or field)\n");
+            }
+        }
+        else
+        {
+            printf("    template: (output ends before the divergence)\n");
+        }
+        
+        fclose(WriteParser.Output);
+        FreeParser(&WriteParser);
+    }
+    
+    FreeParser(&Parser);
+    FreeInspectData(&Data);
+}
+
+// Returns false if the output differs from the golden file.
+static
+bool CompareWithGolden(const char *SchemaPath,
+                       const char *SchemaName,
+                       const char *TemplatePath,
+                       const char *OutputPath,
+                       const char *GoldenPath)
+{
+    std::string Output;
+    std::string Golden;
+    if (!ReadFileBytes(OutputPath, &Output))
+    {
+        printf("%s -- unable to read output\n", OutputPath);
+        return false;
+    }
+    
+    if (!ReadFileBytes(GoldenPath, &Golden))
+    {
+        printf("%s -- no golden file \"%s\"\n", OutputPath, GoldenPath);
+        return false;
+    }
+    
+    if (Output == Golden)
+    {
+        return true;
+    }
+    
+    size_t Offset = 0;
+    while (Offset < Output.size() && Offset < Golden.size() && Output[Offset] == Golden[Offset])
+    {
+        ++Offset;
+    }
+    
+    int Line = 1;
+    int Column = 1;
+    for (size_t I = 0; I < Offset; ++I)
+    {
+        if (Output[I] == '\n')
+        {
+            ++Line;
+            Column = 1;
+        }
+        else
+        {
+            ++Column;
+        }
+    }
+    
+    PrintLocation(Line, Column, OutputPath);
+    printf("differs from \"%s\" at byte %llu (%llu bytes, golden %llu bytes)\n",
+           GoldenPath,
+           (unsigned long long)Offset,
+           (unsigned long long)Output.size(),
+           (unsigned long long)Golden.size());
+    PrintContext("expected:", Golden, Offset);
+    PrintContext("actual:", Output, Offset);
+    
+    ExplainDivergence(SchemaPath, SchemaName, TemplatePath, OutputPath, Offset);
+    return false;
+}
+
+static
+bool RunGoldenSchema(bench_options *Options,
+                     const char *SchemaName,
+                     std::vector<micro_result> *Timings,
+                     bool *Matched)
+{
+    const int TemplateCount = (int)ARRAY_SIZE(GoldenTemplates);
+    
+    char SchemaPath[BENCH_PATH_SIZE];
+    char TemplatePaths[TemplateCount][BENCH_PATH_SIZE];
+    char OutputPaths[TemplateCount][BENCH_PATH_SIZE];
+    char GoldenPaths[TemplateCount][BENCH_PATH_SIZE];
+    std::string OutputNames[TemplateCount];
+    snprintf(SchemaPath, sizeof(SchemaPath), "%s/%s", Options->GoldenSchemas, SchemaName);
+    
+    for (int T = 0; T < TemplateCount; ++T)
+    {
+        char *OutputName = ReplaceExtension(SchemaName, GoldenTemplates[T].Extension);
+        OutputNames[T] = OutputName;
+        free(OutputName);
+        
+        snprintf(TemplatePaths[T], BENCH_PATH_SIZE, "%s/%s", Options->TemplateDirectory, GoldenTemplates[T].Template);
+        snprintf(OutputPaths[T], BENCH_PATH_SIZE, "%s/%s", Options->WorkingDirectory, OutputNames[T].c_str());
+        snprintf(GoldenPaths[T], BENCH_PATH_SIZE, "%s/%s", Options->GoldenDirectory, OutputNames[T].c_str());
+    }
+    
+    std::vector<float64> ParseSamples;
+    std::vector<float64> RenderSamples[TemplateCount];
+    uint64 OutputBytes[TemplateCount] = {};
+    
+    for (int I = 0; I < Options->Iterations; ++I)
+    {
+        float64 Begin = PLATFORM_WALL_CLOCK();
+        
+        inspect_data Data;
+        inspect_parser Parser;
+        if (!ParseForStage(SchemaPath, &Parser, &Data))
+        {
+            printf("%s -- FAILED to parse\n", SchemaPath);
+            return false;
+        }
+        
+        ParseSamples.push_back(PLATFORM_WALL_CLOCK() - Begin);
+        InsertOutputNames(&Data, SchemaName);
+        
+        bool Rendered = true;
+        for (int T = 0; T < TemplateCount && Rendered; ++T)
+        {
+            float64 RenderBegin = PLATFORM_WALL_CLOCK();
+            OutputBytes[T] = 0;
+            Rendered = RenderTemplate(&Data, TemplatePaths[T], OutputPaths[T], &OutputBytes[T]);
+            RenderSamples[T].push_back(PLATFORM_WALL_CLOCK() - RenderBegin);
+        }
+        
+        FreeParser(&Parser);
+        FreeInspectData(&Data);
+        
+        if (!Rendered)
+        {
+            printf("%s -- FAILED to render\n", SchemaPath);
+            return false;
+        }
+    }
+    
+    micro_result Timing;
+    Timing.Name = SchemaName;
+    Timing.Seconds = Median(ParseSamples);
+    Timing.Items = 0;
+    Timings->push_back(Timing);
+    
+    for (int T = 0; T < TemplateCount; ++T)
+    {
+        Timing.Name = OutputNames[T];
+        Timing.Seconds = Median(RenderSamples[T]);
+        Timing.Items = OutputBytes[T];
+        Timings->push_back(Timing);
+        
+        if (Options->Record)
+        {
+            std::string Output;
+            if (!ReadFileBytes(OutputPaths[T], &Output) || !WriteFileBytes(GoldenPaths[T], Output))
+            {
+                printf("%s -- unable to record golden file\n", GoldenPaths[T]);
+                return false;
+            }
+        }
+        else if (!CompareWithGolden(SchemaPath, SchemaName, TemplatePaths[T], OutputPaths[T], GoldenPaths[T]))
+        {
+            *Matched = false;
+        }
+    }
+    
+    return true;
+}
+
+static inline
+bool HasExtension(std::string &Filename, const char *Extension)
+{
+    size_t Length = strlen(Extension);
+    return Filename.size() > Length &&
+        Filename.compare(Filename.size() - Length, Length, Extension) == 0;
+}
+
+static
+bool RunGolden(bench_options *Options)
+{
+    if (!PLATFORM_MAKE_DIRECTORY(Options->WorkingDirectory) ||
+        (Options->Record && !PLATFORM_MAKE_DIRECTORY(Options->GoldenDirectory)))
+    {
+        printf("Unable to create output directories\n");
+        return false;
+    }
+    
+    std::vector<std::string> Files;
+    if (!PLATFORM_LIST_FILES(Options->GoldenSchemas, &Files))
+    {
+        printf("Unable to list \"%s\"\n", Options->GoldenSchemas);
+        return false;
+    }
+    
+    std::vector<std::string> Schemas;
+    for (std::string &File : Files)
+    {
+        if (HasExtension(File, ".ins"))
+        {
+            Schemas.push_back(File);
+        }
+    }
+    
+    // Sorted so the report (and the recorded timings) don't depend on directory order.
+    std::sort(Schemas.begin(), Schemas.end());
+    
+    if (Schemas.empty())
+    {
+        printf("No .ins files found in \"%s\"\n", Options->GoldenSchemas);
+        return false;
+    }
+    
+    std::vector<micro_result> Timings;
+    int Diverged = 0;
+    for (std::string &Schema : Schemas)
+    {
+        bool Matched = true;
+        if (!RunGoldenSchema(Options, Schema.c_str(), &Timings, &Matched))
+        {
+            return false;
+        }
+        
+        Diverged += Matched ? 0 : 1;
+    }
+    
+    PrintResults(Timings);
+    
+    char TimingPath[BENCH_PATH_SIZE];
+    snprintf(TimingPath, sizeof(TimingPath), "%s/%s", Options->GoldenDirectory, GOLDEN_TIMING_FILE);
+    
+    if (Options->Record)
+    {
+        printf("\nRecorded golden output for %i schemas in \"%s\"\n",
+               (int)Schemas.size(), Options->GoldenDirectory);
+        return WriteTimingJson(TimingPath, Options, Timings);
+    }
+    
+    if (Options->JsonOutput && !WriteTimingJson(Options->JsonOutput, Options, Timings))
+    {
+        return false;
+    }
+    
+    bool TimingPassed = CompareAgainstBaseline(Options, TimingPath, Timings);
+    
+    printf("\n%i of %i schemas match the golden output\n", (int)Schemas.size() - Diverged, (int)Schemas.size());
+    return Diverged == 0 && TimingPassed;
+}
+
+/*******************************************/
+// Library API
+
+// Schemas for the library checks, only ever handed over as text. "sub/more.ins" imports
+// "../types.ins" which the root also imports as "types.ins", the same diamond the
+// synthetic corpus has, and "resolved.ins" is only known to the resolve callback. Only
+// the structs of the root are rendered, it uses a type from every import.
+static const char LibraryRootSchema[] =
+    "import \"types.ins\";\n"
+    "import \"sub/more.ins\";\n"
+    "import \"resolved.ins\";\n"
+    "struct Root\n"
+    "{\n"
+    "    Id Key;\n"
+    "    More Child;\n"
+    "    Resolved Counted;\n"
+    "};\n";
+
+static const char LibraryTypesSchema[] =
+    "declare_type int32 INT32_TD;\n"
+    "declare_type Id ID_TD;\n";
+
+static const char LibraryMoreSchema[] =
+    "import \"../types.ins\";\n"
+    "struct More\n"
+    "{\n"
+    "    Id Key;\n"
+    "};\n";
+
+static const char LibraryResolvedSchema[] =
+    "struct Resolved\n"
+    "{\n"
+    "    int32 Count;\n"
+    "};\n";
+
+static const char LibraryBrokenSchema[] =
+    "import \"nowhere.ins\";\n";
+
+static const char LibraryTemplate[] =
+    "$ HeaderFile $:$ foreach struct in Structs $ $ struct.Name $$ end $";
+
+// The model is read only to templates, only the template's own variables can be assigned.
+static const char LibraryAssignTemplate[] =
+    "$ Name = \"x\" $$ foreach struct in Structs $$ struct.Name = Name $$ end $";
+
+#define LIBRARY_ROOT "lib/root.ins"
+#define LIBRARY_TEMPLATE "lib/names.template"
+#define LIBRARY_ASSIGN_TEMPLATE "lib/assign.template"
+#define LIBRARY_BUFFER_SIZE 4096
+
+static
+bool ResolveLibrarySource(void *User, const char *Path, const char **Text, size_t *Length)
+{
+    if (strcmp(Path, "lib/resolved.ins") != 0)
+    {
+        return false;
+    }
+    
+    *Text = LibraryResolvedSchema;
+    *Length = sizeof(LibraryResolvedSchema) - 1;
+    return true;
+}
+
+static inline
+void AddLibrarySource(codegen_context *Context, const char *Path, const char *Text)
+{
+    CodegenAddSource(Context, Path, Text, strlen(Text));
+}
+
+static
+bool ReportLibraryCheck(codegen_context *Context, const char *Name, bool Passed)
+{
+    printf("%-36s %s\n", Name, Passed ? "ok" : "FAILED");
+    if (!Passed)
+    {
+        printf("%s", CodegenGetErrors(Context));
+    }
+    
+    fflush(stdout);
+    return Passed;
+}
+
+static
+bool RenderMatches(codegen_context *Context, codegen_model *Model, const char *Expected)
+{
+    char Buffer[LIBRARY_BUFFER_SIZE];
+    size_t Length;
+    if (!CodegenRender(Context, Model, LIBRARY_TEMPLATE, Buffer, sizeof(Buffer), &Length))
+    {
+        return false;
+    }
+    
+    if (Length != strlen(Expected) || strcmp(Buffer, Expected) != 0)
+    {
+        printf("expected \"%s\", rendered \"%s\"\n", Expected, Buffer);
+        return false;
+    }
+    
+    return true;
+}
+
+static
+bool RunLibraryChecks()
+{
+    codegen_options LibraryOptions = {};
+    LibraryOptions.Resolve = ResolveLibrarySource;
+    
+    codegen_context *Context = CodegenCreateContext(&LibraryOptions);
+    AddLibrarySource(Context, LIBRARY_ROOT, LibraryRootSchema);
+    AddLibrarySource(Context, "lib/types.ins", LibraryTypesSchema);
+    AddLibrarySource(Context, "lib/sub/more.ins", LibraryMoreSchema);
+    AddLibrarySource(Context, "lib/broken.ins", LibraryBrokenSchema);
+    AddLibrarySource(Context, LIBRARY_TEMPLATE, LibraryTemplate);
+    AddLibrarySource(Context, LIBRARY_ASSIGN_TEMPLATE, LibraryAssignTemplate);
+    
+    codegen_model *Model = CodegenParse(Context, LIBRARY_ROOT);
+    bool Passed = ReportLibraryCheck(Context, "in-memory sources and imports", Model != nullptr);
+    if (Model)
+    {
+        const char *Expected = "root.gen.h: Root";
+        
+        CodegenSetString(Context, "HeaderFile", "root.gen.h");
+        Passed &= ReportLibraryCheck(Context, "render", RenderMatches(Context, Model, Expected));
+        
+        char Small[4];
+        size_t Length = 0;
+        bool Fits = CodegenRender(Context, Model, LIBRARY_TEMPLATE, Small, sizeof(Small), &Length);
+        Passed &= ReportLibraryCheck(Context, "render into a buffer too small",
+                                     !Fits && Length == strlen(Expected));
+        
+        Length = 0;
+        bool Missing = CodegenRender(Context, Model, "lib/missing.template", Small, sizeof(Small), &Length);
+        Passed &= ReportLibraryCheck(Context, "render a missing template",
+                                     !Missing && Length == 0 &&
+                                     strstr(CodegenGetErrors(Context), "Unable to open template"));
+        
+        // NOTE: The context keeps its renderer between renders, a failed one mustn't break it.
+        Passed &= ReportLibraryCheck(Context, "render after a failed render",
+                                     RenderMatches(Context, Model, Expected));
+        
+        char Assigned[LIBRARY_BUFFER_SIZE];
+        bool Rendered = CodegenRender(Context, Model, LIBRARY_ASSIGN_TEMPLATE, Assigned, sizeof(Assigned), &Length);
+        Passed &= ReportLibraryCheck(Context, "assign to a model value",
+                                     !Rendered &&
+                                     strstr(CodegenGetErrors(Context),
+                                            "Can't assign to \"Name\", model values are read-only") &&
+                                     RenderMatches(Context, Model, Expected));
+        
+        // Strings set on one context aren't seen by another rendering the same model.
+        codegen_context *Other = CodegenCreateContext(&LibraryOptions);
+        AddLibrarySource(Other, LIBRARY_TEMPLATE, LibraryTemplate);
+        CodegenSetString(Other, "HeaderFile", "other.gen.h");
+        Passed &= ReportLibraryCheck(Other, "render from a second context",
+                                     RenderMatches(Other, Model, "other.gen.h: Root") &&
+                                     RenderMatches(Context, Model, Expected));
+        CodegenFreeContext(Other);
+        
+        CodegenFreeModel(Model);
+    }
+    
+    codegen_model *Broken = CodegenParse(Context, "lib/broken.ins");
+    Passed &= ReportLibraryCheck(Context, "parse with a missing import", !Broken);
+    if (Broken)
+    {
+        CodegenFreeModel(Broken);
+    }
+    
+    CodegenFreeContext(Context);
+    return Passed;
+}
+
+// Every broken field is parsed as the only field of struct A in this schema.
+static const char FieldDiagnosticSchema[] =
+    "declare_type int32 INT32_TD;\n"
+    "declare_type list LIST_TD;\n"
+    "struct A\n"
+    "{\n"
+    "    %s\n"
+    "};\n"
+    "struct B\n"
+    "{\n"
+    "    int32 ok;\n"
+    "};\n";
+
+struct field_diagnostic
+{
+    const char *Field;
+    const char *Errors;
+};
+
+// What parsing a broken field reports, word for word. It is what the parser said when
+// it still went through fields back to front.
+static const field_diagnostic FieldDiagnostics[] =
+{
+    { "int32 a }", "diag.ins:6:1: Expected: \"Identifier\", Found: \"}\"\n" },
+    { "int32;", "diag.ins:4:1: Unexpected Identifier.\n\n" },
+    { ";", "diag.ins:4:1: Unexpected \";\"\n\n" },
+    { "list<> a;", "diag.ins:5:9: Expected: \"Identifier\", Found: \"<\"\n" },
+    { "list<int32,> a;", "diag.ins:5:15: Expected: \"Identifier\", Found: \",\"\n" },
+    { "list<int32>> a;", "diag.ins:4:1: Unexpected token \"{\"\n" },
+    { "int32 *;", "diag.ins:5:11: Expected: \"Identifier\", Found: \"*\"\n" },
+    { "5 a;", "diag.ins:5:5: Expected: \"Identifier\", Found: \"5\"\n" },
+    { "int32 a(x);", "diag.ins:5:12: Expected: \"Identifier\", Found: \"(\"\n" },
+    { "int32 a(int32 x) b;", "diag.ins:5:20: Expected: \"Identifier\", Found: \")\"\n" },
+    { "int32 a(int32 x", "diag.ins:6:1: Expected: \"Identifier\", Found: \"}\"\n" },
+    { "int32 a(int32 x, [Y()] int32 y);", "diag.ins:5:22: Expected: \"Identifier\", Found: \"[\"\n" },
+};
+
+#define FIELD_DIAGNOSTIC_SIZE 1024
+
+static
+bool ParseField(codegen_context *Context, const char *Field, codegen_model **Model)
+{
+    char Schema[FIELD_DIAGNOSTIC_SIZE];
+    int Length = snprintf(Schema, sizeof(Schema), FieldDiagnosticSchema, Field);
+    if (Length < 0 || (size_t)Length >= sizeof(Schema))
+    {
+        printf("Field \"%s\" is too long\n", Field);
+        return false;
+    }
+    
+    CodegenAddSource(Context, "diag.ins", Schema, (size_t)Length);
+    *Model = CodegenParse(Context, "diag.ins");
+    return true;
+}
+
+static
+bool RunFieldDiagnostics()
+{
+    codegen_options LibraryOptions = {};
+    codegen_context *Context = CodegenCreateContext(&LibraryOptions);
+    
+    int Matched = 0;
+    for (const field_diagnostic &Diagnostic : FieldDiagnostics)
+    {
+        codegen_model *Model;
+        if (!ParseField(Context, Diagnostic.Field, &Model))
+        {
+            continue;
+        }
+        
+        const char *Errors = CodegenGetErrors(Context);
+        if (Model || strcmp(Errors, Diagnostic.Errors) != 0)
+        {
+            printf("field \"%s\" reported:\n%sexpected:\n%s",
+                   Diagnostic.Field, Errors, Diagnostic.Errors);
+        }
+        else
+        {
+            ++Matched;
+        }
+        
+        if (Model)
+        {
+            CodegenFreeModel(Model);
+        }
+    }
+    
+    int Count = (int)ARRAY_SIZE(FieldDiagnostics);
+    bool Passed = ReportLibraryCheck(Context, "field diagnostics", Matched == Count);
+    
+    // Method arguments reach templates last to first.
+    static const char ArgumentTemplate[] =
+        "$ foreach struct in Structs $$ foreach field in struct.Fields $"
+        "$ if field.IsMethod $$ foreach argument in field.MethodArguments $ $ argument.Name $$ end $$ end $"
+        "$ end $$ end $";
+    CodegenAddSource(Context, "arguments.template", ArgumentTemplate, sizeof(ArgumentTemplate) - 1);
+    
+    codegen_model *Model;
+    bool Ordered = false;
+    if (ParseField(Context, "int32 a(int32 x, int32 y, list<int32> z);", &Model) && Model)
+    {
+        char Buffer[LIBRARY_BUFFER_SIZE];
+        size_t Length;
+        Ordered = CodegenRender(Context, Model, "arguments.template", Buffer, sizeof(Buffer), &Length) &&
+            strcmp(Buffer, " z y x") == 0;
+        CodegenFreeModel(Model);
+    }
+    
+    Passed &= ReportLibraryCheck(Context, "method argument order", Ordered);
+    
+    CodegenFreeContext(Context);
+    return Passed;
+}
+
+// No template expression makes a new container yet, so the evaluator's side of an
+// assignment is driven directly: a list pushed on the frame like a temporary and stored
+// into a scope. The scope has to own it afterwards and free it exactly once, run under
+// AddressSanitizer to catch the leak or the double free.
+static
+bool RunAssignmentOwnership()
+{
+    write_parser Parser;
+    inspect_data_item ScopeItem = NewDictItem();
+    
+    bool Owned = false;
+    {
+        stack_frame Frame(&Parser);
+        
+        inspect_data_item List = NewListItem();
+        List.List->push_back(NewStringItem("owned"));
+        Parser.ItemStack.PushItem(List);
+        
+        inspect_data_item Result;
+        StoreAssignedValue(&Frame, ScopeItem.Dict, "x", &List, &Result);
+        
+        auto It = ScopeItem.Dict->Lookup.find("x");
+        Owned = It != ScopeItem.Dict->Lookup.end() &&
+            It->second.List == List.List && !It->second.IsReference &&
+            Result.IsReference && Parser.ItemStack.Items.empty();
+    }
+    
+    FreeDataItem(&ScopeItem);
+    
+    printf("%-36s %s\n", "assign an owned container", Owned ? "ok" : "FAILED");
+    fflush(stdout);
+    return Owned;
+}
+
+// Opens files until the source file table is full. Adding one more has to fail instead of
+// handing out an index some other file already has, and closing one makes room again.
+static
+bool RunSourceFileLimit()
+{
+    static char Filename[] = "limit.ins";
+    static char Text[] = "";
+    
+    std::vector<uint16> Files;
+    uint16 File;
+    while (Files.size() < MAX_SOURCE_FILES && AddSourceFile(Filename, Text, &File))
+    {
+        Files.push_back(File);
+    }
+    
+    bool Full = !Files.empty() && !AddSourceFile(Filename, Text, &File);
+    
+    bool Reopened = false;
+    if (Full)
+    {
+        RemoveSourceFile(Files.back());
+        Files.pop_back();
+        
+        Reopened = AddSourceFile(Filename, Text, &File);
+        if (Reopened)
+        {
+            Files.push_back(File);
+        }
+    }
+    
+    for (uint16 Open : Files)
+    {
+        RemoveSourceFile(Open);
+    }
+    
+    bool Passed = Full && Reopened;
+    printf("%-36s %s\n", "source file table full", Passed ? "ok" : "FAILED");
+    fflush(stdout);
+    return Passed;
+}
+
+static
+bool AddLibraryFile(codegen_context *Context, const char *Path)
+{
+    std::string Text;
+    if (!ReadFileBytes(Path, &Text))
+    {
+        printf("Unable to read \"%s\"\n", Path);
+        return false;
+    }
+    
+    CodegenAddSource(Context, Path, Text.data(), Text.size());
+    return true;
+}
+
+// Renders the template into Output, asking for the length first like a caller without a
+// big enough buffer would.
+static
+bool RenderLibraryTemplate(codegen_context *Context, codegen_model *Model,
+                           const char *TemplatePath, std::vector<char> *Output)
+{
+    size_t Length;
+    if (Output->empty() &&
+        (CodegenRender(Context, Model, TemplatePath, nullptr, 0, &Length) || Length == 0))
+    {
+        printf("Render of \"%s\" without a buffer didn't ask for one\n%s",
+               TemplatePath, CodegenGetErrors(Context));
+        return false;
+    }
+    
+    if (Output->empty())
+    {
+        Output->resize(Length + 1);
+    }
+    
+    if (!CodegenRender(Context, Model, TemplatePath, Output->data(), Output->size(), &Length))
+    {
+        printf("Unable to render \"%s\"\n%s", TemplatePath, CodegenGetErrors(Context));
+        return false;
+    }
+    
+    return true;
+}
+
+// Parses and renders the synthetic corpus through the library with every file added as
+// text, checks the output is the same as the command line pipeline's and times it.
+static
+bool RunLibraryCorpus(bench_options *Options)
+{
+    corpus_options Corpus = Options->Corpus;
+    Corpus.StructCount = Options->Sizes[0];
+    
+    char RootPath[BENCH_PATH_SIZE];
+    pipeline_timing PipelineTiming;
+    if (!GenerateCorpus(Options->WorkingDirectory, &Corpus, RootPath, sizeof(RootPath)) ||
+        !RunPipeline(Options, RootPath, &PipelineTiming))
+    {
+        printf("Pipeline failed for \"%s\"\n", RootPath);
+        return false;
+    }
+    
+    const char *Templates[] = { "data.header", "data.source" };
+    const char *Outputs[] = { "bench.gen.h", "bench.gen.cpp" };
+    const int TemplateCount = (int)ARRAY_SIZE(Templates);
+    char TemplatePaths[TemplateCount][BENCH_PATH_SIZE];
+    
+    codegen_options LibraryOptions = {};
+    LibraryOptions.ParallelImports = Options->ParallelImports;
+    codegen_context *Context = CodegenCreateContext(&LibraryOptions);
+    CodegenSetString(Context, "HeaderFile", Outputs[0]);
+    CodegenSetString(Context, "SourceFile", Outputs[1]);
+    
+    bool Added = AddLibraryFile(Context, RootPath);
+    for (int I = 0; I < Corpus.ImportFanOut && Added; ++I)
+    {
+        char Filename[BENCH_PATH_SIZE];
+        char Path[BENCH_PATH_SIZE];
+        ImportFilename(I, Filename, sizeof(Filename));
+        int Length = snprintf(Path, sizeof(Path), "%s/%s", Options->WorkingDirectory, Filename);
+        if (Length < 0 || (size_t)Length >= sizeof(Path))
+        {
+            printf("Path of import file %i in \"%s\" is too long\n", I, Options->WorkingDirectory);
+            Added = false;
+        }
+        else
+        {
+            Added = AddLibraryFile(Context, Path);
+        }
+    }
+    
+    for (int T = 0; T < TemplateCount && Added; ++T)
+    {
+        snprintf(TemplatePaths[T], BENCH_PATH_SIZE, "%s/%s", Options->TemplateDirectory, Templates[T]);
+        Added = AddLibraryFile(Context, TemplatePaths[T]);
+    }
+    
+    if (!Added)
+    {
+        CodegenFreeContext(Context);
+        return false;
+    }
+    
+    std::vector<float64> ParseSamples;
+    std::vector<float64> RenderSamples;
+    std::vector<char> Output[TemplateCount];
+    for (int I = 0; I < Options->Iterations; ++I)
+    {
+        float64 Begin = PLATFORM_WALL_CLOCK();
+        
+        codegen_model *Model = CodegenParse(Context, RootPath);
+        if (!Model)
+        {
+            printf("Unable to parse \"%s\"\n%s", RootPath, CodegenGetErrors(Context));
+            CodegenFreeContext(Context);
+            return false;
+        }
+        
+        float64 Parsed = PLATFORM_WALL_CLOCK();
+        
+        bool Rendered = true;
+        for (int T = 0; T < TemplateCount && Rendered; ++T)
+        {
+            Rendered = RenderLibraryTemplate(Context, Model, TemplatePaths[T], &Output[T]);
+        }
+        
+        RenderSamples.push_back(PLATFORM_WALL_CLOCK() - Parsed);
+        ParseSamples.push_back(Parsed - Begin);
+        CodegenFreeModel(Model);
+        
+        if (!Rendered)
+        {
+            CodegenFreeContext(Context);
+            return false;
+        }
+    }
+    
+    CodegenFreeContext(Context);
+    
+    bool Matched = true;
+    for (int T = 0; T < TemplateCount; ++T)
+    {
+        char OutputPath[BENCH_PATH_SIZE];
+        snprintf(OutputPath, sizeof(OutputPath), "%s/%s", Options->WorkingDirectory, Outputs[T]);
+        
+        std::string Expected;
+        if (!ReadFileBytes(OutputPath, &Expected))
+        {
+            printf("Unable to read \"%s\"\n", OutputPath);
+            return false;
+        }
+        
+        if (Expected != Output[T].data())
+        {
+            printf("%s rendered by the library differs from \"%s\"\n", Templates[T], OutputPath);
+            Matched = false;
+        }
+    }
+    
+    printf("%-36s %s\n", "corpus output matches the pipeline", Matched ? "ok" : "FAILED");
+    printf("library parse: %.3f ms, render: %.3f ms (median)\n",
+           Median(ParseSamples) * 1000.0,
+           Median(RenderSamples) * 1000.0);
+    fflush(stdout);
+    
+    return Matched;
+}
+
+static
+bool RunLibrary(bench_options *Options)
+{
+    bool Passed = RunLibraryChecks();
+    Passed &= RunFieldDiagnostics();
+    Passed &= RunAssignmentOwnership();
+    Passed &= RunSourceFileLimit();
+    return RunLibraryCorpus(Options) && Passed;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options Options;
+    if (!CreateBenchOptions(argc, argv, &Options))
+    {
+        return BENCH_FAILURE;
+    }
+    
+    if (Options.DoNotRun)
+    {
+        return BENCH_SUCCESS;
+    }
+    
+    if (Options.GoldenSchemas)
+    {
+        printf("schemas: %s, golden: %s, iterations: %i\n",
+               Options.GoldenSchemas,
+               Options.GoldenDirectory,
+               Options.Iterations);
+        
+        return RunGolden(&Options) ? BENCH_SUCCESS : BENCH_FAILURE;
+    }
+    
+    if (Options.Micro)
+    {
+        printf("structs: %i, fields/struct: %i, attribute density: %i%%, iterations: %i\n",
+               Options.Sizes[0],
+               Options.Corpus.FieldsPerStruct,
+               Options.Corpus.AttributeDensity,
+               Options.Iterations);
+        
+        return RunMicro(&Options) ? BENCH_SUCCESS : BENCH_FAILURE;
+    }
+    
+    if (Options.Library)
+    {
+        printf("structs: %i, imports: %i, iterations: %i\n",
+               Options.Sizes[0],
+               Options.Corpus.ImportFanOut,
+               Options.Iterations);
+        
+        return RunLibrary(&Options) ? BENCH_SUCCESS : BENCH_FAILURE;
+    }
+    
+    printf("fields/struct: %i, attribute density: %i%%, imports: %i, list nesting: %i, iterations: %i\n",
+           Options.Corpus.FieldsPerStruct,
+           Options.Corpus.AttributeDensity,
+           Options.Corpus.ImportFanOut,
+           Options.Corpus.ListNesting,
+           Options.Iterations);
+    
+    // NOTE: Peak memory is the high water mark of the whole process. Sizes run in the
+    // order given, so for an ascending list it tracks the largest corpus so far.
+    printf("%8s %9s %10s %10s %10s %10s %10s %12s %9s %9s\n",
+           "structs", "fields", "parse ms", "render ms", "p50 ms", "p90 ms", "p99 ms",
+           "fields/s", "out MB/s", "peak MB");
+    
+    for (int I = 0; I < Options.SizeCount; ++I)
+    {
+        if (!RunSize(&Options, Options.Sizes[I]))
+        {
+            return BENCH_FAILURE;
+        }
+    }
+    
+    return BENCH_SUCCESS;
+}
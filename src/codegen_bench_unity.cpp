@@ -0,0 +1,15 @@
+
+#include "codegen_inspect_data.cpp"
+#include "codegen_lex_base.cpp"
+#include "codegen_lex_inspect.cpp"
+#include "codegen_lex_pipeline.cpp"
+#include "codegen_parse_inspect.cpp"
+#include "codegen_module.cpp"
+
+#include "codegen_lex_write.cpp"
+#include "codegen_parse_write.cpp"
+
+#include "codegen_library.cpp"
+
+// NOTE: Comes last so the stage benchmarks can reach the static parser functions.
+#include "codegen_bench.cpp"
@@ -0,0 +1,179 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "numeric_types.h"
+#include "compiler_utils.h"
+
+// Plain little helpers for the binary files codegen writes for itself (snapshots and
+// modules). Values are written in the byte order of the machine, the files are caches
+// and never move between machines.
+
+struct binary_writer
+{
+    std::vector<uint8> Bytes;
+};
+
+// Every read is checked against the end of the data. Once one fails every later one
+// does too, so a truncated or damaged file only has to be checked for at the end.
+struct binary_reader
+{
+    uint8 *At;
+    uint8 *End;
+    bool Failed;
+};
+
+inline
+void WriteBytes(binary_writer *Writer, const void *Data, size_t Length)
+{
+    const uint8 *Bytes = (const uint8 *)Data;
+    Writer->Bytes.insert(Writer->Bytes.end(), Bytes, Bytes + Length);
+}
+
+inline
+void WriteU32(binary_writer *Writer, uint32 Value)
+{
+    WriteBytes(Writer, &Value, sizeof(Value));
+}
+
+inline
+void WriteU64(binary_writer *Writer, uint64 Value)
+{
+    WriteBytes(Writer, &Value, sizeof(Value));
+}
+
+inline
+void WriteString(binary_writer *Writer, const std::string &String)
+{
+    WriteU32(Writer, (uint32)String.size());
+    WriteBytes(Writer, String.data(), String.size());
+}
+
+// Reserves room for the hash of everything written after it, see FinishHashedSection.
+inline
+size_t BeginHashedSection(binary_writer *Writer)
+{
+    size_t HashAt = Writer->Bytes.size();
+    WriteU64(Writer, 0);
+    return HashAt;
+}
+
+inline
+void FinishHashedSection(binary_writer *Writer, size_t HashAt)
+{
+    size_t SectionAt = HashAt + sizeof(uint64);
+    uint64 Hash = fnv64(Writer->Bytes.data() + SectionAt, Writer->Bytes.size() - SectionAt);
+    memcpy(Writer->Bytes.data() + HashAt, &Hash, sizeof(Hash));
+}
+
+inline
+bool WriteBinaryFile(const char *Path, binary_writer *Writer)
+{
+    FILE *File = fopen(Path, "wb");
+    if (!File)
+    {
+        return false;
+    }
+    
+    bool Written = fwrite(Writer->Bytes.data(), 1, Writer->Bytes.size(), File) == Writer->Bytes.size();
+    fclose(File);
+    
+    if (!Written)
+    {
+        remove(Path);
+    }
+    
+    return Written;
+}
+
+inline
+bool ReadBinaryFile(const char *Path, std::vector<uint8> *Bytes)
+{
+    FILE *File = fopen(Path, "rb");
+    if (!File)
+    {
+        return false;
+    }
+    
+    uint8 Buffer[1 << 16];
+    size_t Read;
+    while ((Read = fread(Buffer, 1, sizeof(Buffer), File)) > 0)
+    {
+        Bytes->insert(Bytes->end(), Buffer, Buffer + Read);
+    }
+    
+    fclose(File);
+    return true;
+}
+
+inline
+void CreateBinaryReader(binary_reader *Reader, std::vector<uint8> *Bytes)
+{
+    Reader->At = Bytes->data();
+    Reader->End = Bytes->data() + Bytes->size();
+    Reader->Failed = false;
+}
+
+inline
+size_t BytesLeft(binary_reader *Reader)
+{
+    return (size_t)(Reader->End - Reader->At);
+}
+
+inline
+bool ReadBytes(binary_reader *Reader, void *Data, size_t Length)
+{
+    if (Reader->Failed || BytesLeft(Reader) < Length)
+    {
+        Reader->Failed = true;
+        return false;
+    }
+    
+    if (Length)
+    {
+        memcpy(Data, Reader->At, Length);
+        Reader->At += Length;
+    }
+    
+    return true;
+}
+
+inline
+uint32 ReadU32(binary_reader *Reader)
+{
+    uint32 Value = 0;
+    ReadBytes(Reader, &Value, sizeof(Value));
+    return Value;
+}
+
+inline
+uint64 ReadU64(binary_reader *Reader)
+{
+    uint64 Value = 0;
+    ReadBytes(Reader, &Value, sizeof(Value));
+    return Value;
+}
+
+inline
+std::string ReadString(binary_reader *Reader)
+{
+    uint32 Length = ReadU32(Reader);
+    if (Reader->Failed || BytesLeft(Reader) < Length)
+    {
+        Reader->Failed = true;
+        return {};
+    }
+    
+    std::string Result((const char *)Reader->At, Length);
+    Reader->At += Length;
+    return Result;
+}
+
+// Checks the hash BeginHashedSection left in front of the rest of the data.
+inline
+bool CheckHashedSection(binary_reader *Reader)
+{
+    uint64 Hash = ReadU64(Reader);
+    return !Reader->Failed && fnv64(Reader->At, BytesLeft(Reader)) == Hash;
+}
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <string_view>
 #include <assert.h>
 #include "codegen_inspect_data.h"
 #include "compiler_utils.h"
@@ -15,10 +17,17 @@ void FreeDataItem(inspect_data_item *Item)
     
     if (Item->Type == Type_Dict)
     {
+        // The attribute list isn't the dict's, see inspect_data_item.
+        FreeInspectDict(Item->Dict);
         delete Item->Dict;
     }
     else if (Item->Type == Type_List)
     {
+        for (inspect_data_item &Element : *Item->List)
+        {
+            FreeDataItem(&Element);
+        }
+        
         delete Item->List;
     }
     else if (Item->Type == Type_String)
@@ -29,15 +38,18 @@ void FreeDataItem(inspect_data_item *Item)
     {
         delete Item->Procedure;
     }
-    
-    if (Item->Attributes)
-    {
-        delete Item->Attributes;
-    }
 }
 
 void FreeInspectDict(inspect_dict *Dict)
 {
+    for (uint32 Slot = 0; Slot < Dict->Slots.size(); ++Slot)
+    {
+        if (IsSlotSet(Dict, Slot))
+        {
+            FreeDataItem(&Dict->Slots[Slot]);
+        }
+    }
+    
     for(auto Iterator = Dict->Lookup.begin();
         Iterator != Dict->Lookup.end();
         Iterator++)
@@ -46,23 +58,303 @@ void FreeInspectDict(inspect_dict *Dict)
     }
 }
 
-bool Lookup(inspect_dict *Dict, std::string Key, inspect_data_item *Value)
+/*******************************************/
+// Interning
+
+#define INTERN_BLOCK_SIZE (1 << 16)
+
+inspect_data_item InternString(intern_table *Table, const char *String, size_t Length)
 {
-    auto Result = Dict->Lookup.find(Key);
-    if (Result == Dict->Lookup.end())
+    auto It = Table->Strings.find(std::string_view(String, Length));
+    if (It == Table->Strings.end())
     {
-        if (Dict->Parent)
+        char *Copy;
+        if (Length > INTERN_BLOCK_SIZE / 4)
+        {
+            Copy = (char *)malloc(Length + 1);
+            Table->Blocks.push_back(Copy);
+        }
+        else
         {
-            return Lookup(Dict->Parent, Key, Value);
+            if (Length + 1 > Table->BlockLeft)
+            {
+                Table->Block = (char *)malloc(INTERN_BLOCK_SIZE);
+                Table->BlockLeft = INTERN_BLOCK_SIZE;
+                Table->Blocks.push_back(Table->Block);
+            }
+            
+            Copy = Table->Block;
+            Table->Block += Length + 1;
+            Table->BlockLeft -= Length + 1;
         }
         
+        memcpy(Copy, String, Length);
+        Copy[Length] = '\0';
+        It = Table->Strings.insert(std::string_view(Copy, Length)).first;
+    }
+    
+    inspect_data_item Item = NewStringView((char *)It->data(), It->size());
+    Item.IsInterned = true;
+    return Item;
+}
+
+bool FindInternedString(intern_table *Table, const char *String, size_t Length,
+                        inspect_data_item *Result)
+{
+    auto It = Table->Strings.find(std::string_view(String, Length));
+    if (It == Table->Strings.end())
+    {
         return false;
     }
     
-    *Value = Result->second;
+    *Result = NewStringView((char *)It->data(), It->size());
+    Result->IsInterned = true;
     return true;
 }
 
+void FreeInternTable(intern_table *Table)
+{
+    for (char *Block : Table->Blocks)
+    {
+        free(Block);
+    }
+    
+    Table->Strings.clear();
+    Table->Blocks.clear();
+    Table->Block = nullptr;
+    Table->BlockLeft = 0;
+}
+
+// Shared attribute data is only ever referenced, and by many lists.
+struct freeze_walk
+{
+    intern_table *Table;
+    std::unordered_set<inspect_dict *> SharedDicts;
+};
+
+static void FreezeDict(freeze_walk *Walk, inspect_dict *Dict);
+
+// Only walks into what the item owns, everything the model references is owned by
+// something else in it.
+static
+void FreezeItem(freeze_walk *Walk, inspect_data_item *Item)
+{
+    if (Item->Type == Type_String && !Item->IsInterned)
+    {
+        inspect_data_item Interned = InternString(Walk->Table, Item->String, Item->StringLength);
+        FreeDataItem(Item);
+        *Item = Interned;
+    }
+    else if (Item->IsReference)
+    {
+        return;
+    }
+    else if (Item->Type == Type_Dict)
+    {
+        FreezeDict(Walk, Item->Dict);
+    }
+    else if (Item->Type == Type_List)
+    {
+        for (inspect_data_item &Element : *Item->List)
+        {
+            FreezeItem(Walk, &Element);
+        }
+    }
+}
+
+static
+void FreezeDict(freeze_walk *Walk, inspect_dict *Dict)
+{
+    Dict->ReadOnly = true;
+    
+    for (uint32 Slot = 0; Slot < Dict->Slots.size(); ++Slot)
+    {
+        if (IsSlotSet(Dict, Slot))
+        {
+            FreezeItem(Walk, &Dict->Slots[Slot]);
+        }
+    }
+    
+    for (auto &Entry : Dict->Lookup)
+    {
+        FreezeItem(Walk, &Entry.second);
+    }
+    
+    if (Dict->Attributes)
+    {
+        for (auto &Entry : Dict->Attributes->AttributeData.Lookup)
+        {
+            inspect_data_item &Shared = Entry.second;
+            if (Shared.Type == Type_Dict && Walk->SharedDicts.insert(Shared.Dict).second)
+            {
+                FreezeDict(Walk, Shared.Dict);
+            }
+        }
+    }
+}
+
+void FreezeModel(inspect_data *Data)
+{
+    freeze_walk Walk;
+    Walk.Table = &Data->Strings;
+    FreezeItem(&Walk, &Data->GlobalScope);
+}
+
+/*******************************************/
+// Shapes
+
+static const char *TypeKeys[Num_Type_Slots] =
+{
+    "Name",
+    "IsPointer",
+    "IsReference",
+    "HasInnerType",
+    "InnerType",
+    "Args",
+    "Info",
+};
+
+static const char *TypedArgumentKeys[Num_Typed_Argument_Slots] =
+{
+    "Name",
+    "Type",
+};
+
+static const char *FieldKeys[Num_Field_Slots] =
+{
+    "Type",
+    "Name",
+    "HasInitializer",
+    "Initializer",
+    "IsMethod",
+    "MethodArguments",
+};
+
+static const char *TypeInfoKeys[Num_Type_Info_Slots] =
+{
+    "Name",
+    "Descriptor",
+    "CamelCase",
+};
+
+static const char *StructKeys[Num_Struct_Slots] =
+{
+    "Name",
+    "Fields",
+    "FieldCount",
+    "TypeInfo",
+};
+
+const inspect_shape InspectShapes[Num_Inspect_Shapes] =
+{
+    { nullptr, 0 },
+    { TypeKeys, Num_Type_Slots },
+    { TypedArgumentKeys, Num_Typed_Argument_Slots },
+    { FieldKeys, Num_Field_Slots },
+    { TypeInfoKeys, Num_Type_Info_Slots },
+    { StructKeys, Num_Struct_Slots },
+};
+
+// Shapes have a handful of keys, comparing them is quicker than hashing the key.
+int32 FindSlot(inspect_dict *Dict, const char *Key, size_t Length)
+{
+    const inspect_shape *Shape = &InspectShapes[Dict->Shape];
+    for (uint32 Slot = 0; Slot < Shape->SlotCount; ++Slot)
+    {
+        const char *Candidate = Shape->Keys[Slot];
+        if (strncmp(Candidate, Key, Length) == 0 && Candidate[Length] == '\0')
+        {
+            return (int32)Slot;
+        }
+    }
+    
+    return -1;
+}
+
+void Insert(inspect_dict *Dict, const char *Key, size_t Length, inspect_data_item *Value)
+{
+    int32 Slot = FindSlot(Dict, Key, Length);
+    if (Slot >= 0)
+    {
+        SetSlot(Dict, (uint32)Slot, Value);
+        return;
+    }
+    
+    std::string Name(Key, Length);
+    auto It = Dict->Lookup.find(Name);
+    if (It == Dict->Lookup.end())
+    {
+        It = Dict->Lookup.emplace(Name, *Value).first;
+    }
+    else if (!IsSameValue(&It->second, Value))
+    {
+        FreeDataItem(&It->second);
+    }
+    
+    inspect_data_item &Entry = It->second;
+    Entry = *Value;
+    Entry.IsLValue = false;
+}
+
+void FreeIfExists(inspect_dict *Dict, const char *Key)
+{
+    int32 Slot = FindSlot(Dict, Key, strlen(Key));
+    if (Slot >= 0)
+    {
+        if (IsSlotSet(Dict, (uint32)Slot))
+        {
+            FreeDataItem(&Dict->Slots[(uint32)Slot]);
+            Dict->SlotsSet &= ~((uint32)1 << Slot);
+        }
+        
+        return;
+    }
+    
+    auto It = Dict->Lookup.find(Key);
+    if (It != Dict->Lookup.end())
+    {
+        FreeDataItem(&It->second);
+        Dict->Lookup.erase(It);
+    }
+}
+
+bool Lookup(inspect_dict *Dict, const char *Key, size_t Length, inspect_data_item *Value,
+            inspect_dict **Owner)
+{
+    for (; Dict; Dict = Dict->Parent)
+    {
+        int32 Slot = FindSlot(Dict, Key, Length);
+        if (Slot >= 0 && IsSlotSet(Dict, (uint32)Slot))
+        {
+            *Value = BorrowItem(&Dict->Slots[(uint32)Slot]);
+        }
+        else
+        {
+            if (Dict->Lookup.empty())
+            {
+                continue;
+            }
+            
+            auto Result = Dict->Lookup.find(std::string(Key, Length));
+            if (Result == Dict->Lookup.end())
+            {
+                continue;
+            }
+    
+            *Value = BorrowItem(&Result->second);
+        }
+        
+        if (Owner)
+        {
+            *Owner = Dict;
+        }
+    
+        return true;
+    }
+    
+    return false;
+}
+
 /*******************************************/
 // Operation interfaces
 
@@ -207,21 +499,20 @@ bool StringCanExecute(inspect_item_operator Op)
 
 inspect_data_item StringEquality(inspect_data_item *Left, inspect_data_item *Right)
 {
-    return NewBoolItem(strcmp(Left->String, Right->String) == 0);
+    return NewBoolItem(StringsAreEqual(Left, Right));
 }
 
 inspect_data_item StringInEquality(inspect_data_item *Left, inspect_data_item *Right)
 {
-    return NewBoolItem(strcmp(Left->String, Right->String) != 0);
+    return NewBoolItem(!StringsAreEqual(Left, Right));
 }
 
-inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
+const inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
 {
     
     /*******************************************/
     // String
     
-    InspectDataInterfaces[Type_String] =
     {
         StringCanExecute,
         NoValidCast,
@@ -244,7 +535,6 @@ inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
     /*******************************************/
     // Int
     
-    InspectDataInterfaces[Type_Int] =
     {
         IntCanExecuteOperation,
         NoValidCast,
@@ -267,7 +557,6 @@ inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
     /*******************************************/
     // Bool
     
-    InspectDataInterfaces[Type_Bool] =
     {
         BoolCanExecuteOperation,
         NoValidCast,
@@ -290,7 +579,6 @@ inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
     /*******************************************/
     // Void
     
-    InspectDataInterfaces[Type_Void] =
     {
         NoValidOperation,
         NoValidCast,
@@ -313,7 +601,6 @@ inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
     /*******************************************/
     // Dict
     
-    InspectDataInterfaces[Type_Dict] =
     {
         NoValidOperation,
         NoValidCast,
@@ -336,7 +623,6 @@ inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
     /*******************************************/
     // List
     
-    InspectDataInterfaces[Type_List] =
     {
         NoValidOperation,
         NoValidCast,
@@ -359,7 +645,6 @@ inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types] =
     /*******************************************/
     // Procedure
     
-    InspectDataInterfaces[Type_Procedure] =
     {
         NoValidOperation,
         NoValidCast,
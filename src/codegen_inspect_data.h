@@ -1,10 +1,15 @@
 #pragma once
+#include <assert.h>
+#include <string.h>
+#include <atomic>
 #include <unordered_map>
+#include <unordered_set>
+#include <string_view>
 #include "codegen_lex_inspect.h"
 #include "codegen_lex_write.h"
 #include "numeric_types.h"
 
-enum inspect_item_type
+enum inspect_item_type : uint8
 {
     Type_String,
     Type_Int,
@@ -34,21 +39,105 @@ const char *InspectItemTypeToString(inspect_item_type Type)
     return "Unknown";
 }
 
-struct itoken_info
+struct inspect_data_item;
+typedef std::vector<inspect_data_item> inspect_list;
+
+struct attribute_list;
+
+// Every object of one kind in the model has the same keys, so instead of a map of its
+// own each one is given the shape of its kind and keeps its values in slots, in the
+// order the shape lists the keys in. Templates look keys up the same way either way.
+enum inspect_shape_id
 {
-    inspect_token Token;
-    int Line;
-    int Column;
-    char *Filename;
+    Shape_None,
+    Shape_Type,
+    Shape_TypedArgument,
+    Shape_Field,
+    Shape_TypeInfo,
+    Shape_Struct,
+    Num_Inspect_Shapes,
 };
 
-struct inspect_data_item;
-typedef std::vector<inspect_data_item> inspect_list;
+enum type_slot
+{
+    TypeSlot_Name,
+    TypeSlot_IsPointer,
+    TypeSlot_IsReference,
+    TypeSlot_HasInnerType,
+    TypeSlot_InnerType,
+    TypeSlot_Args,
+    TypeSlot_Info,
+    Num_Type_Slots,
+};
+
+enum typed_argument_slot
+{
+    TypedArgumentSlot_Name,
+    TypedArgumentSlot_Type,
+    Num_Typed_Argument_Slots,
+};
+
+enum field_slot
+{
+    FieldSlot_Type,
+    FieldSlot_Name,
+    FieldSlot_HasInitializer,
+    FieldSlot_Initializer,
+    FieldSlot_IsMethod,
+    FieldSlot_MethodArguments,
+    Num_Field_Slots,
+};
+
+enum type_info_slot
+{
+    TypeInfoSlot_Name,
+    TypeInfoSlot_Descriptor,
+    TypeInfoSlot_CamelCase,
+    Num_Type_Info_Slots,
+};
+
+enum struct_slot
+{
+    StructSlot_Name,
+    StructSlot_Fields,
+    StructSlot_FieldCount,
+    StructSlot_TypeInfo,
+    Num_Struct_Slots,
+};
+
+struct inspect_shape
+{
+    const char **Keys;
+    uint32 SlotCount;
+};
+
+extern const inspect_shape InspectShapes[Num_Inspect_Shapes];
 
 struct inspect_dict
 {
     inspect_dict *Parent;
+    
+    // Keys that aren't in the shape, and every key of a dict without one (scopes and
+    // attribute data).
     std::unordered_map<std::string, inspect_data_item> Lookup;
+    
+    // One bit per slot, not every object has a value for every key of its shape (a type
+    // without an inner type, a field that isn't a method).
+    inspect_shape_id Shape = Shape_None;
+    uint32 SlotsSet = 0;
+    std::vector<inspect_data_item> Slots;
+    
+    // Only the dicts made for the model have these, so they are kept here instead of in
+    // every item. The dict of a field, struct or type has its attributes and the token it
+    // was declared at.
+    attribute_list *Attributes = nullptr;
+    itoken_info SourceToken = {};
+    
+    // Templates can't assign to the values, see GetSharedAttributeData and FreezeModel.
+    bool ReadOnly = false;
+    
+    // The one dict of all identical attribute instances, see GetSharedAttributeData.
+    bool SharedAttributeData = false;
 };
 
 struct tab_state
@@ -101,40 +190,130 @@ struct attribute_list
     std::vector<attribute_instance> Attributes;
     
     inspect_dict AttributeData;
+    
+    // One bit per attribute handle, set for every attribute in the list
+    // (aliases set the bit of the attribute they stand for).
+    std::vector<uint64> Presence;
 };
 
-struct inspect_data_item
+inline
+void SetAttributePresent(attribute_list *List, attribute_handle Handle)
 {
-    inspect_data_item()
+    size_t Word = (size_t)Handle / 64;
+    if (Word >= List->Presence.size())
     {
-        UID = NextUID++;
-        Attributes = 0;
+        List->Presence.resize(Word + 1, 0);
     }
     
-    inspect_item_type Type;
+    List->Presence[Word] |= (uint64)1 << ((uint64)Handle % 64);
+}
+
+inline
+bool IsAttributePresent(attribute_list *List, attribute_handle Handle)
+{
+    size_t Word = (size_t)Handle / 64;
+    return Word < List->Presence.size() &&
+        (List->Presence[Word] >> ((uint64)Handle % 64)) & 1;
+}
+
+// 16 bytes, items are copied by value everywhere. Anything only some of them need lives
+// in their dict instead, see inspect_dict.
+//
+// Strings have an explicit length and aren't terminated, most of them point straight into
+// the text of the file they came from, see NewStringView.
+//
+// An item that isn't a reference owns what it points at, and whatever holds the item (a
+// slot, a map entry, a list element) owns it in turn, up to the global scope. Every value
+// has exactly one owner. Reading a value out of a dict or list only borrows it, see
+// BorrowItem, so copies of items can be passed around and stored freely without anything
+// being freed twice. Attribute lists are the exception, a struct and its type info share
+// one, so they and the attribute data they share belong to the inspect_data.
+struct inspect_data_item
+{
     union
     {
         char *String;
         int Int;
         bool Bool;
-        itoken_info TokenInfo;
-        inspect_ctext CText;
         inspect_dict *Dict;
         inspect_list *List;
         inspect_procedure *Procedure;
     };
     
-    inspect_dict *Owner = 0;
+    inspect_item_type Type;
     bool IsReference = false;
     
-    uint64 UID;
-    inline static uint64 NextUID = 0;
+    // Set on an item that came straight out of a variable, so it can be assigned to. The
+    // variable is the last one the template parser looked up, see write_parser.
+    bool IsLValue = false;
     
-    attribute_list *Attributes;
+    // The string is the one copy of its text in its intern table, see StringsAreEqual.
+    bool IsInterned = false;
     
-    itoken_info OptionalSourceToken;
+    uint32 StringLength;
 };
 
+// Whether both are the same value, e.g. the same dict, no matter how they are referenced.
+inline
+bool IsSameValue(inspect_data_item *First, inspect_data_item *Second)
+{
+    if (First->Type != Second->Type)
+    {
+        return false;
+    }
+    
+    if (First->Type == Type_String)
+    {
+        return First->String == Second->String && First->StringLength == Second->StringLength;
+    }
+    else if (First->Type == Type_Int)
+    {
+        return First->Int == Second->Int;
+    }
+    else if (First->Type == Type_Bool)
+    {
+        return First->Bool == Second->Bool;
+    }
+    else if (First->Type == Type_Dict)
+    {
+        return First->Dict == Second->Dict;
+    }
+    else if (First->Type == Type_List)
+    {
+        return First->List == Second->List;
+    }
+    else if (First->Type == Type_Procedure)
+    {
+        return First->Procedure == Second->Procedure;
+    }
+    
+    return true;
+}
+
+// Interned strings are equal exactly when they are the same pointer. A template only sees
+// strings of its model's table and its own, which never have the same text.
+inline
+bool StringsAreEqual(inspect_data_item *Left, inspect_data_item *Right)
+{
+    if (Left->IsInterned && Right->IsInterned)
+    {
+        return Left->String == Right->String;
+    }
+    
+    return Left->StringLength == Right->StringLength &&
+        (Left->String == Right->String ||
+         memcmp(Left->String, Right->String, Left->StringLength) == 0);
+}
+
+// Identical attribute data is one shared dict, so for it comparing the dicts is the same
+// as comparing their contents. Other dicts can't be compared.
+inline
+bool AreSharedAttributeData(inspect_data_item *Left, inspect_data_item *Right)
+{
+    return Left->Type == Type_Dict && Right->Type == Type_Dict &&
+        Left->Dict->SharedAttributeData && Right->Dict->SharedAttributeData;
+}
+
 enum inspect_item_operator
 {
     Addition_Op,
@@ -179,17 +358,42 @@ struct inspect_data_operation_interface
     unary_op Decrement;
 };
 
-extern inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types];
+extern const inspect_data_operation_interface InspectDataInterfaces[Num_Inspect_Item_Types];
 
 inline
-inspect_data_operation_interface *GetInterface(inspect_item_type Type)
+const inspect_data_operation_interface *GetInterface(inspect_item_type Type)
 {
     return &InspectDataInterfaces[Type];
 }
 
+// Strings with the same text share one copy here, so interned strings can be compared
+// by pointer. The text is copied into blocks that are never moved, the set only points
+// into them.
+struct intern_table
+{
+    std::unordered_set<std::string_view> Strings;
+    std::vector<char *> Blocks;
+    char *Block = nullptr;
+    size_t BlockLeft = 0;
+};
+
+// Everything one run knows about its input. Nothing about a model is global, any number
+// of them can be built on different threads at once. Once ParseInspect is done with it the
+// model is only ever read, so any number of templates can be evaluated against it at
+// once too.
 struct inspect_data
 {
     inspect_data_item GlobalScope;
+    
+    // The model's strings, see FreezeModel.
+    intern_table Strings;
+    
+    // Declared attribute names, so templates can turn has_attribute names into handles.
+    std::unordered_map<std::string, attribute_handle> AttributeHandles;
+    
+    // Owned here rather than by the dicts pointing at them, see inspect_data_item.
+    std::vector<attribute_list *> AttributeLists;
+    std::vector<inspect_dict *> SharedAttributeData;
 };
 
 inline
@@ -209,6 +413,15 @@ inspect_data_item NewDictItem()
     return Item;
 }
 
+inline
+inspect_data_item NewShapedDictItem(inspect_shape_id Shape)
+{
+    inspect_data_item Item = NewDictItem();
+    Item.Dict->Shape = Shape;
+    Item.Dict->Slots.resize(InspectShapes[Shape].SlotCount);
+    return Item;
+}
+
 inline
 inspect_data_item NewListItem()
 {
@@ -227,42 +440,74 @@ inspect_data_item NewProcedureItem()
     return Item;
 }
 
+// Copies the string, for text that is computed or doesn't live as long as the item.
 inline
-inspect_data_item NewStringItem(const char *String)
+inspect_data_item NewStringItem(const char *String, size_t Length)
 {
     inspect_data_item Item;
     Item.Type = Type_String;
-    Item.String = strdup(String);
+    Item.String = (char *)malloc(Length + 1);
+    memcpy(Item.String, String, Length);
+    Item.String[Length] = '\0';
+    Item.StringLength = (uint32)Length;
     return Item;
 }
 
-inline inspect_data_item NewStringItem(itoken_info *Token)
+inline
+inspect_data_item NewStringItem(const char *String)
 {
-    inspect_data_item Item;
-    Item.Type = Type_String;
-    Item.String = (char *)malloc(Token->Token.Length + 1);
-    memcpy(Item.String, Token->Token.Text, Token->Token.Length);
-    Item.String[Token->Token.Length] = '\0';
-    return Item;
+    return NewStringItem(String, strlen(String));
 }
 
+// Points into text that outlives the item, e.g. the source of a lexer, which is kept for
+// the whole run. Nothing is copied and the item is never freed.
 inline
-inspect_data_item NewStringItem(inspect_ctext *Text)
+inspect_data_item NewStringView(char *String, size_t Length)
 {
     inspect_data_item Item;
     Item.Type = Type_String;
-    Item.String = (char *)malloc(Text->Length + 1);
-    memcpy(Item.String, Text->Begin, Text->Length);
-    Item.String[Text->Length] = '\0';
+    Item.String = String;
+    Item.StringLength = (uint32)Length;
+    Item.IsReference = true;
     return Item;
 }
 
+inline
+inspect_data_item NewStringView(itoken_info *Token)
+{
+    return NewStringView(TokenText(Token), Token->Length);
+}
+
+inline
+inspect_data_item NewStringView(inspect_ctext *Text)
+{
+    return NewStringView(Text->Begin, Text->Length);
+}
+
+// The copy of the text in Table, added if it isn't there yet. Only one thread at a time
+// may intern into a table.
+inspect_data_item InternString(intern_table *Table, const char *String, size_t Length);
+
+// Like InternString, but only looks, so any number of threads can use the table at once
+// while nothing is added to it.
+bool FindInternedString(intern_table *Table, const char *String, size_t Length,
+                        inspect_data_item *Result);
+
+void FreeInternTable(intern_table *Table);
+
+// Replaces every string in the model with its interned copy and makes every dict in it
+// read only for templates. ParseInspect does this once the model is built, after that
+// nothing writes to it.
+void FreezeModel(inspect_data *Data);
+
+// Takes ownership of String.
 inline
 inspect_data_item ReceiveStringItem(char *String)
 {
     inspect_data_item Item;
     Item.Type = Type_String;
     Item.String = String;
+    Item.StringLength = (uint32)strlen(String);
     return Item;
 }
 
@@ -292,71 +537,107 @@ inspect_data_item NewVoidItem()
     return Item;
 }
 
+// Frees everything the item owns, nothing if it is a reference.
 void FreeDataItem(inspect_data_item *Item);
 
+// Frees the values in the dict but not the dict itself, for dicts that aren't in an item.
+void FreeInspectDict(inspect_dict *Dict);
+
 inline
-std::string StringFromToken(write_token *Token)
+std::string StringFromToken(wtoken_info *Token)
 {
-    return std::string(Token->Text, Token->Length);
+    return std::string(TokenText(Token), Token->Length);
 }
 
 inline
-std::string StringFromToken(inspect_token *Token)
+std::string StringFromToken(itoken_info *Token)
 {
-    return std::string(Token->Text, Token->Length);
+    return std::string(TokenText(Token), Token->Length);
 }
 
-// NOTE(Brian): For insert, we set the item's owner variable. To prevent mistakes,
-// we don't allow passing the item by copy, but an r-value is fine.
 inline
-void Insert(inspect_dict *Dict, const char *Key, inspect_data_item *Value)
+std::string StringFromItem(inspect_data_item *Item)
 {
-    Value->Owner = Dict;
-    Dict->Lookup[Key] = *Value;
+    return std::string(Item->String, Item->StringLength);
 }
 
+// For model code that knows the shape of the dict. The slot has to be set.
 inline
-void Insert(inspect_dict *Dict, const char *Key, inspect_data_item &&Value)
+inspect_data_item &GetSlot(inspect_dict *Dict, uint32 Slot)
 {
-    Value.Owner = Dict;
-    Dict->Lookup[Key] = Value;
+    assert(Dict->SlotsSet & ((uint32)1 << Slot));
+    return Dict->Slots[Slot];
 }
 
 inline
-void Insert(inspect_dict *Dict, inspect_token *TokenKey, inspect_data_item &&Value)
+bool IsSlotSet(inspect_dict *Dict, uint32 Slot)
 {
-    Value.Owner = Dict;
-    Dict->Lookup[StringFromToken(TokenKey)] = Value;
+    return (Dict->SlotsSet >> Slot) & 1;
 }
 
+// Values in a dict are never L-Values themselves, only copies of them that the template
+// parser got out of a variable. The dict owns the value from then on, and frees the one
+// it replaces.
 inline
-void Insert(inspect_dict *Dict, inspect_token *TokenKey, inspect_data_item *Value)
+void SetSlot(inspect_dict *Dict, uint32 Slot, inspect_data_item *Value)
 {
-    Value->Owner = Dict;
-    Dict->Lookup[StringFromToken(TokenKey)] = *Value;
+    if (IsSlotSet(Dict, Slot) && !IsSameValue(&Dict->Slots[Slot], Value))
+    {
+        FreeDataItem(&Dict->Slots[Slot]);
+    }
+    
+    Dict->SlotsSet |= (uint32)1 << Slot;
+    Dict->Slots[Slot] = *Value;
+    Dict->Slots[Slot].IsLValue = false;
 }
 
 inline
-void Insert(inspect_dict *Dict, write_token *TokenKey, inspect_data_item *Value)
+void SetSlot(inspect_dict *Dict, uint32 Slot, inspect_data_item &&Value)
 {
-    Value->Owner = Dict;
-    Dict->Lookup[StringFromToken(TokenKey)] = *Value;
+    SetSlot(Dict, Slot, &Value);
 }
 
+// The slot of the key in the shape of the dict, or -1 if it has none.
+int32 FindSlot(inspect_dict *Dict, const char *Key, size_t Length);
+
+// Like SetSlot, for any key.
+void Insert(inspect_dict *Dict, const char *Key, size_t Length, inspect_data_item *Value);
+
 inline
-void FreeIfExists(inspect_dict *Dict, const char *Key)
+void Insert(inspect_dict *Dict, const char *Key, inspect_data_item *Value)
 {
-    auto It = Dict->Lookup.find(Key);
-    if (It != Dict->Lookup.end())
-    {
-        FreeDataItem(&It->second);
-        Dict->Lookup.erase(It);
-    }
+    Insert(Dict, Key, strlen(Key), Value);
+}
+
+inline
+void Insert(inspect_dict *Dict, const char *Key, inspect_data_item &&Value)
+{
+    Insert(Dict, Key, &Value);
 }
 
+inline
+void Insert(inspect_dict *Dict, itoken_info *TokenKey, inspect_data_item &&Value)
+{
+    Insert(Dict, TokenText(TokenKey), TokenKey->Length, &Value);
+}
+
+inline
+void Insert(inspect_dict *Dict, itoken_info *TokenKey, inspect_data_item *Value)
+{
+    Insert(Dict, TokenText(TokenKey), TokenKey->Length, Value);
+}
+
+inline
+void Insert(inspect_dict *Dict, wtoken_info *TokenKey, inspect_data_item *Value)
+{
+    Insert(Dict, TokenText(TokenKey), TokenKey->Length, Value);
+}
+
+void FreeIfExists(inspect_dict *Dict, const char *Key);
+
 #if 0
 inline
-void Remove(inspect_dict *Dict, write_token *TokenKey)
+void Remove(inspect_dict *Dict, wtoken_info *TokenKey)
 {
     auto It = Dict->Lookup.find(StringFromToken(TokenKey));
     FreeDataItem(It->second());
@@ -364,22 +645,36 @@ void Remove(inspect_dict *Dict, write_token *TokenKey)
 }
 #endif
 
-bool Lookup(inspect_dict *Dict, std::string Key, inspect_data_item *Value);
+// The value is borrowed, see BorrowItem. Owner is set to the dict, or the parent of it,
+// the key was found in.
+bool Lookup(inspect_dict *Dict, const char *Key, size_t Length, inspect_data_item *Value,
+            inspect_dict **Owner = nullptr);
+
+inline
+bool Lookup(inspect_dict *Dict, const std::string &Key, inspect_data_item *Value,
+            inspect_dict **Owner = nullptr)
+{
+    return Lookup(Dict, Key.data(), Key.size(), Value, Owner);
+}
 
 inline
-bool Lookup(inspect_dict *Dict, write_token *TokenIdentifier, inspect_data_item *Value)
+bool Lookup(inspect_dict *Dict, wtoken_info *TokenIdentifier, inspect_data_item *Value,
+            inspect_dict **Owner = nullptr)
 {
-    return Lookup(Dict, StringFromToken(TokenIdentifier), Value);
+    return Lookup(Dict, TokenText(TokenIdentifier), TokenIdentifier->Length, Value, Owner);
 }
 
+// A copy of the item that doesn't own anything, it is only valid as long as the owner of
+// the item is.
 inline
-inspect_data_item CreateCopyOrReference(inspect_data_item *Item)
+inspect_data_item BorrowItem(inspect_data_item *Item)
 {
     inspect_data_item Result = *Item;
     
     if (Item->Type == Type_Dict ||
         Item->Type == Type_List ||
-        Item->Type == Type_String)
+        Item->Type == Type_String ||
+        Item->Type == Type_Procedure)
     {
         Result.IsReference = true;
     }
@@ -2,6 +2,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include "codegen_lex_base.h"
 
 char *ReadEntireFileAndTerminate(const char *Filename)
 {
@@ -26,6 +29,16 @@ char *ReadEntireFileAndTerminate(const char *Filename)
     return 0;
 }
 
+char *ReadSource(source_reader *Reader, const char *Path)
+{
+    if (Reader)
+    {
+        return Reader->Read(Reader->User, Path);
+    }
+    
+    return ReadEntireFileAndTerminate(Path);
+}
+
 char *GetDirectory(const char *Filename)
 {
     int LastSlash = -1;
@@ -120,3 +133,192 @@ char *AppendToDirectory(const char *Directory, const char *Path)
     Buffer[FinalLength] = '\0';
     return Buffer;
 }
+
+static inline
+bool IsSeparator(char C)
+{
+    return C == '/' || C == '\\';
+}
+
+size_t NormalizePath(char *Path)
+{
+    // NOTE: The output never gets ahead of the input, so this can work in place.
+    const char *In = Path;
+    char *Out = Path;
+    
+    // Nothing before Root can be removed by "..".
+    if (IsSeparator(*In))
+    {
+        *Out++ = '/';
+        ++In;
+    }
+    
+    char *Root = Out;
+    
+    while (*In)
+    {
+        if (IsSeparator(*In))
+        {
+            ++In;
+            continue;
+        }
+        
+        const char *Segment = In;
+        while (*In && !IsSeparator(*In))
+        {
+            ++In;
+        }
+        
+        size_t Length = (size_t)(In - Segment);
+        if (Length == 1 && Segment[0] == '.')
+        {
+            continue;
+        }
+        
+        if (Length == 2 && Segment[0] == '.' && Segment[1] == '.')
+        {
+            char *Last = Out;
+            while (Last > Root && Last[-1] != '/')
+            {
+                --Last;
+            }
+            
+            bool LastIsParent = Out - Last == 2 && Last[0] == '.' && Last[1] == '.';
+            if (Out > Root && !LastIsParent)
+            {
+                // Also drops the separator in front of the removed segment.
+                Out = Last > Root ? Last - 1 : Root;
+                continue;
+            }
+            
+            if (Out == Root && Root > Path)
+            {
+                // The parent of the root is the root.
+                continue;
+            }
+        }
+        
+        if (Out > Root)
+        {
+            *Out++ = '/';
+        }
+        
+        memmove(Out, Segment, Length);
+        Out += Length;
+    }
+    
+    *Out = '\0';
+    return (size_t)(Out - Path);
+}
+
+// Files live in chunks that never move, lexers on other threads can add files while
+// tokens of the existing ones are being looked at. Adding and removing take the lock,
+// looking up a file doesn't since a file's index is only handed out once it is stored.
+static const int SourceFileChunkShift = 8;
+static const int SourceFileChunkSize = 1 << SourceFileChunkShift;
+
+static source_file *SourceFileChunks[MAX_SOURCE_FILES / SourceFileChunkSize];
+static uint32 SourceFileCount;
+static std::vector<uint16> FreeSourceFiles;
+static std::mutex SourceFileLock;
+
+static inline
+source_file &SourceFileAt(uint16 File)
+{
+    return SourceFileChunks[File >> SourceFileChunkShift][File & (SourceFileChunkSize - 1)];
+}
+
+static
+uint16 AppendSourceFile(source_file *Source)
+{
+    uint16 File = (uint16)SourceFileCount++;
+    
+    source_file *&Chunk = SourceFileChunks[File >> SourceFileChunkShift];
+    if (!Chunk)
+    {
+        Chunk = new source_file[SourceFileChunkSize];
+    }
+    
+    SourceFileAt(File) = *Source;
+    return File;
+}
+
+bool AddSourceFile(char *Filename, char *Text, uint16 *File)
+{
+    std::lock_guard<std::mutex> Guard(SourceFileLock);
+    
+    if (SourceFileCount == 0)
+    {
+        // NO_SOURCE_FILE, empty so the text of tokens without a file is still valid.
+        static char Empty[] = "";
+        source_file None;
+        None.Filename = Empty;
+        None.Text = Empty;
+        AppendSourceFile(&None);
+    }
+    
+    source_file Source;
+    Source.Filename = Filename;
+    Source.Text = Text;
+    
+    if (!FreeSourceFiles.empty())
+    {
+        *File = FreeSourceFiles.back();
+        FreeSourceFiles.pop_back();
+        SourceFileAt(*File) = Source;
+        return true;
+    }
+    
+    // NOTE: Every index a token can hold is taken by a file that is still open.
+    if (SourceFileCount == MAX_SOURCE_FILES)
+    {
+        return false;
+    }
+    
+    *File = AppendSourceFile(&Source);
+    return true;
+}
+
+// The slot is reused by the next file, so no token of this file may be looked at again.
+void RemoveSourceFile(uint16 File)
+{
+    std::lock_guard<std::mutex> Guard(SourceFileLock);
+    SourceFileAt(File) = source_file();
+    FreeSourceFiles.push_back(File);
+}
+
+char *GetSourceText(uint16 File)
+{
+    return SourceFileAt(File).Text;
+}
+
+const char *GetSourceFilename(uint16 File)
+{
+    return SourceFileAt(File).Filename;
+}
+
+void GetSourceLocation(uint16 File, uint32 Offset, int *Line, int *Column)
+{
+    // NOTE: Locked because errors in the same file can be found on several resolve
+    // threads at once, and the first one builds the table. Only errors get here.
+    std::lock_guard<std::mutex> Guard(SourceFileLock);
+    source_file &Source = SourceFileAt(File);
+    if (Source.LineStarts.empty())
+    {
+        Source.LineStarts.push_back(0);
+        for (uint32 I = 0; Source.Text[I]; ++I)
+        {
+            if (Source.Text[I] == '\n')
+            {
+                Source.LineStarts.push_back(I + 1);
+            }
+        }
+    }
+    
+    // The last line that starts at or before the offset.
+    auto Next = std::upper_bound(Source.LineStarts.begin(), Source.LineStarts.end(), Offset);
+    size_t LineIndex = (size_t)(Next - Source.LineStarts.begin()) - 1;
+    
+    *Line = (int)LineIndex + 1;
+    *Column = (int)(Offset - Source.LineStarts[LineIndex]) + 1;
+}
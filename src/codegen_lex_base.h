@@ -1,11 +1,32 @@
 #pragma once
+#include <vector>
+#include "numeric_types.h"
 
 char *ReadEntireFileAndTerminate(const char *Filename);
+
+// Returns the text of the file at Path, null terminated and allocated with malloc, or
+// null if there is no such file.
+typedef char *(*read_source_proc)(void *User, const char *Path);
+
+// Where lexers get the text of their files from, for sources that aren't on disk. Files
+// are read from disk if there is no reader.
+struct source_reader
+{
+    read_source_proc Read;
+    void *User;
+};
+
+char *ReadSource(source_reader *Reader, const char *Path);
 char *GetDirectory(const char *Filename);
 char *GetFilename(const char *Path);
 char *ReplaceExtension(const char *Filename, const char *NewExtension);
 char *AppendToDirectory(const char *Directory, const char *Path);
 
+// Removes "." segments, ".." segments along with the segment before them, and repeated
+// separators, so every spelling of a path to a file is the same string. Only looks at the
+// text, the file system isn't asked. Rewrites Path in place and returns its new length.
+size_t NormalizePath(char *Path);
+
 inline
 bool IsWhitespace(char c)
 {
@@ -20,3 +41,33 @@ bool IsNumeric(char c)
 {
     return (c >= '0' && c <= '9');
 }
+
+// Every file handed to a lexer is registered here. Tokens only keep the index of their
+// file and an offset into it, their text, line and column are found through that.
+//
+// NOTE: This is the one table every parse and render in the process shares, a token
+// has no room to say which run it belongs to. Adding and removing a file takes a lock,
+// and so does finding a line and column, which only errors do. Looking up text doesn't.
+struct source_file
+{
+    char *Filename;
+    char *Text;
+    
+    // Offset of the first character of each line. Only built the first time a location
+    // in the file is needed, which is normally just for error messages.
+    std::vector<uint32> LineStarts;
+};
+
+// File of tokens that don't come from any file, like the names of built in types.
+#define NO_SOURCE_FILE 0
+
+// Tokens keep the index of their file in 16 bits, so at most this many files can be open
+// at the same time, across every parse and render. The index of a removed file is reused.
+#define MAX_SOURCE_FILES 0x10000
+
+// Fails if MAX_SOURCE_FILES files are already open.
+bool AddSourceFile(char *Filename, char *Text, uint16 *File);
+void RemoveSourceFile(uint16 File);
+char *GetSourceText(uint16 File);
+const char *GetSourceFilename(uint16 File);
+void GetSourceLocation(uint16 File, uint32 Offset, int *Line, int *Column);
@@ -10,7 +10,6 @@ static inline
 void Advance(inspect_lexer *Lexer)
 {
     ++Lexer->At;
-    ++Lexer->NextColumn;
 }
 
 static
@@ -22,12 +21,6 @@ void EatIgnoredCharacters(inspect_lexer *Lexer)
         
         if (IsWhitespace(C))
         {
-            if (C == '\n')
-            {
-                Lexer->NextLine++;
-                Lexer->NextColumn = 0;
-            }
-            
             Advance(Lexer);
             continue;
         }
@@ -42,7 +35,6 @@ void EatIgnoredCharacters(inspect_lexer *Lexer)
                 Advance(Lexer);
             }
             
-            ++Lexer->NextLine;
             Advance(Lexer);
         }
         
@@ -62,11 +54,6 @@ void EatIgnoredCharacters(inspect_lexer *Lexer)
                     }
                 }
                 
-                if (*Lexer->At == '\n')
-                {
-                    ++Lexer->NextLine;
-                }
-                
                 Advance(Lexer);
             }
         }
@@ -83,35 +70,35 @@ static constexpr char *KeywordDeclareAttribute = "declare_attribute";
 static constexpr char *KeywordAliasAttribute = "alias_attribute";
 
 static
-bool SetKeyword(inspect_token *Token)
+bool SetKeyword(itoken_info *Token, char *Text)
 {
     if (ConstexprStrlen(KeywordStruct) == Token->Length &&
-        strncmp(Token->Text, KeywordStruct, Token->Length) == 0)
+        strncmp(Text, KeywordStruct, Token->Length) == 0)
     {
         Token->Type = ITokenType_Struct;
     }
     else if (ConstexprStrlen(KeywordEnum) == Token->Length &&
-             strncmp(Token->Text, KeywordEnum, Token->Length) == 0)
+             strncmp(Text, KeywordEnum, Token->Length) == 0)
     {
         Token->Type = ITokenType_Enum;
     }
     else if (ConstexprStrlen(KeywordDeclareType) == Token->Length &&
-             strncmp(Token->Text, KeywordDeclareType, Token->Length) == 0)
+             strncmp(Text, KeywordDeclareType, Token->Length) == 0)
     {
         Token->Type = ITokenType_DeclareType;
     }
     else if (ConstexprStrlen(KeywordImport) == Token->Length &&
-             strncmp(Token->Text, KeywordImport, Token->Length) == 0)
+             strncmp(Text, KeywordImport, Token->Length) == 0)
     {
         Token->Type = ITokenType_Import;
     }
     else if (ConstexprStrlen(KeywordDeclareAttribute) == Token->Length &&
-             strncmp(Token->Text, KeywordDeclareAttribute, Token->Length) == 0)
+             strncmp(Text, KeywordDeclareAttribute, Token->Length) == 0)
     {
         Token->Type = ITokenType_DeclareAttribute;
     }
     else if (ConstexprStrlen(KeywordAliasAttribute) == Token->Length &&
-             strncmp(Token->Text, KeywordAliasAttribute, Token->Length) == 0)
+             strncmp(Text, KeywordAliasAttribute, Token->Length) == 0)
     {
         Token->Type = ITokenType_AliasAttribute;
     }
@@ -124,10 +111,11 @@ bool SetKeyword(inspect_token *Token)
 }
 
 static
-inspect_token NextIdentifierOrNumber(inspect_lexer *Lexer)
+itoken_info NextIdentifierOrNumber(inspect_lexer *Lexer)
 {
-    inspect_token Token;
-    Token.Text = Lexer->At;
+    itoken_info Token;
+    Token.File = Lexer->File;
+    Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
     
     bool IsNumber = true;
     
@@ -168,12 +156,12 @@ inspect_token NextIdentifierOrNumber(inspect_lexer *Lexer)
             case '=':
             case ' ':
             {
-                Token.Length = (size_t)(Lexer->At - Begin);
+                Token.Length = (uint32)(Lexer->At - Begin);
                 if (IsNumber)
                 {
                     Token.Type = ITokenType_Number;
                 }
-                else if (!SetKeyword(&Token))
+                else if (!SetKeyword(&Token, Begin))
                 {
                     Token.Type = ITokenType_Identifier;
                 }
@@ -225,15 +213,13 @@ bool ContainsCharacter(char C, char *Characters, int Count)
 }
 #endif
 
-inspect_token NextToken(inspect_lexer *Lexer)
+itoken_info NextToken(inspect_lexer *Lexer)
 {
     EatIgnoredCharacters(Lexer);
     
-    Lexer->Line = Lexer->NextLine;
-    Lexer->Column = Lexer->NextColumn;
-    
-    inspect_token Token;
-    Token.Text = Lexer->At;
+    itoken_info Token;
+    Token.File = Lexer->File;
+    Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
     Token.Type = ITokenType_Unknown;
     Token.Length = 1;
     
@@ -279,14 +265,14 @@ inspect_token NextToken(inspect_lexer *Lexer)
         if (!MoveToEndOfString(Lexer))
         {
             Token.Type = ITokenType_IncompleteString;
-            Token.Length = (size_t)(Lexer->At - Token.Text);
+            Token.Length = (uint32)(Lexer->At - Lexer->Begin) - Token.Offset;
             return Token;
         }
         else
         {
             Token.Type = ITokenType_String;
-            Token.Text = StringBegin;
-            Token.Length = (size_t)(Lexer->At - StringBegin - 1);
+            Token.Offset = (uint32)(StringBegin - Lexer->Begin);
+            Token.Length = (uint32)(Lexer->At - StringBegin - 1);
             return Token;
         }
     }
@@ -295,12 +281,20 @@ inspect_token NextToken(inspect_lexer *Lexer)
     return NextIdentifierOrNumber(Lexer);
 }
 
-bool CreateLexerInternal(char *Filename, inspect_lexer *Result)
+bool CreateLexerInternal(char *Filename, source_reader *Reader, inspect_lexer *Result)
 {
-    char *File = ReadEntireFileAndTerminate(Filename);
+    char *File = ReadSource(Reader, Filename);
     
     if (!File)
     {
+        free(Filename);
+        return false;
+    }
+    
+    if (!AddSourceFile(Filename, File, &Result->File))
+    {
+        free(File);
+        free(Filename);
         return false;
     }
     
@@ -308,22 +302,23 @@ bool CreateLexerInternal(char *Filename, inspect_lexer *Result)
     Result->Begin = File;
     Result->At = File;
     Result->Filename = Filename;
-    Result->NextLine = 1;
-    Result->NextColumn = 1;
-    Result->Line = -1;
-    Result->Column = -1;
     
     return true;
 }
 
 bool CreateLexer(const char *Filename, inspect_lexer *Result)
 {
-    return CreateLexerInternal(strdup(Filename), Result);
+    return CreateLexerInternal(strdup(Filename), nullptr, Result);
+}
+
+bool CreateLexer(const char *Filename, source_reader *Reader, inspect_lexer *Result)
+{
+    return CreateLexerInternal(strdup(Filename), Reader, Result);
 }
 
 bool CreateLexer(char *Filename, inspect_lexer *Result)
 {
-    return CreateLexerInternal(Filename, Result);
+    return CreateLexerInternal(Filename, nullptr, Result);
 }
 
 bool CreateLexer(char *Filename, size_t size, inspect_lexer *Result)
@@ -331,11 +326,12 @@ bool CreateLexer(char *Filename, size_t size, inspect_lexer *Result)
     char *FilenameBuffer = (char *)malloc(size + 1);
     strncpy(FilenameBuffer, Filename, size);
     FilenameBuffer[size] = '\0';
-    return CreateLexerInternal(FilenameBuffer, Result);
+    return CreateLexerInternal(FilenameBuffer, nullptr, Result);
 }
 
 void FreeLexer(inspect_lexer *Lexer)
 {
+    RemoveSourceFile(Lexer->File);
     free(Lexer->Begin);
     free(Lexer->Filename);
     free(Lexer->Directory);
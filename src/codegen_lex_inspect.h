@@ -1,20 +1,14 @@
 #pragma once
+#include "codegen_lex_base.h"
 
 struct inspect_lexer
 {
     char *Directory;
     char *Filename;
+    uint16 File; // Index in the source file table.
     
     char *Begin;
     char *At;
-    
-    // The line and the column of the position of the "At" pointer.
-    int NextLine;
-    int NextColumn;
-    
-    // The line and the column of the last given token (This is probably what you want!)
-    int Line;
-    int Column;
 };
 
 enum inspect_token_type
@@ -63,15 +57,25 @@ enum inspect_token_type
     ITokenType_IncompleteString,
 };
 
-struct inspect_token
+// 16 bytes, the text, line and column are found through the file when needed.
+struct itoken_info
 {
-    char *Text;
-    size_t Length;
     inspect_token_type Type;
+    uint16 File;
+    uint32 Offset; // From the beginning of the file.
+    uint32 Length;
 };
 
-inspect_token NextToken(inspect_lexer *Lexer);
+inline
+char *TokenText(itoken_info *Token)
+{
+    return GetSourceText(Token->File) + Token->Offset;
+}
+
+itoken_info NextToken(inspect_lexer *Lexer);
 bool CreateLexer(const char *Filename, inspect_lexer *Result);
+bool CreateLexer(const char *Filename, source_reader *Reader, inspect_lexer *Result);
 bool CreateLexer(char *Filename, size_t length, inspect_lexer *Result);
+// Takes ownership of Filename, even if it fails.
 bool CreateLexer(char *Filename, inspect_lexer *Result);
 void FreeLexer(inspect_lexer *Lexer);
@@ -0,0 +1,382 @@
+#include "codegen_lex_base.h"
+#include "codegen_lex_inspect.h"
+#include "codegen_lex_pipeline.h"
+
+static inline
+bool IsLastToken(itoken_info *Token)
+{
+    return Token->Type == ITokenType_End || Token->Type == ITokenType_IncompleteString;
+}
+
+static inline
+bool ShouldStopLexing(lex_pipeline *Pipeline, lex_worker *Worker)
+{
+    return Pipeline->Stop.load(std::memory_order_relaxed) ||
+        Worker->Cancelled.load(std::memory_order_relaxed);
+}
+
+// NOTE: Each side announces that it waits before it looks at the ring one last time, and
+// the other side looks for the announcement after it changed the ring. The fences keep
+// both from missing each other, one of them always sees what the other one did.
+//
+// A side that waits is only woken once there is a batch of work for it, waking it for
+// every token would just move the two threads back and forth.
+#define LEX_WAKE_BATCH (token_ring<itoken_info>::Size / 2)
+
+static inline
+bool HasRoomForBatch(token_ring<itoken_info> *Ring)
+{
+    return token_ring<itoken_info>::Size - TokensInRing(Ring) >= LEX_WAKE_BATCH;
+}
+
+static
+bool PushToken(lex_pipeline *Pipeline, lex_worker *Worker, itoken_info *Token)
+{
+    if (!TryPushToken(&Worker->Ring, Token))
+    {
+        // The parser is behind, there is nothing better to do than to let it catch up.
+        std::unique_lock<std::mutex> Guard(Worker->Lock);
+        Worker->ProducerWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        
+        while (!HasRoomForBatch(&Worker->Ring))
+        {
+            if (ShouldStopLexing(Pipeline, Worker))
+            {
+                Worker->ProducerWaiting.store(false, std::memory_order_relaxed);
+                return false;
+            }
+            
+            Worker->Changed.wait(Guard);
+        }
+        
+        Worker->ProducerWaiting.store(false, std::memory_order_relaxed);
+        TryPushToken(&Worker->Ring, Token);
+    }
+    
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (Worker->ConsumerWaiting.load(std::memory_order_relaxed) &&
+        (IsLastToken(Token) || TokensInRing(&Worker->Ring) >= LEX_WAKE_BATCH))
+    {
+        std::lock_guard<std::mutex> Guard(Worker->Lock);
+        Worker->Changed.notify_all();
+    }
+    
+    return true;
+}
+
+static
+void SetStatus(lex_pipeline *Pipeline, lex_worker *Worker, lex_worker_status Status)
+{
+    {
+        std::lock_guard<std::mutex> Guard(Pipeline->Lock);
+        Worker->Status.store(Status, std::memory_order_release);
+    }
+    
+    Pipeline->Changed.notify_all();
+}
+
+static
+void LexFile(lex_pipeline *Pipeline, lex_worker *Worker)
+{
+    CreateTokenRing(&Worker->Ring);
+    
+    if (!CreateLexer(Worker->Path.c_str(), &Worker->Lexer))
+    {
+        SetStatus(Pipeline, Worker, LexWorker_OpenFailed);
+        return;
+    }
+    
+    SetStatus(Pipeline, Worker, LexWorker_Open);
+    
+    bool AfterImport = false;
+    for (;;)
+    {
+        itoken_info Token = NextToken(&Worker->Lexer);
+        
+        // Imported files are built the same way the parser builds them when it gets to
+        // the import, so it finds this worker instead of opening the file itself.
+        if (AfterImport && Token.Type == ITokenType_String &&
+            Pipeline->FollowImports.load(std::memory_order_relaxed))
+        {
+            std::string Path = Worker->Lexer.Directory;
+            if (!Path.empty())
+            {
+                Path += "/";
+            }
+            
+            Path.append(TokenText(&Token), Token.Length);
+            StartLexWorker(Pipeline, Path.c_str());
+        }
+        
+        AfterImport = Token.Type == ITokenType_Import;
+        
+        if (ShouldStopLexing(Pipeline, Worker) ||
+            !PushToken(Pipeline, Worker, &Token) || IsLastToken(&Token))
+        {
+            return;
+        }
+    }
+}
+
+static
+void RunLexThread(lex_pipeline *Pipeline)
+{
+    std::unique_lock<std::mutex> Guard(Pipeline->Lock);
+    for (;;)
+    {
+        while (!Pipeline->Stop.load(std::memory_order_relaxed) && Pipeline->Queue.empty())
+        {
+            Pipeline->Changed.wait(Guard);
+        }
+        
+        if (Pipeline->Stop.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        
+        lex_worker *Worker = Pipeline->Queue.front();
+        Pipeline->Queue.pop_front();
+        
+        // The parser may have needed it before any thread got to it, or it was stopped.
+        if (Worker->Status.load(std::memory_order_relaxed) != LexWorker_Queued)
+        {
+            continue;
+        }
+        
+        Worker->Status.store(LexWorker_Opening, std::memory_order_relaxed);
+        Worker->Running = true;
+        --Pipeline->IdleThreads;
+        Guard.unlock();
+        
+        // The parser may be waiting for a queued file that this thread was counted on for.
+        Pipeline->Changed.notify_all();
+        LexFile(Pipeline, Worker);
+        
+        Guard.lock();
+        Worker->Running = false;
+        ++Pipeline->IdleThreads;
+        Pipeline->Changed.notify_all();
+    }
+}
+
+void CreateLexPipeline(lex_pipeline *Pipeline)
+{
+    Pipeline->Stop.store(false, std::memory_order_relaxed);
+    Pipeline->FollowImports.store(true, std::memory_order_relaxed);
+    
+    // The parser has a core of its own.
+    unsigned ThreadCount = std::thread::hardware_concurrency();
+    Pipeline->MaxThreads = ThreadCount > 1 ? ThreadCount - 1 : 1;
+    Pipeline->IdleThreads = 0;
+}
+
+lex_worker *StartLexWorker(lex_pipeline *Pipeline, const char *Path)
+{
+    std::string Normalized = Path;
+    Normalized.resize(NormalizePath(&Normalized[0]));
+    
+    std::lock_guard<std::mutex> Guard(Pipeline->Lock);
+    if (Pipeline->Stop.load(std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    
+    lex_worker *&Worker = Pipeline->Workers[Normalized];
+    if (Worker)
+    {
+        return Worker;
+    }
+    
+    Worker = new lex_worker;
+    Worker->Path = Normalized;
+    Worker->Status.store(LexWorker_Queued, std::memory_order_relaxed);
+    Worker->Claimed = false;
+    Worker->Inline = false;
+    Worker->Running = false;
+    Worker->Cancelled.store(false, std::memory_order_relaxed);
+    Worker->Ring.Tokens = nullptr;
+    Worker->ProducerWaiting.store(false, std::memory_order_relaxed);
+    Worker->ConsumerWaiting.store(false, std::memory_order_relaxed);
+    Worker->Last.Type = ITokenType_Unknown;
+    
+    // Threads are only started once there is more to lex than the running ones can take.
+    Pipeline->Queue.push_back(Worker);
+    if (Pipeline->IdleThreads == 0 && Pipeline->Threads.size() < Pipeline->MaxThreads)
+    {
+        Pipeline->Threads.emplace_back(RunLexThread, Pipeline);
+        ++Pipeline->IdleThreads;
+    }
+    
+    // All, the parser waits on the same condition.
+    Pipeline->Changed.notify_all();
+    return Worker;
+}
+
+bool WaitForLexWorker(lex_pipeline *Pipeline, lex_worker *Worker)
+{
+    std::unique_lock<std::mutex> Guard(Pipeline->Lock);
+    Worker->Claimed = true;
+    
+    for (;;)
+    {
+        int Status = Worker->Status.load(std::memory_order_relaxed);
+        if (Status == LexWorker_Queued && Pipeline->IdleThreads == 0)
+        {
+            // Every thread is busy with other files, which can take until the parser gets
+            // to them. Lexing it right here is the only way not to wait for that.
+            Worker->Status.store(LexWorker_Opening, std::memory_order_relaxed);
+            Worker->Inline = true;
+            Guard.unlock();
+            
+            bool Opened = CreateLexer(Worker->Path.c_str(), &Worker->Lexer);
+            Worker->Status.store(Opened ? LexWorker_Open : LexWorker_OpenFailed,
+                                 std::memory_order_relaxed);
+            return Opened;
+        }
+        
+        if (Status != LexWorker_Queued && Status != LexWorker_Opening)
+        {
+            return Status == LexWorker_Open;
+        }
+        
+        Pipeline->Changed.wait(Guard);
+    }
+}
+
+itoken_info NextToken(lex_worker *Worker)
+{
+    if (IsLastToken(&Worker->Last))
+    {
+        return Worker->Last;
+    }
+    
+    if (Worker->Inline)
+    {
+        Worker->Last = NextToken(&Worker->Lexer);
+        return Worker->Last;
+    }
+    
+    if (!TryPopToken(&Worker->Ring, &Worker->Last))
+    {
+        std::unique_lock<std::mutex> Guard(Worker->Lock);
+        Worker->ConsumerWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        
+        // The thread always gets to the end of the file, the parser doesn't stop it.
+        while (!TryPopToken(&Worker->Ring, &Worker->Last))
+        {
+            Worker->Changed.wait(Guard);
+        }
+        
+        Worker->ConsumerWaiting.store(false, std::memory_order_relaxed);
+    }
+    
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (Worker->ProducerWaiting.load(std::memory_order_relaxed) &&
+        HasRoomForBatch(&Worker->Ring))
+    {
+        std::lock_guard<std::mutex> Guard(Worker->Lock);
+        Worker->Changed.notify_all();
+    }
+    
+    return Worker->Last;
+}
+
+static
+void WakeWorker(lex_worker *Worker)
+{
+    std::lock_guard<std::mutex> Guard(Worker->Lock);
+    Worker->Changed.notify_all();
+}
+
+static
+void FreeWorkerFile(lex_worker *Worker)
+{
+    if (Worker->Status.load(std::memory_order_relaxed) == LexWorker_Open)
+    {
+        FreeLexer(&Worker->Lexer);
+    }
+    
+    FreeTokenRing(&Worker->Ring);
+    Worker->Ring.Tokens = nullptr;
+}
+
+// The worker stays in the pipeline, so importing the file again doesn't start it again.
+static
+void StopWorker(lex_pipeline *Pipeline, lex_worker *Worker, std::unique_lock<std::mutex> &Guard)
+{
+    if (Worker->Claimed || Worker->Status.load(std::memory_order_relaxed) == LexWorker_Stopped)
+    {
+        return;
+    }
+    
+    Worker->Cancelled.store(true, std::memory_order_relaxed);
+    if (Worker->Running)
+    {
+        WakeWorker(Worker);
+        while (Worker->Running)
+        {
+            Pipeline->Changed.wait(Guard);
+        }
+    }
+    
+    FreeWorkerFile(Worker);
+    Worker->Status.store(LexWorker_Stopped, std::memory_order_relaxed);
+}
+
+void StopLexWorker(lex_pipeline *Pipeline, const char *Path)
+{
+    std::string Normalized = Path;
+    Normalized.resize(NormalizePath(&Normalized[0]));
+    
+    std::unique_lock<std::mutex> Guard(Pipeline->Lock);
+    auto It = Pipeline->Workers.find(Normalized);
+    if (It != Pipeline->Workers.end())
+    {
+        StopWorker(Pipeline, It->second, Guard);
+    }
+}
+
+void StopUnclaimedLexWorkers(lex_pipeline *Pipeline)
+{
+    std::unique_lock<std::mutex> Guard(Pipeline->Lock);
+    for (auto &Entry : Pipeline->Workers)
+    {
+        StopWorker(Pipeline, Entry.second, Guard);
+    }
+}
+
+void FreeLexPipeline(lex_pipeline *Pipeline)
+{
+    // Under the lock so no worker can start another one after this.
+    {
+        std::lock_guard<std::mutex> Guard(Pipeline->Lock);
+        Pipeline->Stop.store(true, std::memory_order_relaxed);
+        for (auto &Entry : Pipeline->Workers)
+        {
+            WakeWorker(Entry.second);
+        }
+    }
+    
+    Pipeline->Changed.notify_all();
+    for (std::thread &Thread : Pipeline->Threads)
+    {
+        Thread.join();
+    }
+    
+    for (auto &Entry : Pipeline->Workers)
+    {
+        lex_worker *Worker = Entry.second;
+        if (Worker->Status.load(std::memory_order_relaxed) != LexWorker_Stopped)
+        {
+            FreeWorkerFile(Worker);
+        }
+        
+        delete Worker;
+    }
+    
+    Pipeline->Threads.clear();
+    Pipeline->Queue.clear();
+    Pipeline->Workers.clear();
+}
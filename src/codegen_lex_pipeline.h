@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "codegen_lex_inspect.h"
+#include "token_ring.h"
+
+enum lex_worker_status
+{
+    LexWorker_Queued,
+    LexWorker_Opening,
+    LexWorker_Open,
+    LexWorker_OpenFailed,
+    
+    // Stopped before the parser got to it, because the file turned out not to be needed.
+    LexWorker_Stopped,
+};
+
+// Lexes one file on one of the pipeline's threads into Ring, ahead of the parser reading it.
+struct lex_worker
+{
+    std::string Path;
+    inspect_lexer Lexer; // Only valid once Status is LexWorker_Open.
+    std::atomic<int> Status;
+    
+    // Set once the parser waited for the file, it is never stopped after that.
+    bool Claimed;
+    
+    // The parser had to open the file before any thread got to it, so it lexes it itself
+    // and Ring isn't used.
+    bool Inline;
+    
+    // Whether a thread is lexing the file right now, under the pipeline's lock.
+    bool Running;
+    std::atomic<bool> Cancelled;
+    
+    token_ring<itoken_info> Ring;
+    
+    // The thread waits on Changed when Ring is full, the parser when it is empty. Each
+    // side only takes Lock to notify when the other one said it is waiting.
+    std::mutex Lock;
+    std::condition_variable Changed;
+    std::atomic<bool> ProducerWaiting;
+    std::atomic<bool> ConsumerWaiting;
+    
+    // The last token given to the parser, the end of the file is repeated from here
+    // after the thread is done.
+    itoken_info Last;
+};
+
+// Every file being lexed ahead of the parser. A worker queues a worker for each file it
+// sees imported, so by the time the parser gets to the import the file is usually already
+// open and lexed. No more than one thread per core lexes them.
+struct lex_pipeline
+{
+    std::mutex Lock;
+    std::condition_variable Changed;
+    std::unordered_map<std::string, lex_worker *> Workers;
+    std::deque<lex_worker *> Queue;
+    std::vector<std::thread> Threads;
+    unsigned MaxThreads;
+    
+    // Threads that aren't lexing a file, they take the next queued one.
+    unsigned IdleThreads;
+    
+    // Once set no new workers are started and the running ones give up.
+    std::atomic<bool> Stop;
+    
+    // Cleared when something else takes care of imported files.
+    std::atomic<bool> FollowImports;
+};
+
+void CreateLexPipeline(lex_pipeline *Pipeline);
+
+// Queues the file to be lexed on another thread, unless it already is. The path is
+// normalized, it is both what is opened and what identifies the file.
+// Null once the pipeline is being freed.
+lex_worker *StartLexWorker(lex_pipeline *Pipeline, const char *Path);
+
+// Waits until the worker has opened its file, false if it couldn't. If no thread has
+// started on the file yet the calling thread opens and lexes it itself.
+bool WaitForLexWorker(lex_pipeline *Pipeline, lex_worker *Worker);
+
+itoken_info NextToken(lex_worker *Worker);
+
+// Stops lexing a file the parser didn't wait for and won't need, like an import that was
+// already parsed or loaded from a module. Returns once no thread works on it anymore.
+void StopLexWorker(lex_pipeline *Pipeline, const char *Path);
+
+// StopLexWorker for every file the parser hasn't waited for yet.
+void StopUnclaimedLexWorkers(lex_pipeline *Pipeline);
+
+// Stops every worker, including the ones the parser never got to, and frees their lexers.
+void FreeLexPipeline(lex_pipeline *Pipeline);
@@ -5,22 +5,26 @@
 #include "codegen_lex_write.h"
 
 bool
-CreateLexer(write_lexer *Lexer, const char *Filename)
+CreateLexer(write_lexer *Lexer, const char *Filename, source_reader *Reader)
 {
-    char *Text = ReadEntireFileAndTerminate(Filename);
+    char *Text = ReadSource(Reader, Filename);
     if (!Text)
     {
         return false;
     }
     
+    char *Name = strdup(Filename);
+    if (!AddSourceFile(Name, Text, &Lexer->File))
+    {
+        free(Name);
+        free(Text);
+        return false;
+    }
+    
     Lexer->Begin = Text;
     Lexer->At = Text;
-    Lexer->Filename = strdup(Filename);
+    Lexer->Filename = Name;
     Lexer->Mode = Mode_Text;
-    Lexer->NextLine = 1;
-    Lexer->NextColumn = 1;
-    Lexer->Line = -1;
-    Lexer->Column = -1;
     Lexer->Flags = 0;
     
     return true;
@@ -28,6 +32,7 @@ CreateLexer(write_lexer *Lexer, const char *Filename)
 
 void FreeLexer(write_lexer *Lexer)
 {
+    RemoveSourceFile(Lexer->File);
     free(Lexer->Filename);
     free(Lexer->Begin);
 }
@@ -35,7 +40,6 @@ void FreeLexer(write_lexer *Lexer)
 static inline
 void Advance(write_lexer *Lexer)
 {
-    Lexer->NextColumn++;
     Lexer->At++;
 }
 
@@ -48,12 +52,6 @@ void EatIgnoredExpressionCharacters(write_lexer *Lexer)
         
         if (IsWhitespace(C))
         {
-            if (C == '\n')
-            {
-                Lexer->NextLine++;
-                Lexer->NextColumn = 0;
-            }
-            
             Advance(Lexer);
             continue;
         }
@@ -75,60 +73,60 @@ static constexpr char *KeywordBreakpoint = "breakpoint";
 static constexpr char *KeywordHasAttribute = "has_attribute";
 
 static
-bool SetKeyword(write_token *Token)
+bool SetKeyword(wtoken_info *Token, char *Text)
 {
     if (ConstexprStrlen(KeywordIf) == Token->Length &&
-        strncmp(Token->Text, KeywordIf, Token->Length) == 0)
+        strncmp(Text, KeywordIf, Token->Length) == 0)
     {
         Token->Type = WTokenType_If;
     }
     else if (ConstexprStrlen(KeywordEnd) == Token->Length &&
-             strncmp(Token->Text, KeywordEnd, Token->Length) == 0)
+             strncmp(Text, KeywordEnd, Token->Length) == 0)
     {
         Token->Type = WTokenType_End;
     }
     else if (ConstexprStrlen(KeywordFor) == Token->Length &&
-             strncmp(Token->Text, KeywordFor, Token->Length) == 0)
+             strncmp(Text, KeywordFor, Token->Length) == 0)
     {
         Token->Type = WTokenType_For;
     }
     else if (ConstexprStrlen(KeywordForEach) == Token->Length &&
-             strncmp(Token->Text, KeywordForEach, Token->Length) == 0)
+             strncmp(Text, KeywordForEach, Token->Length) == 0)
     {
         Token->Type = WTokenType_ForEach;
     }
     else if (ConstexprStrlen(KeywordIn) == Token->Length &&
-             strncmp(Token->Text, KeywordIn, Token->Length) == 0)
+             strncmp(Text, KeywordIn, Token->Length) == 0)
     {
         Token->Type = WTokenType_In;
     }
     else if (ConstexprStrlen(KeywordIgnoreNewLine) == Token->Length &&
-             strncmp(Token->Text, KeywordIgnoreNewLine, Token->Length) == 0)
+             strncmp(Text, KeywordIgnoreNewLine, Token->Length) == 0)
     {
         Token->Type = WTokenType_IgnoreNewLine;
     }
     else if (ConstexprStrlen(KeywordDefine) == Token->Length &&
-             strncmp(Token->Text, KeywordDefine, Token->Length) == 0)
+             strncmp(Text, KeywordDefine, Token->Length) == 0)
     {
         Token->Type = WTokenType_Define;
     }
     else if (ConstexprStrlen(KeywordDefinitions) == Token->Length &&
-             strncmp(Token->Text, KeywordDefinitions, Token->Length) == 0)
+             strncmp(Text, KeywordDefinitions, Token->Length) == 0)
     {
         Token->Type = WTokenType_Definitions;
     }
     else if (ConstexprStrlen(KeywordBeginTab) == Token->Length &&
-             strncmp(Token->Text, KeywordBeginTab, Token->Length) == 0)
+             strncmp(Text, KeywordBeginTab, Token->Length) == 0)
     {
         Token->Type = WTokenType_BeginTab;
     }
     else if (ConstexprStrlen(KeywordBreakpoint) == Token->Length &&
-             strncmp(Token->Text, KeywordBreakpoint, Token->Length) == 0)
+             strncmp(Text, KeywordBreakpoint, Token->Length) == 0)
     {
         Token->Type = WTokenType_Breakpoint;
     }
     else if (ConstexprStrlen(KeywordHasAttribute) == Token->Length &&
-             strncmp(Token->Text, KeywordHasAttribute, Token->Length) == 0)
+             strncmp(Text, KeywordHasAttribute, Token->Length) == 0)
     {
         Token->Type = WTokenType_HasAttribute;
     }
@@ -141,7 +139,7 @@ bool SetKeyword(write_token *Token)
 }
 
 static
-write_token TextModeGetNext(write_lexer *Lexer);
+wtoken_info TextModeGetNext(write_lexer *Lexer);
 
 bool MoveToEndOfString(write_lexer *Lexer)
 {
@@ -160,13 +158,10 @@ bool MoveToEndOfString(write_lexer *Lexer)
 }
 
 static
-write_token ExpressionModeGetNext(write_lexer *Lexer)
+wtoken_info ExpressionModeGetNext(write_lexer *Lexer)
 {
-    Lexer->Line = Lexer->NextLine;
-    Lexer->Column = Lexer->NextColumn;
-    
     EatIgnoredExpressionCharacters(Lexer);
-    write_token Token;
+    wtoken_info Token;
     Token.Type = WTokenType_Unknown;
     
     switch (*Lexer->At)
@@ -182,23 +177,24 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
         case '\0':
         {
             Token.Type = WTokenType_EOF;
-            Token.Text = Lexer->At;
+            Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
             Token.Length = 1;
             return Token;
         }
         
         case '\"':
         {
-            Token.Text = Lexer->At + 1;
+            char *Text = Lexer->At + 1;
+            Token.Offset = (uint32)(Text - Lexer->Begin);
             if (!MoveToEndOfString(Lexer))
             {
                 Token.Type = WTokenType_IncompleteString;
-                Token.Length = (size_t)(Lexer->At - Token.Text);
+                Token.Length = (uint32)(Lexer->At - Text);
             }
             else
             {
                 Token.Type = WTokenType_String;
-                Token.Length = (size_t)(Lexer->At - Token.Text);
+                Token.Length = (uint32)(Lexer->At - Text);
                 Advance(Lexer);
             }
             
@@ -223,7 +219,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             else
             {
                 Token.Type = WTokenType_PlusPlus;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -241,7 +237,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             else
             {
                 Token.Type = WTokenType_MinusMinus;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -259,7 +255,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             else
             {
                 Token.Type = WTokenType_LessThanOrEquals;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -277,7 +273,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             else
             {
                 Token.Type = WTokenType_GreaterThanOrEquals;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -291,7 +287,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             if (Lexer->At[1] == '|')
             {
                 Token.Type = WTokenType_BooleanOr;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -305,7 +301,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             if (Lexer->At[1] == '&')
             {
                 Token.Type = WTokenType_BooleanAnd;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -323,7 +319,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             else
             {
                 Token.Type = WTokenType_Equals;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -341,7 +337,7 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             else
             {
                 Token.Type = WTokenType_NotEquals;
-                Token.Text = Lexer->At;
+                Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
                 Token.Length = 2;
                 Advance(Lexer);
                 Advance(Lexer);
@@ -353,14 +349,14 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
     
     if (Token.Type != WTokenType_Unknown)
     {
-        Token.Text = Lexer->At;
+        Token.Offset = (uint32)(Lexer->At - Lexer->Begin);
         Token.Length = 1;
         Advance(Lexer);
         return Token;
     }
     
-    Token.Text = Lexer->At;
     char *Begin = Lexer->At;
+    Token.Offset = (uint32)(Begin - Lexer->Begin);
     bool IsNumber = true;
     
     for (;;)
@@ -389,13 +385,13 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
             case ' ':
             case '$':
             {
-                Token.Length = (size_t)(Lexer->At - Begin);
+                Token.Length = (uint32)(Lexer->At - Begin);
                 
                 if (IsNumber)
                 {
                     Token.Type = WTokenType_Number;
                 }
-                else if (!SetKeyword(&Token))
+                else if (!SetKeyword(&Token, Begin))
                 {
                     Token.Type = WTokenType_Identifier;
                 }
@@ -417,14 +413,11 @@ write_token ExpressionModeGetNext(write_lexer *Lexer)
 }
 
 static
-write_token TextModeGetNext(write_lexer *Lexer)
+wtoken_info TextModeGetNext(write_lexer *Lexer)
 {
-    Lexer->Line = Lexer->NextLine;
-    Lexer->Column = Lexer->NextColumn;
-    
     char *Begin = Lexer->At;
-    write_token Token;
-    Token.Text = Lexer->At;
+    wtoken_info Token;
+    Token.Offset = (uint32)(Begin - Lexer->Begin);
     Token.Type = WTokenType_Text;
     
     if (*Lexer->At == '\0')
@@ -437,8 +430,6 @@ write_token TextModeGetNext(write_lexer *Lexer)
     {
         Token.Length = 1;
         Token.Type = WTokenType_TextNewLine;
-        Lexer->NextColumn = 0;
-        ++Lexer->NextLine;
         Advance(Lexer);
         return Token;
     }
@@ -449,7 +440,7 @@ write_token TextModeGetNext(write_lexer *Lexer)
         {
             case '$':
             {
-                Token.Length = (size_t)(Lexer->At - Begin);
+                Token.Length = (uint32)(Lexer->At - Begin);
                 Advance(Lexer);
                 Lexer->Mode = Mode_Expression;
                 
@@ -472,7 +463,7 @@ write_token TextModeGetNext(write_lexer *Lexer)
             case '\n':
             case '\0':
             {
-                Token.Length = (size_t)(Lexer->At - Begin);
+                Token.Length = (uint32)(Lexer->At - Begin);
                 return Token;
             }
             
@@ -486,7 +477,7 @@ write_token TextModeGetNext(write_lexer *Lexer)
 }
 
 static inline
-write_token NextToken(write_lexer *Lexer)
+wtoken_info NextToken(write_lexer *Lexer)
 {
     Lexer->Flags = 0;
     if (Lexer->Mode == Mode_Text)
@@ -501,17 +492,17 @@ write_token NextToken(write_lexer *Lexer)
 
 void NextTokenInfo(write_lexer *Lexer, wtoken_info *Result)
 {
+    bool FirstAfterModeSwitch = (Lexer->Flags & WLexerFlag_WillCrossExpressionBounds) != 0;
+    
+    *Result = NextToken(Lexer);
+    Result->File = Lexer->File;
     Result->Flags = 0;
-    if (Lexer->Flags & WLexerFlag_WillCrossExpressionBounds)
+    
+    if (FirstAfterModeSwitch)
     {
         Result->Flags |= WTokenFlag_FirstAfterModeSwitch;
     }
     
-    Result->Token = NextToken(Lexer);
-    Result->Filename = Lexer->Filename;
-    Result->Line = Lexer->Line;
-    Result->Column = Lexer->Column;
-    
     if (Lexer->Flags & WLexerFlag_SilentlyCrossedExpressionBounds)
     {
         Result->Flags |= WTokenFlag_FirstAfterModeSwitch;
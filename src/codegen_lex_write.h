@@ -1,6 +1,7 @@
 #pragma once
 
 #include "numeric_types.h"
+#include "codegen_lex_base.h"
 
 enum write_token_type
 {
@@ -54,13 +55,6 @@ enum write_token_type
     WTokenType_IncompleteString
 };
 
-struct write_token
-{
-    write_token_type Type;
-    char *Text;
-    size_t Length;
-};
-
 enum write_lexer_mode
 {
     Mode_Text,
@@ -86,33 +80,35 @@ struct write_lexer
     char *At;
     char *Begin;
     char *Filename;
+    uint16 File; // Given by AddSourceFile in CreateLexer.
     write_lexer_mode Mode;
     uint32 Flags;
     
-    int NextLine;
-    int NextColumn;
-    
-    int Line;
-    int Column;
-    
     int32 AutoClearNewLineTop;
     uint64 AutoClearNewLineStack; // Allows for 64 levels of nesting.
 };
 
-enum wtoken_flags : uint32
+enum wtoken_flags : uint16
 {
     WTokenFlag_FirstAfterModeSwitch = 1,
 };
 
+// Same layout as itoken_info, the flags fit in what would be padding there.
 struct wtoken_info
 {
-    char *Filename;
-    uint32 Flags;
-    int Line;
-    int Column;
-    write_token Token;
+    write_token_type Type;
+    uint16 File;
+    uint16 Flags;
+    uint32 Offset; // From the beginning of the file.
+    uint32 Length;
 };
 
-wtoken_info NextTokenInfo(write_lexer *Lexer);
-bool CreateLexer(write_lexer *Lexer, const char *Filename);
+inline
+char *TokenText(wtoken_info *Token)
+{
+    return GetSourceText(Token->File) + Token->Offset;
+}
+
+void NextTokenInfo(write_lexer *Lexer, wtoken_info *Result);
+bool CreateLexer(write_lexer *Lexer, const char *Filename, source_reader *Reader = nullptr);
 void FreeLexer(write_lexer *Lexer);
@@ -0,0 +1,197 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#include "codegen_library.h"
+#include "codegen_parse_inspect.h"
+#include "codegen_parse_write.h"
+#include "codegen_parse_base.h"
+#include "codegen_lex_base.h"
+
+struct codegen_context
+{
+    codegen_options Options;
+    source_reader Reader;
+    
+    // Only changed by CodegenAddSource, the import threads read it while parsing.
+    std::unordered_map<std::string, std::string> Sources;
+    
+    // Kept between renders, see ResetParser.
+    bool HasRenderer;
+    write_parser Renderer;
+    
+    // Set with CodegenSetString, every render of the context sees them on top of the
+    // model's globals.
+    inspect_data_item Variables;
+    
+    std::string Output;
+    std::string Errors;
+};
+
+// The tokens of the model point into the parser's files, it lives as long as the model.
+struct codegen_model
+{
+    inspect_data Data;
+    inspect_parser Parser;
+};
+
+static
+char *CopyText(const char *Text, size_t Length)
+{
+    char *Result = (char *)malloc(Length + 1);
+    memcpy(Result, Text, Length);
+    Result[Length] = '\0';
+    return Result;
+}
+
+static
+char *ReadContextSource(void *User, const char *Path)
+{
+    codegen_context *Context = (codegen_context *)User;
+    
+    auto Found = Context->Sources.find(Path);
+    if (Found != Context->Sources.end())
+    {
+        return CopyText(Found->second.data(), Found->second.size());
+    }
+    
+    const char *Text;
+    size_t Length;
+    if (Context->Options.Resolve &&
+        Context->Options.Resolve(Context->Options.ResolveUser, Path, &Text, &Length))
+    {
+        return CopyText(Text, Length);
+    }
+    
+    if (Context->Options.ReadFiles)
+    {
+        return ReadEntireFileAndTerminate(Path);
+    }
+    
+    return nullptr;
+}
+
+codegen_context *CodegenCreateContext(const codegen_options *Options)
+{
+    codegen_context *Context = new codegen_context;
+    Context->Options = *Options;
+    Context->Reader.Read = ReadContextSource;
+    Context->Reader.User = Context;
+    Context->HasRenderer = false;
+    
+    // Templates can't assign to them, they stay the same from one render to the next.
+    Context->Variables = NewDictItem();
+    Context->Variables.Dict->ReadOnly = true;
+    return Context;
+}
+
+void CodegenFreeContext(codegen_context *Context)
+{
+    if (Context->HasRenderer)
+    {
+        FreeParser(&Context->Renderer);
+    }
+    
+    FreeDataItem(&Context->Variables);
+    delete Context;
+}
+
+void CodegenAddSource(codegen_context *Context, const char *Path,
+                      const char *Text, size_t Length)
+{
+    Context->Sources[Path].assign(Text, Length);
+}
+
+codegen_model *CodegenParse(codegen_context *Context, const char *Path)
+{
+    Context->Errors.clear();
+    std::string *PreviousCapture = ErrorCapture;
+    ErrorCapture = &Context->Errors;
+    
+    codegen_model *Model = new codegen_model;
+    if (!CreateParser(Path, &Model->Parser, &Context->Reader))
+    {
+        PrintError("Unable to open file \"%s\"\n", Path);
+        ErrorCapture = PreviousCapture;
+        delete Model;
+        return nullptr;
+    }
+    
+    if (Context->Options.ParallelImports)
+    {
+        ParseImportsInParallel(&Model->Parser);
+    }
+    
+    CreateInspectData(&Model->Data);
+    bool Parsed = ParseInspect(&Model->Parser, &Model->Data);
+    ErrorCapture = PreviousCapture;
+    
+    if (!Parsed)
+    {
+        CodegenFreeModel(Model);
+        return nullptr;
+    }
+    
+    return Model;
+}
+
+void CodegenFreeModel(codegen_model *Model)
+{
+    FreeInspectData(&Model->Data);
+    FreeParser(&Model->Parser);
+    delete Model;
+}
+
+void CodegenSetString(codegen_context *Context, const char *Name, const char *Value)
+{
+    Insert(Context->Variables.Dict, Name, NewStringItem(Value));
+}
+
+bool CodegenRender(codegen_context *Context, codegen_model *Model, const char *TemplatePath,
+                   char *Buffer, size_t Capacity, size_t *Length)
+{
+    Context->Errors.clear();
+    std::string *PreviousCapture = ErrorCapture;
+    ErrorCapture = &Context->Errors;
+    
+    bool Started = Context->HasRenderer ?
+        ResetParser(&Context->Renderer, TemplatePath, &Context->Reader, &Context->Output) :
+        CreateParser(&Context->Renderer, TemplatePath, &Context->Reader, &Context->Output);
+    
+    bool Rendered = false;
+    if (!Started)
+    {
+        PrintError("Unable to open template \"%s\"\n", TemplatePath);
+    }
+    else
+    {
+        Context->HasRenderer = true;
+        Rendered = EvaluateTemplate(&Context->Renderer, &Model->Data, Context->Variables.Dict);
+    }
+    
+    ErrorCapture = PreviousCapture;
+    
+    if (!Rendered)
+    {
+        *Length = 0;
+        return false;
+    }
+    
+    *Length = Context->Output.size();
+    if (Context->Output.size() + 1 > Capacity)
+    {
+        return false;
+    }
+    
+    memcpy(Buffer, Context->Output.data(), Context->Output.size());
+    Buffer[Context->Output.size()] = '\0';
+    return true;
+}
+
+const char *CodegenGetErrors(codegen_context *Context)
+{
+    return Context->Errors.c_str();
+}
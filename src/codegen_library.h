@@ -0,0 +1,64 @@
+#pragma once
+#include <stddef.h>
+
+// Runs codegen inside another program, built into codegen.lib by build.bat. Schemas and
+// templates can be handed over as text instead of files, and the output of a template
+// is copied into a buffer instead of written to a file. Nothing is read from disk unless
+// the options ask for it, and modules and snapshots are never used.
+//
+// A context is only used from one thread at a time, use one per thread. A parsed model
+// is only read from then on, so any number of contexts can render it at once. Models
+// can outlive the context that parsed them. Contexts share nothing but the table of
+// source files tokens point into, which briefly takes a lock whenever a file is opened.
+
+struct codegen_context;
+struct codegen_model;
+
+// Finds the text of a file that wasn't added with CodegenAddSource, imports included.
+// Returns false if there is no such file. The text is copied before anything else is
+// asked for, it only has to live until then. Called from the import threads if
+// ParallelImports is set.
+typedef bool (*codegen_resolve_proc)(void *User, const char *Path,
+                                     const char **Text, size_t *Length);
+
+struct codegen_options
+{
+    codegen_resolve_proc Resolve; // Can be null.
+    void *ResolveUser;
+    
+    // Files that weren't added and Resolve doesn't have are read from disk.
+    bool ReadFiles;
+    
+    // See ParseImportsInParallel.
+    bool ParallelImports;
+};
+
+codegen_context *CodegenCreateContext(const codegen_options *Options);
+void CodegenFreeContext(codegen_context *Context);
+
+// Adds the text of a schema or template, Path is what it is parsed, rendered and
+// imported by. Imports are looked for next to the file importing them, like on disk, so
+// "schemas/a.ins" importing "b.ins" finds "schemas/b.ins". Text is copied.
+void CodegenAddSource(codegen_context *Context, const char *Path,
+                      const char *Text, size_t Length);
+
+// Parses and resolves the schema at Path and everything it imports. Null if it failed,
+// see CodegenGetErrors.
+codegen_model *CodegenParse(codegen_context *Context, const char *Path);
+void CodegenFreeModel(codegen_model *Model);
+
+// Sets a string every template rendered with the context can read, like HeaderFile and
+// SourceFile which the command line sets to the names of the files it writes. It hides
+// a global of the model with the same name, the model itself isn't changed.
+void CodegenSetString(codegen_context *Context, const char *Name, const char *Value);
+
+// Evaluates the template at TemplatePath against the model and copies the output into
+// Buffer, followed by a null terminator. Length is set to the length of the output
+// without the terminator. If it doesn't fit nothing is copied and the render fails, it
+// can be done again with a buffer of at least Length + 1.
+bool CodegenRender(codegen_context *Context, codegen_model *Model, const char *TemplatePath,
+                   char *Buffer, size_t Capacity, size_t *Length);
+
+// Everything the last CodegenParse or CodegenRender of the context would have printed
+// on the command line. Some errors in a schema don't stop it from being parsed.
+const char *CodegenGetErrors(codegen_context *Context);
@@ -0,0 +1,400 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "codegen_binary.h"
+#include "codegen_module.h"
+#include "compiler_utils.h"
+
+static const char ModuleMagic[8] = { 'C', 'G', 'M', 'O', 'D', 'U', 'L', 'E' };
+
+struct module_writer
+{
+    binary_writer Out;
+    char *Text;
+    
+    // Index + 1 of every attribute list, 0 is null.
+    std::unordered_map<attribute_list *, uint32> AttributeListIds;
+};
+
+struct module_reader
+{
+    binary_reader In;
+    inspect_lexer *Lexer;
+    size_t TextLength;
+    
+    std::vector<attribute_list *> *AttributeLists;
+};
+
+std::string GetModulePath(const char *Filename)
+{
+    std::string Path = Filename;
+    Path += ".mod";
+    return Path;
+}
+
+// Tokens are written without their file, they all come from the module's file.
+static
+void WriteToken(module_writer *Writer, itoken_info *Token)
+{
+    WriteU32(&Writer->Out, (uint32)Token->Type);
+    WriteU32(&Writer->Out, Token->Offset);
+    WriteU32(&Writer->Out, Token->Length);
+}
+
+static
+void WriteInstance(module_writer *Writer, attribute_instance *Instance)
+{
+    WriteToken(Writer, &Instance->IdentifierToken);
+    WriteU32(&Writer->Out, Instance->Aliased ? 1 : 0);
+    if (Instance->Aliased)
+    {
+        // The alias is only an identifier, it never has an argument list.
+        return;
+    }
+    
+    argument_list *Arguments = &Instance->Arguments;
+    WriteToken(Writer, &Arguments->ListBegin);
+    WriteU32(&Writer->Out, (uint32)Arguments->Arguments.size());
+    for (argument_item &Argument : Arguments->Arguments)
+    {
+        WriteU32(&Writer->Out, Argument.Named ? 1 : 0);
+        if (Argument.Named)
+        {
+            WriteToken(Writer, &Argument.Name);
+        }
+        
+        WriteU32(&Writer->Out, (uint32)(Argument.Value.Begin - Writer->Text));
+        WriteU32(&Writer->Out, (uint32)Argument.Value.Length);
+    }
+}
+
+static
+void WriteDeclaration(module_writer *Writer, imported_declaration *Declaration)
+{
+    WriteU32(&Writer->Out, (uint32)Declaration->Kind);
+    WriteU32(&Writer->Out, (uint32)Declaration->AttributeListsEnd);
+    
+    if (Declaration->Kind == Imported_TypeInfo)
+    {
+        inspect_dict *Info = Declaration->TypeInfo.Dict;
+        WriteString(&Writer->Out, StringFromItem(&GetSlot(Info, TypeInfoSlot_Name)));
+        WriteString(&Writer->Out, StringFromItem(&GetSlot(Info, TypeInfoSlot_Descriptor)));
+        WriteString(&Writer->Out, StringFromItem(&GetSlot(Info, TypeInfoSlot_CamelCase)));
+        
+        attribute_list *Attributes = Declaration->TypeInfo.Dict->Attributes;
+        WriteU32(&Writer->Out, Attributes ? Writer->AttributeListIds[Attributes] : 0);
+        WriteToken(Writer, &Declaration->Name);
+    }
+    else if (Declaration->Kind == Imported_Attribute)
+    {
+        WriteToken(Writer, &Declaration->Attribute.Name);
+        
+        std::vector<itoken_info> &Names = Declaration->Attribute.ArgumentList.Names;
+        WriteU32(&Writer->Out, (uint32)Names.size());
+        for (itoken_info &Name : Names)
+        {
+            WriteToken(Writer, &Name);
+        }
+    }
+    else if (Declaration->Kind == Imported_Alias)
+    {
+        WriteToken(Writer, &Declaration->Alias.Alias);
+        WriteInstance(Writer, &Declaration->Alias.Value);
+    }
+    else
+    {
+        // The path is built again from wherever the file is when the module is loaded.
+        WriteToken(Writer, &Declaration->Import.Filename);
+    }
+}
+
+bool WriteModule(const char *Path, inspect_lexer *Lexer,
+                 std::vector<imported_declaration> *Declarations,
+                 std::vector<attribute_list *> *AttributeLists)
+{
+    module_writer Writer;
+    Writer.Text = Lexer->Begin;
+    
+    WriteBytes(&Writer.Out, ModuleMagic, sizeof(ModuleMagic));
+    WriteU32(&Writer.Out, MODULE_VERSION);
+    WriteU64(&Writer.Out, fnv64(Lexer->Begin, strlen(Lexer->Begin)));
+    
+    size_t HashAt = BeginHashedSection(&Writer.Out);
+    
+    WriteU32(&Writer.Out, (uint32)AttributeLists->size());
+    for (attribute_list *List : *AttributeLists)
+    {
+        Writer.AttributeListIds[List] = (uint32)Writer.AttributeListIds.size() + 1;
+        
+        WriteU32(&Writer.Out, (uint32)List->Attributes.size());
+        for (attribute_instance &Instance : List->Attributes)
+        {
+            WriteInstance(&Writer, &Instance);
+        }
+    }
+    
+    WriteU32(&Writer.Out, (uint32)Declarations->size());
+    for (imported_declaration &Declaration : *Declarations)
+    {
+        WriteDeclaration(&Writer, &Declaration);
+    }
+    
+    FinishHashedSection(&Writer.Out, HashAt);
+    
+    if (!WriteBinaryFile(Path, &Writer.Out))
+    {
+        printf("Unable to write module \"%s\"\n", Path);
+        return false;
+    }
+    
+    return true;
+}
+
+// Every token has to lie inside the file, so a damaged module can't point anywhere else.
+static
+void ReadToken(module_reader *Reader, itoken_info *Token)
+{
+    uint32 Type = ReadU32(&Reader->In);
+    Token->File = Reader->Lexer->File;
+    Token->Offset = ReadU32(&Reader->In);
+    Token->Length = ReadU32(&Reader->In);
+    
+    if (Type > ITokenType_IncompleteString ||
+        (uint64)Token->Offset + Token->Length > Reader->TextLength)
+    {
+        Reader->In.Failed = true;
+        Token->Type = ITokenType_Unknown;
+        return;
+    }
+    
+    Token->Type = (inspect_token_type)Type;
+}
+
+static
+void ReadInstance(module_reader *Reader, attribute_instance *Instance)
+{
+    Instance->InfoHandle = INVALID_ATTRIBUTE_HANDLE;
+    Instance->Alias = 0;
+    ReadToken(Reader, &Instance->IdentifierToken);
+    Instance->Aliased = ReadU32(&Reader->In) != 0;
+    if (Instance->Aliased)
+    {
+        return;
+    }
+    
+    argument_list *Arguments = &Instance->Arguments;
+    ReadToken(Reader, &Arguments->ListBegin);
+    uint32 Count = ReadU32(&Reader->In);
+    if (Count > BytesLeft(&Reader->In))
+    {
+        Reader->In.Failed = true;
+        return;
+    }
+    
+    Arguments->Arguments.reserve(Count);
+    for (uint32 I = 0; I < Count && !Reader->In.Failed; ++I)
+    {
+        argument_item Argument;
+        Argument.Named = ReadU32(&Reader->In) != 0;
+        if (Argument.Named)
+        {
+            ReadToken(Reader, &Argument.Name);
+        }
+        
+        uint32 Offset = ReadU32(&Reader->In);
+        uint32 Length = ReadU32(&Reader->In);
+        if ((uint64)Offset + Length > Reader->TextLength)
+        {
+            Reader->In.Failed = true;
+            return;
+        }
+        
+        Argument.Value.Begin = Reader->Lexer->Begin + Offset;
+        Argument.Value.Length = Length;
+        Arguments->Arguments.push_back(Argument);
+    }
+}
+
+static
+bool ReadDeclaration(module_reader *Reader, imported_declaration *Declaration)
+{
+    uint32 Kind = ReadU32(&Reader->In);
+    Declaration->AttributeListsEnd = ReadU32(&Reader->In);
+    if (Reader->In.Failed || Kind > Imported_Import ||
+        Declaration->AttributeListsEnd > Reader->AttributeLists->size())
+    {
+        return false;
+    }
+    
+    Declaration->Kind = (imported_declaration_kind)Kind;
+    if (Declaration->Kind == Imported_TypeInfo)
+    {
+        std::string Name = ReadString(&Reader->In);
+        std::string Descriptor = ReadString(&Reader->In);
+        std::string CamelCase = ReadString(&Reader->In);
+        uint32 Attributes = ReadU32(&Reader->In);
+        ReadToken(Reader, &Declaration->Name);
+        if (Reader->In.Failed || Attributes > Reader->AttributeLists->size())
+        {
+            return false;
+        }
+        
+        // The same item CreateTypeInfoItem makes when the file is parsed.
+        Declaration->TypeInfo = NewShapedDictItem(Shape_TypeInfo);
+        SetSlot(Declaration->TypeInfo.Dict, TypeInfoSlot_Name, NewStringItem(Name.c_str()));
+        SetSlot(Declaration->TypeInfo.Dict, TypeInfoSlot_Descriptor, NewStringItem(Descriptor.c_str()));
+        SetSlot(Declaration->TypeInfo.Dict, TypeInfoSlot_CamelCase, NewStringItem(CamelCase.c_str()));
+        Declaration->TypeInfo.Dict->Attributes = Attributes ? (*Reader->AttributeLists)[Attributes - 1] : nullptr;
+    }
+    else if (Declaration->Kind == Imported_Attribute)
+    {
+        ReadToken(Reader, &Declaration->Attribute.Name);
+        
+        uint32 Count = ReadU32(&Reader->In);
+        if (Count > BytesLeft(&Reader->In))
+        {
+            return false;
+        }
+        
+        std::vector<itoken_info> &Names = Declaration->Attribute.ArgumentList.Names;
+        Names.resize(Count);
+        for (itoken_info &Name : Names)
+        {
+            ReadToken(Reader, &Name);
+        }
+    }
+    else if (Declaration->Kind == Imported_Alias)
+    {
+        ReadToken(Reader, &Declaration->Alias.Alias);
+        ReadInstance(Reader, &Declaration->Alias.Value);
+    }
+    else
+    {
+        // Built the same way as BuildFilePath.
+        itoken_info *Filename = &Declaration->Import.Filename;
+        ReadToken(Reader, Filename);
+        if (!Reader->In.Failed)
+        {
+            Declaration->ImportPath = Reader->Lexer->Directory;
+            if (!Declaration->ImportPath.empty())
+            {
+                Declaration->ImportPath += "/";
+            }
+            
+            Declaration->ImportPath.append(TokenText(Filename), Filename->Length);
+            Declaration->ImportPath.resize(NormalizePath(&Declaration->ImportPath[0]));
+        }
+    }
+    
+    return !Reader->In.Failed;
+}
+
+static
+bool ReadModule(module_reader *Reader, std::vector<imported_declaration> *Declarations)
+{
+    uint32 ListCount = ReadU32(&Reader->In);
+    if (Reader->In.Failed || ListCount > BytesLeft(&Reader->In))
+    {
+        return false;
+    }
+    
+    for (uint32 I = 0; I < ListCount && !Reader->In.Failed; ++I)
+    {
+        attribute_list *List = new attribute_list;
+        Reader->AttributeLists->push_back(List);
+        
+        uint32 Count = ReadU32(&Reader->In);
+        if (Count > BytesLeft(&Reader->In))
+        {
+            return false;
+        }
+        
+        List->Attributes.resize(Count);
+        for (attribute_instance &Instance : List->Attributes)
+        {
+            ReadInstance(Reader, &Instance);
+        }
+    }
+    
+    uint32 DeclarationCount = ReadU32(&Reader->In);
+    if (Reader->In.Failed || DeclarationCount > BytesLeft(&Reader->In))
+    {
+        return false;
+    }
+    
+    Declarations->reserve(DeclarationCount);
+    for (uint32 I = 0; I < DeclarationCount; ++I)
+    {
+        Declarations->emplace_back();
+        if (!ReadDeclaration(Reader, &Declarations->back()))
+        {
+            // Only type infos own anything, and only once they are read completely.
+            Declarations->pop_back();
+            return false;
+        }
+    }
+    
+    return Reader->In.At == Reader->In.End;
+}
+
+bool LoadModule(const char *Filename, inspect_lexer *Lexer,
+                std::vector<imported_declaration> *Declarations,
+                std::vector<attribute_list *> *AttributeLists)
+{
+    // Most files have no module, that is known before the file is read.
+    std::vector<uint8> Bytes;
+    if (!ReadBinaryFile(GetModulePath(Filename).c_str(), &Bytes))
+    {
+        return false;
+    }
+    
+    module_reader Reader;
+    CreateBinaryReader(&Reader.In, &Bytes);
+    
+    char Magic[sizeof(ModuleMagic)];
+    if (!ReadBytes(&Reader.In, Magic, sizeof(Magic)) ||
+        memcmp(Magic, ModuleMagic, sizeof(Magic)) != 0 ||
+        ReadU32(&Reader.In) != MODULE_VERSION)
+    {
+        return false;
+    }
+    
+    uint64 TextHash = ReadU64(&Reader.In);
+    if (!CheckHashedSection(&Reader.In) || !CreateLexer(Filename, Lexer))
+    {
+        return false;
+    }
+    
+    Reader.Lexer = Lexer;
+    Reader.TextLength = strlen(Lexer->Begin);
+    Reader.AttributeLists = AttributeLists;
+    
+    if (fnv64(Lexer->Begin, Reader.TextLength) != TextHash ||
+        !ReadModule(&Reader, Declarations))
+    {
+        for (imported_declaration &Declaration : *Declarations)
+        {
+            if (Declaration.Kind == Imported_TypeInfo)
+            {
+                FreeDataItem(&Declaration.TypeInfo);
+            }
+        }
+        
+        for (attribute_list *List : *AttributeLists)
+        {
+            delete List;
+        }
+        
+        Declarations->clear();
+        AttributeLists->clear();
+        FreeLexer(Lexer);
+        return false;
+    }
+    
+    return true;
+}
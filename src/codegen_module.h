@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "codegen_parse_inspect.h"
+
+// A module is a file like common_types.ins parsed ahead of time, for files that are
+// imported by nearly every schema. Its types, attributes, aliases and imports are
+// written out the way a file parsed by the import pool records them, and an import
+// of the file replays them instead of lexing and parsing it again.
+//
+// What the declarations resolve to depends on everything else the importing schema
+// declares, so they are still resolved with the rest of the schema. Tokens are written
+// as offsets into the file, which is still read to check that it didn't change since
+// the module was written and for the text and location of the tokens.
+
+// Has to change whenever the format does, or whatever is parsed out of a file.
+#define MODULE_VERSION 2
+
+// Modules live next to their file, "types.ins" has "types.ins.mod".
+std::string GetModulePath(const char *Filename);
+
+// Declarations and AttributeLists are what a parser with a task parsed out of the
+// lexer's file.
+bool WriteModule(const char *Path, inspect_lexer *Lexer,
+                 std::vector<imported_declaration> *Declarations,
+                 std::vector<attribute_list *> *AttributeLists);
+
+// Loads the module of Filename and creates a lexer for the file, the tokens of the
+// declarations point into it. Fails without printing anything if there is no module or
+// the file changed since it was written, the file has to be parsed instead.
+bool LoadModule(const char *Filename, inspect_lexer *Lexer,
+                std::vector<imported_declaration> *Declarations,
+                std::vector<attribute_list *> *AttributeLists);
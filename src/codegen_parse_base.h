@@ -1,9 +1,77 @@
 #pragma once
+#include <stdio.h>
+#include <stdarg.h>
+#include <string>
+#include "codegen_lex_base.h"
+#include "codegen_lex_inspect.h"
+#include "codegen_lex_write.h"
+
+// Errors normally go straight to stdout. A file parsed on another thread collects them
+// here instead, they are printed once the file is merged so the output is the same no
+// matter which thread got to it first.
+inline thread_local std::string *ErrorCapture = nullptr;
+
+inline
+void PrintError(const char *Format, ...)
+{
+    va_list Arguments;
+    va_start(Arguments, Format);
+    
+    if (ErrorCapture)
+    {
+        va_list Retry;
+        va_copy(Retry, Arguments);
+        
+        char Buffer[1024];
+        int Length = vsnprintf(Buffer, sizeof(Buffer), Format, Arguments);
+        if (Length > 0 && (size_t)Length < sizeof(Buffer))
+        {
+            ErrorCapture->append(Buffer, (size_t)Length);
+        }
+        else if (Length > 0)
+        {
+            // Too long for the stack buffer, format again straight into the capture.
+            size_t Start = ErrorCapture->size();
+            ErrorCapture->resize(Start + (size_t)Length + 1);
+            vsnprintf(&(*ErrorCapture)[Start], (size_t)Length + 1, Format, Retry);
+            ErrorCapture->resize(Start + (size_t)Length);
+        }
+        
+        va_end(Retry);
+    }
+    else
+    {
+        vprintf(Format, Arguments);
+    }
+    
+    va_end(Arguments);
+}
 
 inline
 void PrintLocation(int Line, int Column, const char *Filename)
 {
-    printf("%s:%i:%i: ", Filename, Line, Column);
+    PrintError("%s:%i:%i: ", Filename, Line, Column);
+}
+
+inline
+void PrintLocation(uint16 File, uint32 Offset)
+{
+    int Line;
+    int Column;
+    GetSourceLocation(File, Offset, &Line, &Column);
+    PrintLocation(Line, Column, GetSourceFilename(File));
+}
+
+inline
+void PrintLocation(itoken_info *Token)
+{
+    PrintLocation(Token->File, Token->Offset);
+}
+
+inline
+void PrintLocation(wtoken_info *Token)
+{
+    PrintLocation(Token->File, Token->Offset);
 }
 
 #if 0
@@ -2,12 +2,14 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
 
 #include "codegen_lex_base.h"
 #include "codegen_lex_inspect.h"
 #include "codegen_parse_base.h"
 #include "codegen_parse_inspect.h"
 #include "codegen_inspect_data.h"
+#include "codegen_module.h"
 
 static inline
 void CreateLexerStack(lexer_stack *Stack)
@@ -16,13 +18,14 @@ void CreateLexerStack(lexer_stack *Stack)
 }
 
 static inline
-void PushLexer(inspect_parser *Parser, inspect_lexer *Lexer)
+void PushLexer(inspect_parser *Parser, inspect_lexer *Lexer, lex_worker *Worker)
 {
     ++Parser->LexerStack.Top;
     assert(Parser->LexerStack.Top < lexer_stack::Max);
     
-    Parser->LexerStack.Lexers[Parser->LexerStack.Top] = { Parser->At, Parser->Lexer };
+    Parser->LexerStack.Lexers[Parser->LexerStack.Top] = { Parser->At, Parser->Lexer, Parser->Worker };
     Parser->Lexer = Lexer;
+    Parser->Worker = Worker;
 }
 
 static inline
@@ -72,7 +75,7 @@ std::string GetFullTypeNameForPointer(type *Type)
         else
         {
             Result.insert(0, " ");
-            Result.insert(0, Current->TypeName.Token.Text, Current->TypeName.Token.Length);
+            Result.insert(0, TokenText(&Current->TypeName), Current->TypeName.Length);
             break;
         }
         
@@ -85,34 +88,34 @@ std::string GetFullTypeNameForPointer(type *Type)
 static
 inspect_data_item NewTypeItem(type *Type)
 {
-    inspect_data_item TypeItem = NewDictItem();
+    inspect_data_item TypeItem = NewShapedDictItem(Shape_Type);
     inspect_dict &TypeDict = *TypeItem.Dict;
     
     if (Type->IsPointer || Type->IsReference)
     {
-        Insert(&TypeDict, "Name", NewStringItem(GetFullTypeNameForPointer(Type).c_str()));
+        SetSlot(&TypeDict, TypeSlot_Name, NewStringItem(GetFullTypeNameForPointer(Type).c_str()));
     }
     else
     {
-        Insert(&TypeDict, "Name", NewStringItem(&Type->TypeName));
+        SetSlot(&TypeDict, TypeSlot_Name, NewStringView(&Type->TypeName));
     }
     
-    Insert(&TypeDict, "IsPointer", NewBoolItem(Type->IsPointer));
-    Insert(&TypeDict, "IsReference", NewBoolItem(Type->IsReference));
+    SetSlot(&TypeDict, TypeSlot_IsPointer, NewBoolItem(Type->IsPointer));
+    SetSlot(&TypeDict, TypeSlot_IsReference, NewBoolItem(Type->IsReference));
     
     if (Type->InnerType)
     {
-        Insert(&TypeDict, "HasInnerType", NewBoolItem(true));
-        Insert(&TypeDict, "InnerType", NewTypeItem(Type->InnerType));
+        SetSlot(&TypeDict, TypeSlot_HasInnerType, NewBoolItem(true));
+        SetSlot(&TypeDict, TypeSlot_InnerType, NewTypeItem(Type->InnerType));
     }
     else
     {
-        Insert(&TypeDict, "HasInnerType", NewBoolItem(false));
+        SetSlot(&TypeDict, TypeSlot_HasInnerType, NewBoolItem(false));
     }
     
-    Insert(&TypeDict, "Args", NewTypeArgsItem(&Type->Args));
+    SetSlot(&TypeDict, TypeSlot_Args, NewTypeArgsItem(&Type->Args));
     
-    TypeItem.OptionalSourceToken = Type->TypeName;
+    TypeDict.SourceToken = Type->TypeName;
     
     return TypeItem;
 }
@@ -120,11 +123,11 @@ inspect_data_item NewTypeItem(type *Type)
 static inline
 inspect_data_item CreateTypedArgumentItem(typed_argument_declaration *Item)
 {
-    inspect_data_item ArgumentItem = NewDictItem();
+    inspect_data_item ArgumentItem = NewShapedDictItem(Shape_TypedArgument);
     inspect_dict *Dict = ArgumentItem.Dict;
     
-    Insert(Dict, "Name", NewStringItem(&Item->Name));
-    Insert(Dict, "Type", NewTypeItem(&Item->Type));
+    SetSlot(Dict, TypedArgumentSlot_Name, NewStringView(&Item->Name));
+    SetSlot(Dict, TypedArgumentSlot_Type, NewTypeItem(&Item->Type));
     
     return ArgumentItem;
 }
@@ -146,29 +149,31 @@ inspect_data_item CreateTypedArgumentListItem(typed_argument_list_declaration *L
 static inline
 inspect_data_item CreateFieldItem(field *Field)
 {
-    inspect_data_item FieldItem = NewDictItem();
+    inspect_data_item FieldItem = NewShapedDictItem(Shape_Field);
     inspect_dict &FieldDict = *FieldItem.Dict;
     
-    Insert(&FieldDict, "Type", NewTypeItem(&Field->Type));
-    Insert(&FieldDict, "Name", NewStringItem(&Field->Name));
-    Insert(&FieldDict, "HasInitializer", NewBoolItem(Field->HasInitializer));
+    SetSlot(&FieldDict, FieldSlot_Type, NewTypeItem(&Field->Type));
+    SetSlot(&FieldDict, FieldSlot_Name, NewStringView(&Field->Name));
+    SetSlot(&FieldDict, FieldSlot_HasInitializer, NewBoolItem(Field->HasInitializer));
     
     if (Field->HasInitializer)
     {
-        Insert(&FieldDict, "Initializer", NewStringItem(&Field->InitializerText));
+        SetSlot(&FieldDict, FieldSlot_Initializer, NewStringView(&Field->InitializerText));
     }
     else
     {
-        Insert(&FieldDict, "Initializer", NewStringItem(""));
+        // Empty, any text that lives as long as the field will do.
+        SetSlot(&FieldDict, FieldSlot_Initializer, NewStringView(TokenText(&Field->Name), 0));
     }
     
-    Insert(&FieldDict, "IsMethod", NewBoolItem(Field->IsMethod));
+    SetSlot(&FieldDict, FieldSlot_IsMethod, NewBoolItem(Field->IsMethod));
     if (Field->IsMethod)
     {
-        Insert(&FieldDict, "MethodArguments", CreateTypedArgumentListItem(&Field->Arguments));
+        SetSlot(&FieldDict, FieldSlot_MethodArguments, CreateTypedArgumentListItem(&Field->Arguments));
     }
     
-    FieldItem.Attributes = Field->Attributes;
+    FieldDict.Attributes = Field->Attributes;
+    FieldDict.SourceToken = Field->Name;
     
     return FieldItem;
 }
@@ -179,13 +184,13 @@ inspect_data_item CreateTypeInfoItemInternal(inspect_data_item Name,
                                              inspect_data_item Descriptor,
                                              attribute_list *Attributes)
 {
-    inspect_data_item TypeInfoItem = NewDictItem();
+    inspect_data_item TypeInfoItem = NewShapedDictItem(Shape_TypeInfo);
     inspect_dict &TypeDict = *TypeInfoItem.Dict;
     
-    Insert(&TypeDict, "Name", &Name);
-    Insert(&TypeDict, "Descriptor", &Descriptor);
-    Insert(&TypeDict, "CamelCase", &CamelCase);
-    TypeInfoItem.Attributes = Attributes;
+    SetSlot(&TypeDict, TypeInfoSlot_Name, &Name);
+    SetSlot(&TypeDict, TypeInfoSlot_Descriptor, &Descriptor);
+    SetSlot(&TypeDict, TypeInfoSlot_CamelCase, &CamelCase);
+    TypeDict.Attributes = Attributes;
     
     return TypeInfoItem;
 }
@@ -254,7 +259,7 @@ char *NameToCamelCase(const char *String)
 static inline
 char *NameToCamelCase(itoken_info *Token)
 {
-    return NameToCamelCase(Token->Token.Text, Token->Token.Length);
+    return NameToCamelCase(TokenText(Token), Token->Length);
 }
 
 static
@@ -262,14 +267,14 @@ inspect_data_item CreateStructItem(defined_struct *Struct,
                                    inspect_dict *TypeInfo,
                                    attribute_list *Attributes)
 {
-    inspect_data_item StructDictItem = NewDictItem();
+    inspect_data_item StructDictItem = NewShapedDictItem(Shape_Struct);
     inspect_dict &StructDict = *StructDictItem.Dict;
     
-    Insert(&StructDict, "Name", NewStringItem(&Struct->Identifier));
+    SetSlot(&StructDict, StructSlot_Name, NewStringView(&Struct->Identifier));
     
     inspect_data_item FieldListItem = NewListItem();
     inspect_list &FieldList = *FieldListItem.List;
-    Insert(&StructDict, "Fields", &FieldListItem);
+    SetSlot(&StructDict, StructSlot_Fields, &FieldListItem);
     
     for (field &Field : Struct->Fields)
     {
@@ -277,11 +282,12 @@ inspect_data_item CreateStructItem(defined_struct *Struct,
     }
     
     inspect_data_item FieldCountItem = NewIntItem((int)FieldList.size());
-    Insert(&StructDict, "FieldCount", &FieldCountItem);
+    SetSlot(&StructDict, StructSlot_FieldCount, &FieldCountItem);
     
-    Insert(&StructDict, "TypeInfo", CreateReference(TypeInfo));
+    SetSlot(&StructDict, StructSlot_TypeInfo, CreateReference(TypeInfo));
     
-    StructDictItem.Attributes = Attributes;
+    StructDict.Attributes = Attributes;
+    StructDict.SourceToken = Struct->Identifier;
     
     return StructDictItem;
 }
@@ -289,9 +295,9 @@ inspect_data_item CreateStructItem(defined_struct *Struct,
 inline
 inspect_data_item CreateTypeInfoItem(declared_type *Info, attribute_list *Attributes)
 {
-    return CreateTypeInfoItemInternal(NewStringItem(&Info->TypeName),
+    return CreateTypeInfoItemInternal(NewStringView(&Info->TypeName),
                                       ReceiveStringItem(NameToCamelCase(&Info->TypeName)),
-                                      NewStringItem(&Info->DescriptorName),
+                                      NewStringView(&Info->DescriptorName),
                                       Attributes);
 }
 
@@ -313,7 +319,7 @@ inspect_data_item CreateTypeInfoItem(inspect_data_item Name,
     char *CamelCase;
     if (Name.Type == Type_String)
     {
-        CamelCase = NameToCamelCase(Name.String);
+        CamelCase = NameToCamelCase(Name.String, Name.StringLength);
     }
     else
     {
@@ -333,7 +339,7 @@ inspect_data_item CreateTypeInfoItem(inspect_data_item Name,
 inline
 inspect_data_item CreateTypeInfoItem(defined_struct *Struct, attribute_list *Attributes)
 {
-    return CreateTypeInfoItem(NewStringItem(&Struct->Identifier),
+    return CreateTypeInfoItem(NewStringView(&Struct->Identifier),
                               Attributes);
 }
 
@@ -343,67 +349,68 @@ bool ReceiveNextToken(inspect_parser *Parser)
     Parser->Stack.Top++;
     if (Parser->Stack.Top < Parser->Stack.Populated)
     {
-        Parser->At = Parser->Stack.Tokens[Parser->Stack.Top];
+        Parser->At = TokenAt(&Parser->Stack, Parser->Stack.Top);
         return true;
     }
     
-    if (Parser->Stack.Top > Parser->Stack.Capacity)
+    if (Parser->Stack.Top == Parser->Stack.Capacity)
     {
-        Resize(&Parser->Stack);
+        Grow(&Parser->Stack);
     }
     
-    Parser->At.Token = NextToken(Parser->Lexer);
-    Parser->At.Line = Parser->Lexer->Line;
-    Parser->At.Column = Parser->Lexer->Column;
-    Parser->At.Filename = Parser->Lexer->Filename;
+    if (Parser->Worker)
+    {
+        Parser->At = NextToken(Parser->Worker);
+    }
+    else
+    {
+        Parser->At = NextToken(Parser->Lexer);
+    }
     
-    Parser->Stack.Tokens[Parser->Stack.Top] = Parser->At;
+    TokenAt(&Parser->Stack, Parser->Stack.Top) = Parser->At;
     ++Parser->Stack.Populated;
     
-    if (Parser->At.Token.Type == ITokenType_IncompleteString)
+    if (Parser->At.Type == ITokenType_IncompleteString)
     {
-        PrintLocation(Parser->At.Line, Parser->At.Column, Parser->Lexer->Filename);
-        printf("Incomplete string. (Are you missing a closing quote?)");
+        PrintLocation(&Parser->At);
+        PrintError("Incomplete string. (Are you missing a closing quote?)");
         return false;
     }
     
     return true;
 }
 
-static
-void MoveBack(inspect_parser *Parser)
-{
-    Parser->Stack.Top--;
-    Parser->At = Parser->Stack.Tokens[Parser->Stack.Top];
-}
-
-static
-void MoveTo(inspect_parser *Parser, int Location)
+// Forgets the tokens of the declarations parsed so far, the next token is lexed
+// into the start of the stack.
+static inline
+void ReleaseTokens(inspect_parser *Parser)
 {
-    Parser->Stack.Top = Location;
-    Parser->At = Parser->Stack.Tokens[Location];
+    if (!Parser->RetainTokens)
+    {
+        ResetTokenStack(&Parser->Stack);
+    }
 }
 
 static inline
 bool CheckAt(inspect_parser *Parser, inspect_token_type Expected)
 {
-    return Parser->At.Token.Type == Expected;
+    return Parser->At.Type == Expected;
 }
 
 static inline
 bool CheckNext(inspect_parser *Parser, inspect_token_type Expected)
 {
-    return ReceiveNextToken(Parser) && Parser->At.Token.Type == Expected;
+    return ReceiveNextToken(Parser) && Parser->At.Type == Expected;
 }
 
 static inline
 bool ExpectAt(inspect_parser *Parser, inspect_token_type Expected, const char *ExpectedString)
 {
-    if (Parser->At.Token.Type != Expected)
+    if (Parser->At.Type != Expected)
     {
-        PrintLocation(Parser->At.Line, Parser->At.Column, Parser->Lexer->Filename);
-        printf("Expected: \"%s\", Found: \"%.*s\"\n",
-               ExpectedString, (int)Parser->At.Token.Length, Parser->At.Token.Text);
+        PrintLocation(&Parser->At);
+        PrintError("Expected: \"%s\", Found: \"%.*s\"\n",
+                   ExpectedString, (int)Parser->At.Length, TokenText(&Parser->At));
         
         return false;
     }
@@ -422,238 +429,112 @@ bool ExpectNext(inspect_parser *Parser, inspect_token_type Expected, const char
     return ExpectAt(Parser, Expected, ExpectedString);
 }
 
-static bool TryParseType(inspect_parser *Parser, type *Result);
-
-static
-bool TryParseTypeArgs(inspect_parser *Parser, type_args *Result)
-{
-    if (!CheckAt(Parser, ITokenType_LeftAngle))
-    {
-        return false;
-    }
-    
-    ReceiveNextToken(Parser);
-    itoken_info ArgToken = Parser->At;
-    while (ArgToken.Token.Type != ITokenType_RightAngle)
-    {
-        // TODO(Brian): Ewww, if we get our own list type for codegen,
-        // we should have it return the element inserted.
-        Result->Args.emplace_back();
-        type &Argument = Result->Args.back();
-        
-        if (!TryParseType(Parser, &Argument))
-        {
-            Result->Args.pop_back();
-            PrintLocation(ArgToken.Line, ArgToken.Column, ArgToken.Filename);
-            printf("Unable to parse type\n");
-            return false;
-        }
-        
-        ArgToken = Parser->At;
-    }
-    
-    // NOTE(Brian): All succesful Try* calls should leave the parser at the next token.
-    // The above loop will not do that itself, so we need to manually do that here.
-    ReceiveNextToken(Parser);
-    
-    return true;
-}
-
-static bool
-FailAtBarrier(inspect_parser *Parser,
-              int Barrier,
-              const char *Message)
-{
-    if (Parser->Stack.Top == Barrier)
-    {
-        PrintLocation(Parser->At.Line, Parser->At.Column, Parser->At.Filename);
-        puts(Message);
-        return true;
-    }
-    
-    return false;
-}
-
 static void
 PrintUnexpectedToken(itoken_info *Token)
 {
-    PrintLocation(Token->Line, Token->Column, Token->Filename);
-    printf("Unexpected token \"%.*s\"\n",
-           (int)Token->Token.Length,
-           Token->Token.Text);
+    PrintLocation(Token);
+    PrintError("Unexpected token \"%.*s\"\n",
+               (int)Token->Length,
+               TokenText(Token));
 }
 
-static bool
-FailAtBarrierWithUnexpectedToken(inspect_parser *Parser,
-                                 int Barrier)
+static inline
+void InitializeType(type *Type)
 {
-    if (Parser->Stack.Top == Barrier)
-    {
-        PrintUnexpectedToken(&Parser->At);
-        return true;
-    }
-    
-    return false;
+    Type->IsPointer = false;
+    Type->IsReference = false;
+    Type->InnerType = nullptr;
+    Type->Args.Args.clear();
 }
 
-static
-bool TryParseTypeReverse(inspect_parser *Parser,
-                         type *Result,
-                         int Barrier);
+static bool TryParseType(inspect_parser *Parser, type *Result);
+static void FreeType(type *Type);
 
 static
-bool TryParseTypeArgsReverse(inspect_parser *Parser,
-                             type_args *Result,
-                             int Barrier)
+bool TryParseTypeArgs(inspect_parser *Parser, type_args *Result)
 {
-    if (!CheckAt(Parser, ITokenType_RightAngle))
+    if (!CheckAt(Parser, ITokenType_LeftAngle))
     {
         return false;
     }
     
     do
     {
-        MoveBack(Parser);
-        if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
-        {
-            return false;
-        }
-        
-        Result->Args.emplace_back();
-        type &Argument = Result->Args.back();
-        if (!TryParseTypeReverse(Parser, &Argument, Barrier))
-        {
-            return false;
-        }
-        
-        if (!CheckAt(Parser, ITokenType_Comma) &&
-            !CheckAt(Parser, ITokenType_LeftAngle))
+        if (!ReceiveNextToken(Parser))
         {
-            PrintUnexpectedToken(&Parser->At);
             return false;
         }
-    }
-    while (!CheckAt(Parser, ITokenType_LeftAngle));
-    
-    std::reverse(Result->Args.begin(), Result->Args.end());
-    MoveBack(Parser);
-    return true;
-}
-
-static inline
-void InitializeType(type *Type)
-{
-    Type->IsPointer = false;
-    Type->IsReference = false;
-    Type->InnerType = nullptr;
-}
-
-static
-bool TryParseTypeReverse(inspect_parser *Parser,
-                         type *Result,
-                         int Barrier)
-{
-    InitializeType(Result);
-    
-    if (CheckAt(Parser, ITokenType_Asterisk))
-    {
-        Result->IsPointer = true;
         
-        MoveBack(Parser);
-        if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
+        if (!ExpectAt(Parser, ITokenType_Identifier, "Identifier"))
         {
             return false;
         }
         
-        Result->InnerType = new type;
-        return TryParseTypeReverse(Parser, Result->InnerType, Barrier);
-    }
-    else if (CheckAt(Parser, ITokenType_Ampersand))
-    {
-        Result->IsReference = true;
+        // TODO(Brian): Ewww, if we get our own list type for codegen,
+        // we should have it return the element inserted.
+        Result->Args.emplace_back();
+        type &Argument = Result->Args.back();
         
-        MoveBack(Parser);
-        if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
+        if (!TryParseType(Parser, &Argument))
         {
             return false;
         }
-        
-        Result->InnerType = new type;
-        return TryParseTypeReverse(Parser, Result->InnerType, Barrier);
     }
-    
-    if (CheckAt(Parser, ITokenType_RightAngle))
-    {
-        if (!TryParseTypeArgsReverse(Parser, &Result->Args, Barrier))
-        {
-            return false;
-        }
+    while (CheckAt(Parser, ITokenType_Comma));
         
-        if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
-        {
-            return false;
-        }
-    }
-    
-    if (!ExpectAt(Parser, ITokenType_Identifier, "Identifier"))
+    if (!ExpectAt(Parser, ITokenType_RightAngle, ">"))
     {
         return false;
     }
     
-    Result->TypeName = Parser->At;
-    
-    
-    
-    MoveBack(Parser);
-    return true;
+    // NOTE(Brian): All succesful Try* calls should leave the parser at the next token.
+    return ReceiveNextToken(Parser);
 }
 
 static
 bool TryParseType(inspect_parser *Parser, type *Result)
 {
-    type Temporary;
-    InitializeType(&Temporary);
-    
     if (!CheckAt(Parser, ITokenType_Identifier))
     {
         return false;
     }
-    Temporary.TypeName = Parser->At;
+        
+    InitializeType(Result);
+    Result->TypeName = Parser->At;
     
+    if (!ReceiveNextToken(Parser))
+    {
+        return false;
+    }
+        
     // Type arguments are optional, so we should check first if there is a '<'
-    if (CheckNext(Parser, ITokenType_LeftAngle))
+    if (CheckAt(Parser, ITokenType_LeftAngle))
     {
-        if (!TryParseTypeArgs(Parser, &Temporary.Args))
+        if (!TryParseTypeArgs(Parser, &Result->Args))
         {
             return false;
         }
     }
     
-    // Pointer and reference handling.
-    for (;;)
+    // Pointer and reference handling, each one wraps everything before it.
+    // The wrapper keeps the name token so it still has a source location.
+    while (CheckAt(Parser, ITokenType_Asterisk) ||
+           CheckAt(Parser, ITokenType_Ampersand))
     {
-        if (CheckAt(Parser, ITokenType_Asterisk))
-        {
-            type *NewInner = new type;
-            *NewInner = Temporary;
-            
-            Temporary.InnerType = NewInner;
-            Temporary.IsPointer = true;
-            Temporary.IsReference = false;
-        }
-        else if (CheckAt(Parser, ITokenType_Ampersand))
+        type *NewInner = new type;
+        *NewInner = *Result;
+    
+        Result->Args.Args.clear();
+        Result->InnerType = NewInner;
+        Result->IsPointer = CheckAt(Parser, ITokenType_Asterisk);
+        Result->IsReference = CheckAt(Parser, ITokenType_Ampersand);
+    
+        if (!ReceiveNextToken(Parser))
         {
-            type *NewInner = new type;
-            *NewInner = Temporary;
-            
-            Temporary.InnerType = NewInner;
-            Temporary.IsPointer = false;
-            Temporary.IsReference = true;
+            return false;
         }
     }
     
-    *Result = Temporary;
-    
     return true;
 }
 
@@ -661,18 +542,18 @@ static inline
 inspect_ctext CreateCText(itoken_info *Begin, itoken_info *End)
 {
     char *BeginPtr;
-    if (Begin->Token.Type == ITokenType_String)
+    if (Begin->Type == ITokenType_String)
     {
         // We start string tokens at the character after the first double-quote.
         // We want to inclue that in CTexts.
-        BeginPtr = Begin->Token.Text - 1;
+        BeginPtr = TokenText(Begin) - 1;
     }
     else
     {
-        BeginPtr = Begin->Token.Text;
+        BeginPtr = TokenText(Begin);
     }
     
-    char *EndPtr = End->Token.Text;
+    char *EndPtr = TokenText(End);
     
     inspect_ctext Result;
     Result.Begin = BeginPtr;
@@ -681,288 +562,437 @@ inspect_ctext CreateCText(itoken_info *Begin, itoken_info *End)
 };
 
 static
-bool TryParseAttributeList(inspect_parser *Parser,
-                           attribute_list **Result,
-                           int Until = INT_MAX);
+bool TryParseAttributeInstance(inspect_parser *Parser,
+                               attribute_instance *Result,
+                               bool *ParsedAttribute);
 
-static
-bool TryParseTypedArgumentListReverse(inspect_parser *Parser,
-                                      typed_argument_list_declaration *Result,
-                                      int Barrier);
+static inline
+void AppendAttribute(attribute_list **List, attribute_instance *Attribute)
+{
+    if (*List == nullptr)
+    {
+        *List = new attribute_list;
+    }
+    
+    (*List)->Attributes.push_back(*Attribute);
+}
 
+static void
+PrintAttributeListFailure(attribute_list *List)
+{
+    if (List)
+    {
+        attribute_instance &First = List->Attributes.front();
+        PrintLocation(&First.IdentifierToken);
+        PrintError("Failed to parse attribute list starting at \"%.*s\"\n",
+                   (int)First.IdentifierToken.Length,
+                   TokenText(&First.IdentifierToken));
+    }
+}
+
+static inline
+bool IsPlainIdentifier(type *Type)
+{
+    return !Type->IsPointer && !Type->IsReference && Type->Args.Args.empty();
+}
+
+// A type that turned out not to be the declared type or name has to be an alias attribute.
 static
-bool TryParseField(inspect_parser *Parser,
-                   field *Result)
+bool AppendAliasAttribute(attribute_list **List, type *Type)
 {
-    // Fields need to be parsed in reverse because if there
-    // is an attribute list as the beginning of the field,
-    // the name of a type and the name of an attribute are indistinguishable.
-    Result->Attributes = nullptr;
+    if (!IsPlainIdentifier(Type))
+    {
+        PrintUnexpectedToken(&Type->TypeName);
+        return false;
+    }
+
+    attribute_instance Alias = {};
+    Alias.InfoHandle = INVALID_ATTRIBUTE_HANDLE;
+    Alias.IdentifierToken = Type->TypeName;
+    Alias.Aliased = true;
+    Alias.Alias = 0;
     
-    int Begin = Parser->Stack.Top;
-    int Before = Begin - 1;
-    int End;
+    AppendAttribute(List, &Alias);
+    return true;
+}
+
+// Parses the "attributes type name" start shared by fields and typed arguments, leaving
+// the parser at the first token that can't continue it. An alias attribute is
+// indistinguishable from a type name, so the last two types seen are held back until the
+// end shows they were the type and the name, they are kept in Pending. Anything before
+// them is an attribute. Fails without printing anything if it runs into the end of the file.
+static
+bool TryParseDeclarationInternal(inspect_parser *Parser,
+                                 attribute_list **Attributes,
+                                 type *Pending,
+                                 type *Type,
+                                 itoken_info *Name)
+{
+    *Attributes = nullptr;
     
-    itoken_info FirstToken = Parser->At;
+    int PendingCount = 0;
     
     for (;;)
     {
-        if (CheckAt(Parser, ITokenType_SemiColon))
+        if (CheckAt(Parser, ITokenType_LeftSquare))
         {
-            break;
+            for (int I = 0; I < PendingCount; ++I)
+            {
+                if (!AppendAliasAttribute(Attributes, &Pending[I]))
+                {
+                    return false;
+                }
+            }
+            
+            PendingCount = 0;
+            
+            attribute_instance Attribute;
+            bool ParsedAttribute;
+            if (!TryParseAttributeInstance(Parser, &Attribute, &ParsedAttribute))
+            {
+                PrintAttributeListFailure(*Attributes);
+                return false;
+            }
+            
+            AppendAttribute(Attributes, &Attribute);
+            
+            if (!ReceiveNextToken(Parser))
+            {
+                return false;
+            }
+        }
+        else if (CheckAt(Parser, ITokenType_Identifier))
+        {
+            if (PendingCount == 2)
+            {
+                if (!AppendAliasAttribute(Attributes, &Pending[0]))
+                {
+                    return false;
+                }
+                
+                Pending[0] = Pending[1];
+                PendingCount = 1;
+            }
+            
+            if (!TryParseType(Parser, &Pending[PendingCount]))
+            {
+                return false;
+            }
+            
+            ++PendingCount;
         }
-        else if (CheckAt(Parser, ITokenType_Equals))
+        else
         {
             break;
         }
-        
+    }
+    
+    if (PendingCount < 2)
+    {
         if (CheckAt(Parser, ITokenType_End))
         {
-            PrintLocation(FirstToken.Line, FirstToken.Column, FirstToken.Filename);
-            printf("Found EOF while parsing field.\n");
             return false;
         }
         
-        if (!ReceiveNextToken(Parser))
+        if (PendingCount == 1)
         {
-            return false;
+            itoken_info &Identifier = Pending[0].TypeName;
+            PrintLocation(&Identifier);
+            PrintError("Unexpected Identifier.\n");
         }
-    }
-    
-    End = Parser->Stack.Top;
-    
-    if (FailAtBarrier(Parser, Before, "Unexpected \";\"\n"))
-    {
-        return false;
-    }
-    
-    itoken_info Current = Parser->At;
-    MoveBack(Parser);
-    
-    if (CheckAt(Parser, ITokenType_RightParen))
-    {
-        if (!TryParseTypedArgumentListReverse(Parser, &Result->Arguments, Before))
+        else
         {
-            return false;
+            PrintUnexpectedToken(&Parser->At);
         }
         
-        Result->IsMethod = true;
-    }
-    else
-    {
-        Result->IsMethod = false;
+        return false;
     }
     
-    if (FailAtBarrier(Parser, Before, "Unexpected \";\"\n"))
+    if (!IsPlainIdentifier(&Pending[1]))
     {
+        PrintUnexpectedToken(&Pending[1].TypeName);
         return false;
     }
     
-    if (!ExpectAt(Parser, ITokenType_Identifier, "Identifier"))
+    if (*Attributes)
     {
-        return false;
+        Parser->UnresolvedAttributeLists.push_back(*Attributes);
     }
     
-    itoken_info Identifier = Parser->At;
-    MoveBack(Parser);
-    
-    if (FailAtBarrier(Parser, Before, "Unexpected Identifier.\n"))
+    *Type = Pending[0];
+    *Name = Pending[1].TypeName;
+    return true;
+}
+
+static
+bool TryParseDeclaration(inspect_parser *Parser,
+                         attribute_list **Attributes,
+                         type *Type,
+                         itoken_info *Name)
+{
+    type Pending[2] = {};
+    if (TryParseDeclarationInternal(Parser, Attributes, Pending, Type, Name))
     {
-        return false;
+        return true;
     }
     
-    Result->Name = Identifier;
+    // The attribute list only belongs to the parser once the declaration is parsed.
+    delete *Attributes;
+    *Attributes = nullptr;
     
-    if (!TryParseTypeReverse(Parser, &Result->Type, Before))
+    // Neither type was handed out, a pointer or a type argument still belongs to them.
+    // The ones that were never parsed into are empty.
+    FreeType(&Pending[0]);
+    FreeType(&Pending[1]);
+    return false;
+}
+
+static
+bool TryParseTypedArgumentList(inspect_parser *Parser,
+                               typed_argument_list_declaration *Result)
+{
+    if (!CheckAt(Parser, ITokenType_LeftParen))
     {
         return false;
     }
     
-    if (Parser->Stack.Top != Before)
+    if (CheckNext(Parser, ITokenType_RightParen))
     {
-        // There are some potential attributes that we want to parse.
-        int EndOfAttributes = Parser->Stack.Top + 1;
-        MoveTo(Parser, Begin);
-        
-        if (!TryParseAttributeList(Parser, &Result->Attributes, EndOfAttributes))
-        {
-            return false;
-        }
+        return ReceiveNextToken(Parser);
     }
     
-    MoveTo(Parser, End);
-    
-    if (CheckAt(Parser, ITokenType_Equals))
+    for (;;)
     {
-        if (!ReceiveNextToken(Parser))
+        // NOTE: Attributes on arguments are checked but not kept anywhere. Only alias
+        // attributes on the first argument have ever been allowed.
+        typed_argument_declaration Argument;
+        attribute_list *Attributes;
+        if (!TryParseDeclaration(Parser, &Attributes, &Argument.Type, &Argument.Name))
         {
             return false;
         }
         
-        itoken_info BeginInitializer = Parser->At;
-        while (!CheckAt(Parser, ITokenType_SemiColon))
+        bool Allowed = Result->Arguments.empty();
+        for (size_t I = 0; Attributes && Allowed && I < Attributes->Attributes.size(); ++I)
         {
-            if (CheckAt(Parser, ITokenType_End))
+            Allowed = Attributes->Attributes[I].Aliased;
+        }
+        
+        if (Attributes && !Allowed)
+        {
+            attribute_instance &First = Attributes->Attributes.front();
+            PrintLocation(&First.IdentifierToken);
+            PrintError("Attribute list cannot be defined here. First attribute \"%.*s\"\n",
+                       (int)First.IdentifierToken.Length,
+                       TokenText(&First.IdentifierToken));
+            return false;
+        }
+        
+        Result->Arguments.push_back(Argument);
+        
+        if (CheckAt(Parser, ITokenType_RightParen))
+        {
+            break;
+        }
+        
+        if (!CheckAt(Parser, ITokenType_Comma))
+        {
+            if (!CheckAt(Parser, ITokenType_End))
             {
-                PrintLocation(Parser->At.Line, Parser->At.Column, Parser->At.Filename);
-                printf("Unexpted EOF while parsing field initializer\n");
-                return false;
+                PrintUnexpectedToken(&Parser->At);
             }
             
-            if (!ReceiveNextToken(Parser))
-            {
-                return false;
-            }
+            return false;
         }
         
-        Result->HasInitializer = true;
-        Result->InitializerText = CreateCText(&BeginInitializer, &Parser->At);
-    }
-    else
-    {
-        Result->HasInitializer = false;
+        if (!ReceiveNextToken(Parser))
+        {
+            return false;
+        }
     }
     
-    // TryParseField doesn't move to the next token.
-    return true;
+    // NOTE: Arguments have always been given to templates last to first, the generated
+    // code depends on that order.
+    std::reverse(Result->Arguments.begin(), Result->Arguments.end());
+    return ReceiveNextToken(Parser);
 }
 
+// NOTE: Fields used to be parsed back to front from the ";" that ends them, and that is
+// what every error in a field says and points at. When parsing one front to back fails,
+// its tokens, which are still on the stack, are walked back to front once more only to
+// report the error the same way. Nothing is built on the way.
+
 static
-char *BuildFilePath(import_file *File, char *CurrentDirectory)
+void MoveBack(inspect_parser *Parser)
 {
-    // + 1 for the added '/'
-    size_t StringLength = strlen(CurrentDirectory) + 1 + File->Filename.Token.Length;
-    
-    // + 1 for the null terminator
-    char *Buffer = (char *)malloc(StringLength + 1);
-    sprintf(Buffer, "%s/%.*s", CurrentDirectory,
-            (int)File->Filename.Token.Length, File->Filename.Token.Text);
-    
-    return Buffer;
+    Parser->Stack.Top--;
+    Parser->At = TokenAt(&Parser->Stack, Parser->Stack.Top);
 }
 
 static
-bool StartParsingImport(inspect_parser *Parser, import_file *File)
+void MoveTo(inspect_parser *Parser, int Location)
 {
-    char *CurrentDirectory = Parser->Lexer->Directory;
-    char *Filepath = BuildFilePath(File, CurrentDirectory);
-    
-    inspect_lexer *NewLexer = new inspect_lexer;
-    if (!CreateLexer(Filepath, NewLexer))
+    Parser->Stack.Top = Location;
+    Parser->At = TokenAt(&Parser->Stack, Location);
+}
+
+static bool
+FailAtBarrier(inspect_parser *Parser,
+              int Barrier,
+              const char *Message)
+{
+    if (Parser->Stack.Top == Barrier)
     {
-        PrintLocation(File->Filename.Line, File->Filename.Column,
-                      Parser->Lexer->Filename);
-        printf("Unable to open file \"%.*s\"\n",
-               (int)File->Filename.Token.Length, File->Filename.Token.Text);
-        return false;
+        PrintLocation(&Parser->At);
+        PrintError("%s\n", Message);
+        return true;
     }
     
-    Parser->LexerStorage.push_back(NewLexer);
-    PushLexer(Parser, NewLexer);
-    return true;
+    return false;
 }
 
-static
-bool ReturnFromFile(inspect_parser *Parser)
+static bool
+FailAtBarrierWithUnexpectedToken(inspect_parser *Parser,
+                                 int Barrier)
 {
-    lex_state State;
-    if (!PopLexer(&Parser->LexerStack, &State))
+    if (Parser->Stack.Top == Barrier)
     {
-        return false;
+        PrintUnexpectedToken(&Parser->At);
+        return true;
     }
     
-    Parser->Lexer = State.Lexer;
-    Parser->At = State.At;
-    return true;
+    return false;
 }
 
 static
-bool TryParseImport(inspect_parser *Parser, import_file *File)
+bool CheckTypeReverse(inspect_parser *Parser,
+                      int Barrier);
+
+static
+bool CheckTypeArgsReverse(inspect_parser *Parser,
+                          int Barrier)
 {
-    if (!CheckAt(Parser, ITokenType_Import))
-    {
-        return false;
-    }
-    
-    if (!ExpectNext(Parser, ITokenType_String, "string"))
+    if (!CheckAt(Parser, ITokenType_RightAngle))
     {
         return false;
     }
     
-    File->Filename = Parser->At;
-    
-    if (!ExpectNext(Parser, ITokenType_SemiColon, ";"))
+    do
     {
-        return false;
+        MoveBack(Parser);
+        if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
+        {
+            return false;
+        }
+        
+        if (!CheckTypeReverse(Parser, Barrier))
+        {
+            return false;
+        }
+        
+        if (!CheckAt(Parser, ITokenType_Comma) &&
+            !CheckAt(Parser, ITokenType_LeftAngle))
+        {
+            PrintUnexpectedToken(&Parser->At);
+            return false;
+        }
     }
+    while (!CheckAt(Parser, ITokenType_LeftAngle));
     
+    MoveBack(Parser);
     return true;
 }
 
 static
-bool TryParseDeclareType(inspect_parser *Parser, declared_type *Info)
+bool CheckTypeReverse(inspect_parser *Parser,
+                      int Barrier)
 {
-    if (!CheckAt(Parser, ITokenType_DeclareType))
+    if (CheckAt(Parser, ITokenType_Asterisk) ||
+        CheckAt(Parser, ITokenType_Ampersand))
     {
-        return false;
+        MoveBack(Parser);
+        if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
+        {
+            return false;
+        }
+        
+        return CheckTypeReverse(Parser, Barrier);
     }
     
-    if (!CheckNext(Parser, ITokenType_Identifier))
+    if (CheckAt(Parser, ITokenType_RightAngle))
     {
-        printf("%s:%i:%i: Expected identifier after \"declare_type\"",
-               Parser->Lexer->Filename, Parser->Lexer->Line, Parser->Lexer->Column);
-        return false;
+        if (!CheckTypeArgsReverse(Parser, Barrier))
+        {
+            return false;
+        }
+        
+        if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
+        {
+            return false;
+        }
     }
     
-    Info->TypeName = Parser->At;
-    
-    if (!CheckNext(Parser, ITokenType_Identifier))
+    if (!ExpectAt(Parser, ITokenType_Identifier, "Identifier"))
     {
-        printf("%s:%i:%i: Expected identifier after type name.",
-               Parser->Lexer->Filename, Parser->Lexer->Line, Parser->Lexer->Column);
         return false;
     }
     
-    Info->DescriptorName = Parser->At;
+    MoveBack(Parser);
+    return true;
+}
+
+// Parses the attributes from the parser's token up to the one at Until.
+static
+bool CheckAttributeList(inspect_parser *Parser, int Until)
+{
+    attribute_list *Attributes = nullptr;
+    bool Checked = true;
     
-    if (!ExpectNext(Parser, ITokenType_SemiColon, ";"))
+    while (Checked && Parser->Stack.Top < Until)
     {
-        return false;
+        attribute_instance Attribute = {};
+        bool ParsedAttribute;
+        if (!TryParseAttributeInstance(Parser, &Attribute, &ParsedAttribute))
+        {
+            PrintAttributeListFailure(Attributes);
+            Checked = false;
+        }
+        else if (!ParsedAttribute)
+        {
+            break;
+        }
+        else
+        {
+            AppendAttribute(&Attributes, &Attribute);
+            Checked = ReceiveNextToken(Parser);
+        }
     }
     
-    return true;
+    delete Attributes;
+    return Checked;
 }
 
 static
-bool TryParseTypedArgumentReverse(inspect_parser *Parser,
-                                  typed_argument_declaration *Result,
-                                  int Barrier)
+bool CheckTypedArgumentReverse(inspect_parser *Parser,
+                               int Barrier)
 {
     if (!CheckAt(Parser, ITokenType_Identifier))
     {
         return false;
     }
     
-    Result->Name = Parser->At;
-    
     MoveBack(Parser);
     if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
     {
         return false;
     }
     
-    if (!TryParseTypeReverse(Parser, &Result->Type, Barrier))
-    {
-        return false;
-    }
-    
-    return true;
+    return CheckTypeReverse(Parser, Barrier);
 }
 
 static
-bool TryParseTypedArgumentListReverse(inspect_parser *Parser,
-                                      typed_argument_list_declaration *Result,
-                                      int Barrier)
+bool CheckTypedArgumentListReverse(inspect_parser *Parser,
+                                   int Barrier)
 {
     if (!CheckAt(Parser, ITokenType_RightParen))
     {
@@ -983,14 +1013,11 @@ bool TryParseTypedArgumentListReverse(inspect_parser *Parser,
     
     do
     {
-        typed_argument_declaration Argument;
-        if (!TryParseTypedArgumentReverse(Parser, &Argument, Barrier))
+        if (!CheckTypedArgumentReverse(Parser, Barrier))
         {
             return false;
         }
         
-        Result->Arguments.push_back(Argument);
-        
         if (CheckAt(Parser, ITokenType_Comma))
         {
             MoveBack(Parser);
@@ -999,16 +1026,19 @@ bool TryParseTypedArgumentListReverse(inspect_parser *Parser,
                 return false;
             }
         }
-        else if (CheckAt(Parser, ITokenType_LeftParen))
-        {
-            continue;
-        }
-        else
+        else if (!CheckAt(Parser, ITokenType_LeftParen))
         {
             int AttributesEnd = Parser->Stack.Top + 1;
             
             do
             {
+                // NOTE: Walking past the field here is where the old parser crashed,
+                // the error is left to the forward parser.
+                if (Parser->Stack.Top <= Barrier)
+                {
+                    return false;
+                }
+                
                 MoveBack(Parser);
                 if (FailAtBarrierWithUnexpectedToken(Parser, Barrier))
                 {
@@ -1020,13 +1050,8 @@ bool TryParseTypedArgumentListReverse(inspect_parser *Parser,
             
             int BeforeAttributes = Parser->Stack.Top;
             
-            if (!ReceiveNextToken(Parser))
-            {
-                return false;
-            }
-            
-            attribute_list *Attributes;
-            if (!TryParseAttributeList(Parser, &Attributes, AttributesEnd))
+            if (!ReceiveNextToken(Parser) ||
+                !CheckAttributeList(Parser, AttributesEnd))
             {
                 return false;
             }
@@ -1040,125 +1065,1120 @@ bool TryParseTypedArgumentListReverse(inspect_parser *Parser,
     return true;
 }
 
+// Reports what is wrong with the field starting at the token at Begin. Prints nothing
+// for the few fields the old parser took that are errors now.
 static
-bool TryParseArgumentList(inspect_parser *Parser, argument_list *Result)
+void ReportFieldError(inspect_parser *Parser, int Begin)
 {
-    if (!CheckAt(Parser, ITokenType_LeftParen))
-    {
-        return false;
-    }
-    
-    Result->ListBegin = Parser->At;
+    int Before = Begin - 1;
     
-    if (CheckNext(Parser, ITokenType_RightParen))
-    {
-        return ReceiveNextToken(Parser);
-    }
+    MoveTo(Parser, Begin);
+    itoken_info FirstToken = Parser->At;
     
-    while (!CheckAt(Parser, ITokenType_RightParen))
+    while (!CheckAt(Parser, ITokenType_SemiColon) &&
+           !CheckAt(Parser, ITokenType_Equals))
     {
-        argument_item Parameter;
-        Parameter.Named = false;
-        
-        itoken_info Begin = Parser->At;
-        if (!ReceiveNextToken(Parser))
+        if (CheckAt(Parser, ITokenType_End))
         {
-            return false;
+            PrintLocation(&FirstToken);
+            PrintError("Found EOF while parsing field.\n");
+            return;
         }
         
-        // Check if the parameter is named.
-        if (Begin.Token.Type == ITokenType_Identifier)
+        // Already reported when it was lexed.
+        if (CheckAt(Parser, ITokenType_IncompleteString) || !ReceiveNextToken(Parser))
         {
-            if (CheckAt(Parser, ITokenType_Colon))
-            {
-                Parameter.Named = true;
-                Parameter.Name = Begin;
-                
-                if (!ReceiveNextToken(Parser))
-                {
-                    return false;
-                }
-                
-                Begin = Parser->At;
-            }
+            return;
         }
-        
-        while (!CheckAt(Parser, ITokenType_Comma) &&
-               !CheckAt(Parser, ITokenType_RightParen))
-        {
-            if (CheckAt(Parser, ITokenType_End))
-            {
-                PrintLocation(Parser->At.Line, Parser->At.Column, Parser->At.Filename);
-                printf("Unexpected EOF while parsing argument list\n");
-                return false;
-            }
-            
-            if (!ReceiveNextToken(Parser))
-            {
-                return false;
+    }
+    
+    MoveBack(Parser);
+    
+    if (CheckAt(Parser, ITokenType_RightParen) &&
+        !CheckTypedArgumentListReverse(Parser, Before))
+    {
+        return;
+    }
+    
+    if (FailAtBarrier(Parser, Before, "Unexpected \";\"\n") ||
+        !ExpectAt(Parser, ITokenType_Identifier, "Identifier"))
+    {
+        return;
+    }
+    
+    MoveBack(Parser);
+    
+    if (FailAtBarrier(Parser, Before, "Unexpected Identifier.\n") ||
+        !CheckTypeReverse(Parser, Before))
+    {
+        return;
+    }
+    
+    if (Parser->Stack.Top != Before)
+    {
+        int EndOfAttributes = Parser->Stack.Top + 1;
+        MoveTo(Parser, Begin);
+        CheckAttributeList(Parser, EndOfAttributes);
+    }
+}
+
+static
+bool TryParseField(inspect_parser *Parser,
+                   field *Result)
+{
+    itoken_info FirstToken = Parser->At;
+    int Begin = Parser->Stack.Top;
+    
+    // Held back until it is clear whether ReportFieldError has something to say instead.
+    std::string Errors;
+    std::string *PreviousCapture = ErrorCapture;
+    ErrorCapture = &Errors;
+    
+    bool Parsed = TryParseDeclaration(Parser, &Result->Attributes, &Result->Type, &Result->Name);
+    
+    Result->IsMethod = false;
+    if (Parsed && CheckAt(Parser, ITokenType_LeftParen))
+    {
+        Parsed = TryParseTypedArgumentList(Parser, &Result->Arguments);
+        Result->IsMethod = true;
+    }
+    
+    if (Parsed &&
+        !CheckAt(Parser, ITokenType_SemiColon) &&
+        !CheckAt(Parser, ITokenType_Equals))
+    {
+        if (!CheckAt(Parser, ITokenType_End))
+        {
+            PrintUnexpectedToken(&Parser->At);
+        }
+        
+        Parsed = false;
+    }
+    
+    if (!Parsed && CheckAt(Parser, ITokenType_End))
+    {
+        PrintLocation(&FirstToken);
+        PrintError("Found EOF while parsing field.\n");
+    }
+    
+    if (!Parsed)
+    {
+        std::string ForwardErrors;
+        ForwardErrors.swap(Errors);
+        ReportFieldError(Parser, Begin);
+        
+        ErrorCapture = PreviousCapture;
+        PrintError("%s", Errors.empty() ? ForwardErrors.c_str() : Errors.c_str());
+        return false;
+    }
+    
+    ErrorCapture = PreviousCapture;
+    
+    if (CheckAt(Parser, ITokenType_Equals))
+    {
+        if (!ReceiveNextToken(Parser))
+        {
+            return false;
+        }
+        
+        itoken_info BeginInitializer = Parser->At;
+        while (!CheckAt(Parser, ITokenType_SemiColon))
+        {
+            if (CheckAt(Parser, ITokenType_End))
+            {
+                PrintLocation(&Parser->At);
+                PrintError("Unexpted EOF while parsing field initializer\n");
+                return false;
+            }
+            
+            if (!ReceiveNextToken(Parser))
+            {
+                return false;
+            }
+        }
+        
+        Result->HasInitializer = true;
+        Result->InitializerText = CreateCText(&BeginInitializer, &Parser->At);
+    }
+    else
+    {
+        Result->HasInitializer = false;
+    }
+    
+    // TryParseField doesn't move to the next token.
+    return true;
+}
+
+static
+char *BuildFilePath(import_file *File, char *CurrentDirectory)
+{
+    // Imports of a file that has no directory are relative to the working directory,
+    // not the root.
+    if (!CurrentDirectory[0])
+    {
+        size_t Length = File->Filename.Length;
+        char *Buffer = (char *)malloc(Length + 1);
+        memcpy(Buffer, TokenText(&File->Filename), Length);
+        Buffer[Length] = '\0';
+        NormalizePath(Buffer);
+        return Buffer;
+    }
+    
+    // + 1 for the added '/'
+    size_t StringLength = strlen(CurrentDirectory) + 1 + File->Filename.Length;
+    
+    // + 1 for the null terminator
+    char *Buffer = (char *)malloc(StringLength + 1);
+    sprintf(Buffer, "%s/%.*s", CurrentDirectory,
+            (int)File->Filename.Length, TokenText(&File->Filename));
+    
+    // The same file imported as "a/../b.ins" and "b.ins" has to be found as parsed.
+    NormalizePath(Buffer);
+    return Buffer;
+}
+
+static void
+PrintOpenFailure(import_file *File)
+{
+    PrintLocation(&File->Filename);
+    PrintError("Unable to open file \"%.*s\"\n",
+               (int)File->Filename.Length, TokenText(&File->Filename));
+}
+
+static inline
+imported_declaration &RecordDeclaration(inspect_parser *Parser, imported_declaration_kind Kind)
+{
+    Parser->Task->Declarations.emplace_back();
+    imported_declaration &Declaration = Parser->Task->Declarations.back();
+    Declaration.Kind = Kind;
+    Declaration.AttributeListsEnd = Parser->UnresolvedAttributeLists.size();
+    return Declaration;
+}
+
+static import_task *WaitForImport(import_pool *Pool, const char *Path);
+static bool MergeImport(inspect_parser *Parser, import_task *Task);
+static bool TryLoadModule(inspect_parser *Parser, const char *Filepath, bool *Added);
+
+// Takes ownership of Filepath.
+static
+bool OpenImport(inspect_parser *Parser, import_file *File, char *Filepath)
+{
+    if (!Parser->ParsedFiles.insert(Filepath).second)
+    {
+        // Already parsed through another import, everything it declares is known. A lexer
+        // thread that looked ahead at it has nothing left to do.
+        if (Parser->Pipeline)
+        {
+            StopLexWorker(Parser->Pipeline, Filepath);
+        }
+        
+        free(Filepath);
+        return true;
+    }
+    
+    bool Added;
+    if (!Parser->Reader && TryLoadModule(Parser, Filepath, &Added))
+    {
+        if (Parser->Pipeline)
+        {
+            StopLexWorker(Parser->Pipeline, Filepath);
+        }
+        
+        free(Filepath);
+        return Added;
+    }
+    
+    if (Parser->ImportPool)
+    {
+        import_task *Task = WaitForImport(Parser->ImportPool, Filepath);
+        free(Filepath);
+        
+        if (!Task->Opened)
+        {
+            PrintOpenFailure(File);
+            return false;
+        }
+        
+        return MergeImport(Parser, Task);
+    }
+    
+    if (Parser->Pipeline)
+    {
+        // Normally the worker was already started when the import was lexed.
+        lex_worker *Worker = StartLexWorker(Parser->Pipeline, Filepath);
+        free(Filepath);
+        
+        if (!WaitForLexWorker(Parser->Pipeline, Worker))
+        {
+            PrintOpenFailure(File);
+            return false;
+        }
+        
+        PushLexer(Parser, &Worker->Lexer, Worker);
+        return true;
+    }
+    
+    inspect_lexer *NewLexer = new inspect_lexer;
+    bool Opened = CreateLexer(Filepath, Parser->Reader, NewLexer);
+    free(Filepath);
+    
+    if (!Opened)
+    {
+        PrintOpenFailure(File);
+        delete NewLexer;
+        return false;
+    }
+    
+    Parser->LexerStorage.push_back(NewLexer);
+    PushLexer(Parser, NewLexer, nullptr);
+    return true;
+}
+
+static
+bool StartParsingImport(inspect_parser *Parser, import_file *File)
+{
+    char *CurrentDirectory = Parser->Lexer->Directory;
+    char *Filepath = BuildFilePath(File, CurrentDirectory);
+    
+    if (Parser->Task)
+    {
+        // Whether the file still has to be parsed is only known once the declarations
+        // before it are merged.
+        imported_declaration &Declaration = RecordDeclaration(Parser, Imported_Import);
+        Declaration.Import = *File;
+        Declaration.ImportPath = Filepath;
+        free(Filepath);
+        return true;
+    }
+    
+    return OpenImport(Parser, File, Filepath);
+}
+
+static
+bool ReturnFromFile(inspect_parser *Parser)
+{
+    lex_state State;
+    if (!PopLexer(&Parser->LexerStack, &State))
+    {
+        return false;
+    }
+    
+    Parser->Lexer = State.Lexer;
+    Parser->Worker = State.Worker;
+    Parser->At = State.At;
+    return true;
+}
+
+static
+bool TryParseImport(inspect_parser *Parser, import_file *File)
+{
+    if (!CheckAt(Parser, ITokenType_Import))
+    {
+        return false;
+    }
+    
+    if (!ExpectNext(Parser, ITokenType_String, "string"))
+    {
+        return false;
+    }
+    
+    File->Filename = Parser->At;
+    
+    if (!ExpectNext(Parser, ITokenType_SemiColon, ";"))
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+static
+bool TryParseDeclareType(inspect_parser *Parser, declared_type *Info)
+{
+    if (!CheckAt(Parser, ITokenType_DeclareType))
+    {
+        return false;
+    }
+    
+    if (!CheckNext(Parser, ITokenType_Identifier))
+    {
+        PrintLocation(&Parser->At);
+        PrintError("Expected identifier after \"declare_type\"");
+        return false;
+    }
+    
+    Info->TypeName = Parser->At;
+    
+    if (!CheckNext(Parser, ITokenType_Identifier))
+    {
+        PrintLocation(&Parser->At);
+        PrintError("Expected identifier after type name.");
+        return false;
+    }
+    
+    Info->DescriptorName = Parser->At;
+    
+    if (!ExpectNext(Parser, ITokenType_SemiColon, ";"))
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+static
+bool TryParseArgumentList(inspect_parser *Parser, argument_list *Result)
+{
+    if (!CheckAt(Parser, ITokenType_LeftParen))
+    {
+        return false;
+    }
+    
+    Result->ListBegin = Parser->At;
+    
+    if (CheckNext(Parser, ITokenType_RightParen))
+    {
+        return ReceiveNextToken(Parser);
+    }
+    
+    while (!CheckAt(Parser, ITokenType_RightParen))
+    {
+        argument_item Parameter;
+        Parameter.Named = false;
+        
+        itoken_info Begin = Parser->At;
+        if (!ReceiveNextToken(Parser))
+        {
+            return false;
+        }
+        
+        // Check if the parameter is named.
+        if (Begin.Type == ITokenType_Identifier)
+        {
+            if (CheckAt(Parser, ITokenType_Colon))
+            {
+                Parameter.Named = true;
+                Parameter.Name = Begin;
+                
+                if (!ReceiveNextToken(Parser))
+                {
+                    return false;
+                }
+                
+                Begin = Parser->At;
+            }
+        }
+        
+        while (!CheckAt(Parser, ITokenType_Comma) &&
+               !CheckAt(Parser, ITokenType_RightParen))
+        {
+            if (CheckAt(Parser, ITokenType_End))
+            {
+                PrintLocation(&Parser->At);
+                PrintError("Unexpected EOF while parsing argument list\n");
+                return false;
+            }
+            
+            if (!ReceiveNextToken(Parser))
+            {
+                return false;
+            }
+        }
+        
+        Parameter.Value = CreateCText(&Begin, &Parser->At);
+        Result->Arguments.push_back(Parameter);
+        
+        itoken_info Last = Parser->At;
+        if (!ReceiveNextToken(Parser))
+        {
+            return false;
+        }
+        
+        if (Last.Type == ITokenType_RightParen)
+        {
+            break;
+        }
+    }
+    
+    return true;
+}
+
+static
+bool TryParseArgumentListDeclaration(inspect_parser *Parser, argument_list_declaration *Result)
+{
+    if (!CheckAt(Parser, ITokenType_LeftParen))
+    {
+        return false;
+    }
+    
+    if (CheckNext(Parser, ITokenType_RightParen))
+    {
+        return true;
+    }
+    
+    for (;;)
+    {
+        if (!ExpectAt(Parser, ITokenType_Identifier, "Identifier"))
+        {
+            return false;
+        }
+        
+        Result->Names.push_back(Parser->At);
+        
+        if (CheckNext(Parser, ITokenType_RightParen))
+        {
+            break;
+        }
+        else if (CheckAt(Parser, ITokenType_Comma))
+        {
+            ReceiveNextToken(Parser);
+        }
+        else if (CheckAt(Parser, ITokenType_End))
+        {
+            PrintLocation(&Parser->At);
+            PrintError("Unexpected EOF while parsing argument list\n");
+            return false;
+        }
+        else
+        {
+            PrintLocation(&Parser->At);
+            PrintError("Unexpected \"%.*s\" while parsing argument list\n",
+                       (int)Parser->At.Length, TokenText(&Parser->At));
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+static
+bool TryParseAttributeInstance(inspect_parser *Parser,
+                               attribute_instance *Result,
+                               bool *ParsedAttribute)
+{
+    *ParsedAttribute = false;
+    if (!CheckAt(Parser, ITokenType_LeftSquare))
+    {
+        if (!CheckAt(Parser, ITokenType_Identifier))
+        {
+            return true;
+        }
+        
+        Result->InfoHandle = INVALID_ATTRIBUTE_HANDLE;
+        Result->IdentifierToken = Parser->At;
+        Result->Aliased = true;
+        Result->Alias = 0;
+        *ParsedAttribute = true;
+        return true;
+    }
+    
+    if (!ExpectNext(Parser, ITokenType_Identifier, "Identifier"))
+    {
+        return false;
+    }
+    
+    itoken_info Identifier = Parser->At;
+    
+    if (!ReceiveNextToken(Parser))
+    {
+        return false;
+    }
+    
+    Result->InfoHandle = INVALID_ATTRIBUTE_HANDLE;
+    Result->IdentifierToken = Identifier;
+    Result->Aliased = false;
+    Result->Alias = 0;
+    
+    if (!TryParseArgumentList(Parser, &Result->Arguments))
+    {
+        return false;
+    }
+    
+    if (!ExpectAt(Parser, ITokenType_RightSquare, "]"))
+    {
+        return false;
+    }
+    
+    *ParsedAttribute = true;
+    return true;
+}
+
+static
+bool TryParseAliasAttribute(inspect_parser *Parser, attribute_alias *Result)
+{
+    if (!CheckAt(Parser, ITokenType_AliasAttribute))
+    {
+        return false;
+    }
+    itoken_info Start = Parser->At;
+    
+    if (!ExpectNext(Parser, ITokenType_Identifier, "Identifier"))
+    {
+        return false;
+    }
+    
+    Result->Alias = Parser->At;
+    
+    if (!ReceiveNextToken(Parser))
+    {
+        return false;
+    }
+    
+    bool Parsed;
+    if (!TryParseAttributeInstance(Parser, &Result->Value, &Parsed) && Parsed)
+    {
+        PrintLocation(&Start);
+        PrintError("Expected attribute\n");
+        return false;
+    }
+    
+    return true;
+}
+
+static
+bool TryParseAttributeList(inspect_parser *Parser,
+                           attribute_list **Result)
+{
+    // NOTE(Brian): Unlike most of the TryParse* functions, this function
+    // does not return false if it does not produce anything.
+    *Result = 0;
+    
+    for (;;)
+    {
+        attribute_instance NewAttribute;
+        bool ParsedAttribute;
+        if (!TryParseAttributeInstance(Parser, &NewAttribute, &ParsedAttribute))
+        {
+            PrintAttributeListFailure(*Result);
+            delete *Result;
+            *Result = 0;
+            return false;
+        }
+        
+        if (!ParsedAttribute)
+        {
+            break;
+        }
+        
+        AppendAttribute(Result, &NewAttribute);
+        
+        if (!ReceiveNextToken(Parser))
+        {
+            delete *Result;
+            *Result = 0;
+            return false;
+        }
+    }
+    
+    if (*Result)
+    {
+        Parser->UnresolvedAttributeLists.push_back(*Result);
+    }
+    
+    return true;
+}
+
+static
+bool TryParseDeclareAttribute(inspect_parser *Parser, attribute_declaration *Result)
+{
+    if (!CheckAt(Parser, ITokenType_DeclareAttribute))
+    {
+        return false;
+    }
+    
+    if (!ExpectNext(Parser, ITokenType_Identifier, "Identifier"))
+    {
+        return false;
+    }
+    
+    itoken_info Identifier = Parser->At;
+    Result->Name = Identifier;
+    
+    if (!ReceiveNextToken(Parser))
+    {
+        return false;
+    }
+    
+    if (!TryParseArgumentListDeclaration(Parser, &Result->ArgumentList))
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+static
+bool TryParseStruct(inspect_parser *Parser, defined_struct *Result)
+{
+    if (CheckAt(Parser, ITokenType_Struct))
+    {
+        if (!CheckNext(Parser, ITokenType_Identifier))
+        {
+            PrintLocation(&Parser->At);
+            PrintError("Expected identifier after \"struct\"");
+            return false;
+        }
+        Result->Identifier = Parser->At;
+        
+        if (!ExpectNext(Parser, ITokenType_LeftCurly, "{"))
+        {
+            return false;
+        }
+        
+        for (;;)
+        {
+            if (!ReceiveNextToken(Parser))
+            {
+                return false;
+            }
+            
+            if (CheckAt(Parser, ITokenType_RightCurly))
+            {
+                break;
+            }
+            
+            field Field;
+            if (!TryParseField(Parser, &Field))
+            {
+                return false;
             }
+            
+            Result->Fields.push_back(Field);
         }
         
-        Parameter.Value = CreateCText(&Begin, &Parser->At);
-        Result->Arguments.push_back(Parameter);
+        if (!ExpectNext(Parser, ITokenType_SemiColon, ";"))
+        {
+            return false;
+        }
         
-        itoken_info Last = Parser->At;
-        if (!ReceiveNextToken(Parser))
+        return true;
+    }
+    
+    return false;
+}
+
+static inline
+bool CompareTokenNames(itoken_info *First, itoken_info *Second)
+{
+    if (First->Length != Second->Length)
+    {
+        return false;
+    }
+    
+    for (size_t I = 0; I < First->Length; ++I)
+    {
+        if (TokenText(First)[I] != TokenText(Second)[I])
         {
             return false;
         }
+    }
+    
+    return true;
+}
+
+static
+bool CheckArguments(argument_list_declaration *Signature,
+                    argument_list *List)
+{
+    if (Signature->Names.size() != List->Arguments.size())
+    {
+        PrintLocation(&List->ListBegin);
+        PrintError("Expected %zu arguments, found %zu.\n",
+                   Signature->Names.size(),
+                   List->Arguments.size());
+        return false;
+    }
+    
+    for(size_t I = 0; I < List->Arguments.size(); ++I)
+    {
+        itoken_info &SignatureName = Signature->Names[I];
+        argument_item &Argument = List->Arguments[I];
         
-        if (Last.Token.Type == ITokenType_RightParen)
+        if (Argument.Named)
+        {
+            if (!CompareTokenNames(&Argument.Name, &SignatureName))
+            {
+                PrintLocation(&Argument.Name);
+                PrintError("Explicit argument name doesn't match signature, found \"%.*s\" expected \"%.*s\"\n",
+                           (int)Argument.Name.Length,
+                           TokenText(&Argument.Name),
+                           (int)SignatureName.Length,
+                           TokenText(&SignatureName));
+                
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+static
+std::string AttributeDataKey(attribute_handle Handle, argument_list *List)
+{
+    std::string Key((const char *)&Handle, sizeof(Handle));
+    for (argument_item &Argument : List->Arguments)
+    {
+        Key.append(Argument.Value.Begin, Argument.Value.Length);
+        Key.push_back('\0');
+    }
+    
+    return Key;
+}
+
+// Returns the shared dict holding the argument values of the attribute, creating it
+// the first time this handle and these values are seen.
+static
+inspect_dict *GetSharedAttributeData(inspect_parser *Parser,
+                                     attribute_handle Handle,
+                                     argument_list_declaration *Signature,
+                                     argument_list *List)
+{
+    inspect_dict *&Shared = Parser->SharedAttributeData[AttributeDataKey(Handle, List)];
+    if (Shared)
+    {
+        return Shared;
+    }
+    
+    Shared = NewDict();
+    for (size_t I = 0; I < List->Arguments.size(); ++I)
+    {
+        Insert(Shared, &Signature->Names[I], NewStringView(&List->Arguments[I].Value));
+    }
+    
+    // Templates can't assign through one field's attribute into everyone else's.
+    Shared->ReadOnly = true;
+    Shared->SharedAttributeData = true;
+    
+    return Shared;
+}
+
+// An error found while resolving. Order is the index of the item it was found in.
+struct resolve_error
+{
+    size_t Order;
+    std::string Message;
+};
+
+#define RESOLVE_BATCH_SIZE 256
+
+template <typename T>
+struct resolve_job
+{
+    inspect_parser *Parser;
+    std::vector<T> *Items;
+    bool (*Resolve)(inspect_parser *Parser, T Item);
+    
+    std::atomic<size_t> NextBatch;
+};
+
+template <typename T>
+static
+void RunResolveThread(resolve_job<T> *Job, std::vector<resolve_error> *Errors)
+{
+    std::string *PreviousCapture = ErrorCapture;
+    std::string Message;
+    ErrorCapture = &Message;
+    
+    size_t Count = Job->Items->size();
+    for (;;)
+    {
+        size_t Begin = Job->NextBatch.fetch_add(1, std::memory_order_relaxed) * RESOLVE_BATCH_SIZE;
+        if (Begin >= Count)
         {
             break;
         }
+        
+        size_t End = Begin + RESOLVE_BATCH_SIZE < Count ? Begin + RESOLVE_BATCH_SIZE : Count;
+        for (size_t I = Begin; I < End; ++I)
+        {
+            if (!Job->Resolve(Job->Parser, (*Job->Items)[I]))
+            {
+                Errors->push_back({ I, std::move(Message) });
+                Message.clear();
+            }
+        }
+    }
+    
+    ErrorCapture = PreviousCapture;
+}
+
+static inline
+bool CompareResolveErrors(const resolve_error &First, const resolve_error &Second)
+{
+    return First.Order < Second.Order;
+}
+
+// Calls Resolve on every item, split across the resolve threads in batches. Resolve may
+// only change the item it is given, the type index and the attribute tables are read by
+// every thread at once so nothing may add to them until this returns.
+//
+// Every error is reported, not just the first. They are printed once every thread is
+// done, in the order of the items, which is the order they appear in the schema. So
+// the output is the same no matter how many threads there were.
+template <typename T>
+static
+bool ResolveInParallel(inspect_parser *Parser,
+                       std::vector<T> *Items,
+                       bool (*Resolve)(inspect_parser *Parser, T Item))
+{
+    size_t BatchCount = (Items->size() + RESOLVE_BATCH_SIZE - 1) / RESOLVE_BATCH_SIZE;
+    
+    size_t ThreadCount = Parser->ResolveThreads ? Parser->ResolveThreads : std::thread::hardware_concurrency();
+    if (ThreadCount > BatchCount)
+    {
+        ThreadCount = BatchCount;
+    }
+    
+    if (ThreadCount == 0)
+    {
+        ThreadCount = 1;
+    }
+    
+    resolve_job<T> Job;
+    Job.Parser = Parser;
+    Job.Items = Items;
+    Job.Resolve = Resolve;
+    Job.NextBatch.store(0, std::memory_order_relaxed);
+    
+    // This thread takes batches as well, a small schema never starts another one.
+    std::vector<std::vector<resolve_error>> Errors(ThreadCount);
+    std::vector<std::thread> Threads;
+    for (size_t I = 1; I < ThreadCount; ++I)
+    {
+        Threads.emplace_back(RunResolveThread<T>, &Job, &Errors[I]);
+    }
+    
+    RunResolveThread(&Job, &Errors[0]);
+    
+    for (std::thread &Thread : Threads)
+    {
+        Thread.join();
+    }
+    
+    std::vector<resolve_error> AllErrors;
+    for (std::vector<resolve_error> &ThreadErrors : Errors)
+    {
+        for (resolve_error &Error : ThreadErrors)
+        {
+            AllErrors.push_back(std::move(Error));
+        }
+    }
+    
+    std::sort(AllErrors.begin(), AllErrors.end(), CompareResolveErrors);
+    for (resolve_error &Error : AllErrors)
+    {
+        PrintError("%s", Error.Message.c_str());
+    }
+    
+    return AllErrors.empty();
+}
+
+static inline
+attribute_instance *GetActualAttribute(attribute_instance *Instance)
+{
+    return Instance->Aliased ? Instance->Alias : Instance;
+}
+
+static
+bool CheckAttributeList(inspect_parser *Parser, attribute_list *List)
+{
+    for (attribute_instance &Instance : List->Attributes)
+    {
+        attribute_instance *ActualAttribute = GetActualAttribute(&Instance);
+        attribute_declaration *Declaration = &Parser->AttributeInformation[(size_t)ActualAttribute->InfoHandle];
+        
+        SetAttributePresent(List, ActualAttribute->InfoHandle);
+        
+        if (!CheckArguments(&Declaration->ArgumentList, &ActualAttribute->Arguments))
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// Only once every list is checked. The shared data is added to as it goes, so this
+// can't be done on the resolve threads.
+static
+void BuildAttributeData(inspect_parser *Parser, attribute_list *List)
+{
+    List->AttributeData.Parent = nullptr;
+    
+    for (attribute_instance &Instance : List->Attributes)
+    {
+        attribute_instance *ActualAttribute = GetActualAttribute(&Instance);
+        attribute_declaration *Declaration = &Parser->AttributeInformation[(size_t)ActualAttribute->InfoHandle];
+        
+        inspect_dict *Shared = GetSharedAttributeData(Parser,
+                                                      ActualAttribute->InfoHandle,
+                                                      &Declaration->ArgumentList,
+                                                      &ActualAttribute->Arguments);
+        
+        Insert(&List->AttributeData, &ActualAttribute->IdentifierToken, CreateReference(Shared));
+    }
+}
+
+static
+bool ResolveAttribute(inspect_parser *Parser, attribute_instance *Instance)
+{
+    auto It = Parser->AttributeIndex.find(StringFromToken(&Instance->IdentifierToken));
+    if (It == Parser->AttributeIndex.end())
+    {
+        PrintLocation(&Instance->IdentifierToken);
+        PrintError("Unrecognized Attribute \"%.*s\"\n",
+                   (int)Instance->IdentifierToken.Length,
+                   TokenText(&Instance->IdentifierToken));
+        return false;
+    }
+    
+    Instance->InfoHandle = It->second;
+    return true;
+}
+
+static
+bool LinkAttribute(inspect_parser *Parser, attribute_instance *Instance)
+{
+    auto It = Parser->AliasIndex.find(StringFromToken(&Instance->IdentifierToken));
+    if (It != Parser->AliasIndex.end())
+    {
+        Instance->Alias = &Parser->AttributeAliases[It->second].Value;
+        return true;
+    }
+    
+    PrintLocation(&Instance->IdentifierToken);
+    PrintError("Could not resolve attribute alias \"%.*s\"\n",
+               (int)Instance->IdentifierToken.Length,
+               TokenText(&Instance->IdentifierToken));
+    return false;
+}
+
+static
+bool ResolveAttributeList(inspect_parser *Parser, attribute_list *List)
+{
+    for (attribute_instance &Instance : List->Attributes)
+    {
+        if (Instance.Aliased)
+        {
+            if (!LinkAttribute(Parser, &Instance))
+            {
+                return false;
+            }
+        }
+            
+        else
+        {
+            if (!ResolveAttribute(Parser, &Instance))
+            {
+                return false;
+            }
+        }
     }
-    
-    return true;
+        
+    return CheckAttributeList(Parser, List);
 }
 
 static
-bool TryParseArgumentListDeclaration(inspect_parser *Parser, argument_list_declaration *Result)
+bool ResolveAttributes(inspect_parser *Parser)
 {
-    if (!CheckAt(Parser, ITokenType_LeftParen))
+    // Lists link to the alias itself, so every alias has to be resolved before them.
+    std::vector<attribute_instance *> AliasValues;
+    for (attribute_alias &Alias : Parser->AttributeAliases)
+    {
+        AliasValues.push_back(&Alias.Value);
+    }
+    
+    if (!ResolveInParallel(Parser, &AliasValues, ResolveAttribute))
     {
         return false;
     }
     
-    if (CheckNext(Parser, ITokenType_RightParen))
+    if (!ResolveInParallel(Parser, &Parser->UnresolvedAttributeLists, ResolveAttributeList))
     {
-        return true;
+        return false;
     }
     
-    for (;;)
+    for (attribute_list *List : Parser->UnresolvedAttributeLists)
     {
-        if (!ExpectAt(Parser, ITokenType_Identifier, "Identifier"))
-        {
-            return false;
-        }
+        BuildAttributeData(Parser, List);
+    }
+    
+    return true;
+}
+
+static
+bool ResolveType(inspect_parser *Parser, inspect_data_item Unresolved)
+{
+    inspect_dict *UnresolvedTypeDict = Unresolved.Dict;
+    inspect_list &TypeList = *Parser->TypeInfoList.List;
+    
+    for(;;)
+    {
+        // We only need to resolve the innermost type of
+        // pointer or references.
         
-        Result->Names.push_back(Parser->At);
+        bool IsPointer = GetSlot(UnresolvedTypeDict, TypeSlot_IsPointer).Bool;
+        bool IsReference = GetSlot(UnresolvedTypeDict, TypeSlot_IsReference).Bool;
         
-        if (CheckNext(Parser, ITokenType_RightParen))
+        if (IsPointer || IsReference)
         {
-            break;
+            // The first item in the type info list is the PTR type info.
+            SetSlot(UnresolvedTypeDict, TypeSlot_Info, CreateReference(TypeList[0].Dict));
+            Unresolved = GetSlot(UnresolvedTypeDict, TypeSlot_InnerType);
+            UnresolvedTypeDict = Unresolved.Dict;
         }
-        else if (CheckAt(Parser, ITokenType_Comma))
+        else
         {
-            ReceiveNextToken(Parser);
+            break;
         }
-        else if (CheckAt(Parser, ITokenType_End))
+    }
+    
+    std::string TypeName = StringFromItem(&GetSlot(UnresolvedTypeDict, TypeSlot_Name));
+    auto It = Parser->TypeIndex.find(TypeName);
+    if (It == Parser->TypeIndex.end())
+    {
+        PrintLocation(&Unresolved.Dict->SourceToken);
+        PrintError("Unrecognized type \"%s\"\n",
+                   TypeName.c_str());
+        return false;
+    }
+    
+    SetSlot(UnresolvedTypeDict, TypeSlot_Info, CreateReference(It->second.Info));
+
+    inspect_list *Args = GetSlot(UnresolvedTypeDict, TypeSlot_Args).List;
+    for (inspect_data_item &Item : *Args)
+    {
+        if (!ResolveType(Parser, Item))
         {
-            PrintLocation(Parser->At.Line, Parser->At.Column, Parser->At.Filename);
-            printf("Unexpected EOF while parsing argument list\n");
             return false;
         }
-        else
+    }
+    
+    return true;
+}
+
+static
+bool ResolveField(inspect_parser *Parser, inspect_dict *FieldDict)
+{
+    inspect_data_item TypeItem = GetSlot(FieldDict, FieldSlot_Type);
+    if (!ResolveType(Parser, TypeItem))
+    {
+        return false;
+    }
+            
+    bool IsMethod = GetSlot(FieldDict, FieldSlot_IsMethod).Bool;
+    if (IsMethod)
+    {
+        inspect_list *ArgumentList = GetSlot(FieldDict, FieldSlot_MethodArguments).List;
+        for (inspect_data_item &ArgumentItem : *ArgumentList)
         {
-            PrintLocation(Parser->At.Line, Parser->At.Column, Parser->At.Filename);
-            printf("Unexpected \"%.*s\" while parsing argument list\n",
-                   (int)Parser->At.Token.Length, Parser->At.Token.Text);
-            return false;
+            inspect_dict *ArgumentDict = ArgumentItem.Dict;
+            inspect_data_item ArgumentType = GetSlot(ArgumentDict, TypedArgumentSlot_Type);
+            if (!ResolveType(Parser, ArgumentType))
+            {
+                return false;
+            }
         }
     }
     
@@ -1166,551 +2186,612 @@ bool TryParseArgumentListDeclaration(inspect_parser *Parser, argument_list_decla
 }
 
 static
-bool TryParseAttributeInstance(inspect_parser *Parser,
-                               attribute_instance *Result,
-                               bool *ParsedAttribute)
+bool ResolveTypes(inspect_parser *Parser)
 {
-    *ParsedAttribute = false;
-    if (!CheckAt(Parser, ITokenType_LeftSquare))
+    // Split by field rather than by struct, a schema can be a handful of huge structs.
+    std::vector<inspect_dict *> Fields;
+    for (inspect_data_item &StructItem : *Parser->StructList.List)
     {
-        if (!CheckAt(Parser, ITokenType_Identifier))
+        for (inspect_data_item &FieldItem : *GetSlot(StructItem.Dict, StructSlot_Fields).List)
         {
-            return true;
+            Fields.push_back(FieldItem.Dict);
         }
-        
-        Result->InfoHandle = INVALID_ATTRIBUTE_HANDLE;
-        Result->IdentifierToken = Parser->At;
-        Result->Aliased = true;
-        Result->Alias = 0;
-        *ParsedAttribute = true;
-        return true;
     }
     
-    if (!ExpectNext(Parser, ITokenType_Identifier, "Identifier"))
+    return ResolveInParallel(Parser, &Fields, ResolveField);
+}
+
+// Adds the type info to the type list and the name index. Fails if a type with the
+// same name was already declared, the type info is freed then.
+static
+bool AddTypeInfo(inspect_parser *Parser, inspect_data_item TypeInfo, itoken_info *Declaration)
+{
+    if (Parser->Task)
     {
-        return false;
+        imported_declaration &Imported = RecordDeclaration(Parser, Imported_TypeInfo);
+        Imported.TypeInfo = TypeInfo;
+        Imported.Name = *Declaration;
+        return true;
     }
     
-    itoken_info Identifier = Parser->At;
+    std::string Name = StringFromItem(&GetSlot(TypeInfo.Dict, TypeInfoSlot_Name));
     
-    if (!ReceiveNextToken(Parser))
+    type_index_entry Entry;
+    Entry.Info = TypeInfo.Dict;
+    Entry.Declaration = *Declaration;
+    
+    auto Inserted = Parser->TypeIndex.emplace(Name, Entry);
+    if (!Inserted.second)
     {
+        itoken_info &Previous = Inserted.first->second.Declaration;
+        
+        PrintLocation(Declaration);
+        if (Previous.File != NO_SOURCE_FILE)
+        {
+            int Line;
+            int Column;
+            GetSourceLocation(Previous.File, Previous.Offset, &Line, &Column);
+            PrintError("Duplicate declaration of type \"%s\", previously declared at %s:%i:%i\n",
+                       Name.c_str(), GetSourceFilename(Previous.File), Line, Column);
+        }
+        else
+        {
+            PrintError("Duplicate declaration of type \"%s\", \"%s\" is a built in type\n", Name.c_str(), Name.c_str());
+        }
+        
+        FreeDataItem(&TypeInfo);
         return false;
     }
     
-    Result->InfoHandle = INVALID_ATTRIBUTE_HANDLE;
-    Result->IdentifierToken = Identifier;
-    Result->Aliased = false;
-    Result->Alias = 0;
+    Parser->TypeInfoList.List->push_back(TypeInfo);
+    return true;
+}
+
+static inline
+void InitializeTypeInfoList(inspect_parser *Parser)
+{
+    // Later we get the PTR type info from accessing the first
+    // element in the list.
+    // Its important that this is the first thing inserted into the list!
+    itoken_info BuiltIn = {};
+    AddTypeInfo(Parser, CreateTypeInfoItem("Pointer", "TD_PTR", nullptr), &BuiltIn);
+}
+
+static
+void InitializeParser(const char *Filename, inspect_parser *Parser, inspect_lexer *Lexer)
+{
+    CreateTokenStack(&Parser->Stack);
+    Parser->RetainTokens = false;
     
-    if (!TryParseArgumentList(Parser, &Result->Arguments))
+    CreateLexerStack(&Parser->LexerStack);
+    Parser->Lexer = Lexer;
+    Parser->ImportPool = nullptr;
+    Parser->Task = nullptr;
+    Parser->Reader = nullptr;
+    Parser->ResolveThreads = 0;
+    
+    Parser->StructList = NewListItem();
+    Parser->TypeInfoList = NewListItem();
+    InitializeTypeInfoList(Parser);
+    
+    std::string Path = Lexer->Directory;
+    char *Name = GetFilename(Filename);
+    if (!Path.empty())
     {
-        return false;
+        Path += "/";
     }
     
-    if (!ExpectAt(Parser, ITokenType_RightSquare, "]"))
+    Path += Name;
+    free(Name);
+    Path.resize(NormalizePath(&Path[0]));
+    Parser->ParsedFiles.insert(Path);
+}
+
+bool CreateParser(const char *Filename, inspect_parser *Parser, source_reader *Reader)
+{
+    inspect_lexer *NewLexer = new inspect_lexer;
+    Parser->LexerStorage.push_back(NewLexer);
+    if(!CreateLexer(Filename, Reader, NewLexer))
     {
+        Parser->LexerStorage.pop_back();
+        delete NewLexer;
         return false;
     }
     
-    *ParsedAttribute = true;
+    Parser->Pipeline = nullptr;
+    Parser->Worker = nullptr;
+    InitializeParser(Filename, Parser, NewLexer);
+    Parser->Reader = Reader;
     return true;
 }
 
-static
-bool TryParseAliasAttribute(inspect_parser *Parser, attribute_alias *Result)
+bool CreatePipelinedParser(const char *Filename, inspect_parser *Parser)
 {
-    if (!CheckAt(Parser, ITokenType_AliasAttribute))
+    Parser->Pipeline = new lex_pipeline;
+    CreateLexPipeline(Parser->Pipeline);
+    
+    Parser->Worker = StartLexWorker(Parser->Pipeline, Filename);
+    if (!WaitForLexWorker(Parser->Pipeline, Parser->Worker))
     {
+        FreeLexPipeline(Parser->Pipeline);
+        delete Parser->Pipeline;
         return false;
     }
-    itoken_info Start = Parser->At;
     
-    if (!ExpectNext(Parser, ITokenType_Identifier, "Identifier"))
+    InitializeParser(Filename, Parser, &Parser->Worker->Lexer);
+    return true;
+}
+
+static void FreeImportPool(import_pool *Pool);
+
+void FreeParser(inspect_parser *Parser)
+{
+    if (Parser->Pipeline)
     {
-        return false;
+        FreeLexPipeline(Parser->Pipeline);
+        delete Parser->Pipeline;
     }
     
-    Result->Alias = Parser->At;
+    if (Parser->ImportPool)
+    {
+        FreeImportPool(Parser->ImportPool);
+        delete Parser->ImportPool;
+    }
     
-    if (!ReceiveNextToken(Parser))
+    for(inspect_lexer *Lexer : Parser->LexerStorage)
     {
-        return false;
+        FreeLexer(Lexer);
+        delete Lexer;
     }
     
-    bool Parsed;
-    if (!TryParseAttributeInstance(Parser, &Result->Value, &Parsed) && Parsed)
+    FreeTokenStack(&Parser->Stack);
+    
+    // Only still the parser's if ParseInspect didn't get to hand them to the model.
+    FreeDataItem(&Parser->StructList);
+    FreeDataItem(&Parser->TypeInfoList);
+    
+    for (attribute_list *List : Parser->UnresolvedAttributeLists)
     {
-        PrintLocation(Start.Line,
-                      Start.Column,
-                      Start.Filename);
-        printf("Expected attribute\n");
-        return false;
+        delete List;
     }
     
-    return true;
+    for (auto &Entry : Parser->SharedAttributeData)
+    {
+        FreeInspectDict(Entry.second);
+        delete Entry.second;
+    }
 }
 
+// Gives the attribute its handle, which is its index in AttributeInformation.
 static
-bool TryParseAttributeList(inspect_parser *Parser,
-                           attribute_list **Result,
-                           int Until)
+bool AddAttributeDeclaration(inspect_parser *Parser, attribute_declaration *Declaration)
 {
-    // NOTE(Brian): Unlike most of the TryParse* functions, this function
-    // does not return false if it does not produce anything.
-    *Result = 0;
-    
-    while (Parser->Stack.Top < Until)
+    if (Parser->Task)
     {
-        attribute_instance NewAttribute;
-        bool ParsedAttribute;
-        if (!TryParseAttributeInstance(Parser, &NewAttribute, &ParsedAttribute))
-        {
-            if (*Result)
-            {
-                attribute_instance &First = (*Result)->Attributes.front();
-                PrintLocation(First.IdentifierToken.Line,
-                              First.IdentifierToken.Column,
-                              First.IdentifierToken.Filename);
-                printf("Failed to parse attribute list starting at \"%.*s\"\n",
-                       (int)First.IdentifierToken.Token.Length,
-                       First.IdentifierToken.Token.Text);
-            }
-            
-            return false;
-        }
-        
-        if (!ParsedAttribute)
-        {
-            break;
-        }
-        
-        if (*Result == nullptr)
-        {
-            *Result = new attribute_list;
-        }
-        
-        (*Result)->Attributes.push_back(NewAttribute);
-        
-        if (!ReceiveNextToken(Parser))
-        {
-            return false;
-        }
+        RecordDeclaration(Parser, Imported_Attribute).Attribute = *Declaration;
+        return true;
     }
     
-    if (*Result)
+    attribute_handle Handle = (attribute_handle)Parser->AttributeInformation.size();
+    auto Inserted = Parser->AttributeIndex.emplace(StringFromToken(&Declaration->Name), Handle);
+    if (!Inserted.second)
     {
-        Parser->UnresolvedAttributeLists.push_back(*Result);
+        itoken_info &Previous = Parser->AttributeInformation[(size_t)Inserted.first->second].Name;
+        int Line;
+        int Column;
+        GetSourceLocation(Previous.File, Previous.Offset, &Line, &Column);
+        
+        PrintLocation(&Declaration->Name);
+        PrintError("Duplicate declaration of attribute \"%.*s\", previously declared at %s:%i:%i\n",
+                   (int)Declaration->Name.Length, TokenText(&Declaration->Name),
+                   GetSourceFilename(Previous.File), Line, Column);
+        return false;
     }
     
+    Parser->AttributeInformation.push_back(*Declaration);
     return true;
 }
 
 static
-bool TryParseDeclareAttribute(inspect_parser *Parser, attribute_declaration *Result)
+bool AddAttributeAlias(inspect_parser *Parser, attribute_alias *Alias)
 {
-    if (!CheckAt(Parser, ITokenType_DeclareAttribute))
+    if (Parser->Task)
     {
-        return false;
+        RecordDeclaration(Parser, Imported_Alias).Alias = *Alias;
+        return true;
     }
     
-    if (!ExpectNext(Parser, ITokenType_Identifier, "Identifier"))
+    size_t Index = Parser->AttributeAliases.size();
+    auto Inserted = Parser->AliasIndex.emplace(StringFromToken(&Alias->Alias), Index);
+    if (!Inserted.second)
     {
+        itoken_info &Previous = Parser->AttributeAliases[Inserted.first->second].Alias;
+        int Line;
+        int Column;
+        GetSourceLocation(Previous.File, Previous.Offset, &Line, &Column);
+        
+        PrintLocation(&Alias->Alias);
+        PrintError("Duplicate attribute alias \"%.*s\", previously declared at %s:%i:%i\n",
+                   (int)Alias->Alias.Length, TokenText(&Alias->Alias),
+                   GetSourceFilename(Previous.File), Line, Column);
         return false;
     }
     
-    itoken_info Identifier = Parser->At;
-    Result->Name = Identifier;
+    Parser->AttributeAliases.push_back(*Alias);
+    return true;
+}
+
+static bool ParseDeclarations(inspect_parser *Parser);
+
+static
+import_task *QueueImport(import_pool *Pool, const std::string &Path)
+{
+    std::lock_guard<std::mutex> Guard(Pool->Lock);
     
-    if (!ReceiveNextToken(Parser))
+    auto Inserted = Pool->Tasks.emplace(Path, nullptr);
+    if (!Inserted.second)
     {
-        return false;
+        return Inserted.first->second;
     }
     
-    if (!TryParseArgumentListDeclaration(Parser, &Result->ArgumentList))
-    {
-        return false;
-    }
+    import_task *Task = new import_task;
+    Task->Path = Path;
+    Task->Status = ImportTask_Queued;
+    Task->Parser = nullptr;
+    Task->Opened = false;
+    Task->Parsed = false;
+    Task->Merged = false;
     
-    return true;
+    Inserted.first->second = Task;
+    Pool->Queue.push_back(Task);
+    Pool->Changed.notify_one();
+    return Task;
 }
 
+// Queues every file imported by the lexer's file before it is parsed, so its imports
+// are already being parsed while it is. This only looks at the tokens, an import the
+// parser would reject later is still queued.
 static
-bool TryParseStruct(inspect_parser *Parser, defined_struct *Result)
+void QueueImports(import_pool *Pool, inspect_lexer *Lexer)
 {
-    if (CheckAt(Parser, ITokenType_Struct))
+    inspect_lexer Scan;
+    Scan.Directory = Lexer->Directory;
+    Scan.Filename = Lexer->Filename;
+    Scan.File = Lexer->File;
+    Scan.Begin = Lexer->Begin;
+    Scan.At = Lexer->Begin;
+    
+    bool AfterImport = false;
+    for (;;)
     {
-        if (!CheckNext(Parser, ITokenType_Identifier))
-        {
-            printf("%s:%i:%i: Expected identifier after \"struct\"",
-                   Parser->Lexer->Filename, Parser->Lexer->Line, Parser->Lexer->Column);
-            return false;
-        }
-        Result->Identifier = Parser->At;
-        
-        if (!ExpectNext(Parser, ITokenType_LeftCurly, "{"))
+        itoken_info Token = NextToken(&Scan);
+        if (Token.Type == ITokenType_End || Token.Type == ITokenType_IncompleteString)
         {
-            return false;
+            break;
         }
         
-        for (;;)
+        // Built the same way as BuildFilePath.
+        if (AfterImport && Token.Type == ITokenType_String)
         {
-            if (!ReceiveNextToken(Parser))
-            {
-                return false;
-            }
-            
-            if (CheckAt(Parser, ITokenType_RightCurly))
-            {
-                break;
-            }
-            
-            field Field;
-            if (!TryParseField(Parser, &Field))
+            std::string Path = Scan.Directory;
+            if (!Path.empty())
             {
-                return false;
+                Path += "/";
             }
             
-            Result->Fields.push_back(Field);
-        }
-        
-        if (!ExpectNext(Parser, ITokenType_SemiColon, ";"))
-        {
-            return false;
+            Path.append(TokenText(&Token), Token.Length);
+            Path.resize(NormalizePath(&Path[0]));
+            QueueImport(Pool, Path);
         }
         
-        return true;
+        AfterImport = Token.Type == ITokenType_Import;
     }
+}
+
+// A parser that only records the declarations of the lexer's file in the task, the
+// files it imports aren't opened.
+static
+void InitializeTaskParser(inspect_parser *Parser, inspect_lexer *Lexer, import_task *Task)
+{
+    Parser->LexerStorage.push_back(Lexer);
     
-    return false;
+    CreateTokenStack(&Parser->Stack);
+    Parser->RetainTokens = false;
+    CreateLexerStack(&Parser->LexerStack);
+    Parser->Lexer = Lexer;
+    Parser->Pipeline = nullptr;
+    Parser->Worker = nullptr;
+    Parser->ImportPool = nullptr;
+    Parser->Task = Task;
+    Parser->Reader = nullptr;
 }
 
-static inline
-bool CompareTokenNames(inspect_token *First, inspect_token *Second)
+static
+void RunImportTask(import_pool *Pool, import_task *Task)
 {
-    if (First->Length != Second->Length)
+    inspect_lexer *Lexer = new inspect_lexer;
+    Task->Opened = CreateLexer(Task->Path.c_str(), Pool->Reader, Lexer);
+    if (!Task->Opened)
     {
-        return false;
+        delete Lexer;
+        return;
     }
     
-    for (size_t I = 0; I < First->Length; ++I)
-    {
-        if (First->Text[I] != Second->Text[I])
-        {
-            return false;
-        }
-    }
+    QueueImports(Pool, Lexer);
     
-    return true;
+    inspect_parser *Parser = new inspect_parser;
+    Task->Parser = Parser;
+    InitializeTaskParser(Parser, Lexer, Task);
+    
+    // Also run on the parser's thread, which may be capturing its own errors.
+    std::string *PreviousCapture = ErrorCapture;
+    ErrorCapture = &Task->Errors;
+    Task->Parsed = ParseDeclarations(Parser);
+    ErrorCapture = PreviousCapture;
+    
+    FreeTokenStack(&Parser->Stack);
 }
 
 static
-bool ResolveArguments(argument_list_declaration *Signature,
-                      argument_list *List,
-                      inspect_dict *Parent)
+void FinishImportTask(import_pool *Pool, import_task *Task)
 {
-    if (Signature->Names.size() != List->Arguments.size())
-    {
-        PrintLocation(List->ListBegin.Line,
-                      List->ListBegin.Column,
-                      List->ListBegin.Filename);
-        printf("Expected %zu arguments, found %zu.\n",
-               Signature->Names.size(),
-               List->Arguments.size());
-        return false;
-    }
+    RunImportTask(Pool, Task);
     
-    for(size_t I = 0; I < List->Arguments.size(); ++I)
     {
-        itoken_info &SignatureName = Signature->Names[I];
-        argument_item &Argument = List->Arguments[I];
-        
-        if (Argument.Named)
-        {
-            if (!CompareTokenNames(&Argument.Name.Token, &SignatureName.Token))
-            {
-                PrintLocation(Argument.Name.Line,
-                              Argument.Name.Column,
-                              Argument.Name.Filename);
-                printf("Explicit argument name doesn't match signature, found \"%.*s\" expected \"%.*s\"\n",
-                       (int)Argument.Name.Token.Length,
-                       Argument.Name.Token.Text,
-                       (int)SignatureName.Token.Length,
-                       SignatureName.Token.Text);
-                
-                return false;
-            }
-        }
-        
-        Insert(Parent, &SignatureName.Token, NewStringItem(&Argument.Value));
+        std::lock_guard<std::mutex> Guard(Pool->Lock);
+        Task->Status = ImportTask_Done;
     }
     
-    return true;
+    Pool->Changed.notify_all();
 }
 
 static
-bool BuildAttributeData(inspect_parser *Parser, attribute_list *List)
+void RunImportThread(import_pool *Pool)
 {
-    List->AttributeData.Parent = nullptr;
-    
-    for (attribute_instance &Instance : List->Attributes)
+    std::unique_lock<std::mutex> Guard(Pool->Lock);
+    for (;;)
     {
-        attribute_declaration *Declaration;
-        attribute_instance *ActualAttribute;
-        if (!Instance.Aliased)
+        while (!Pool->Stop && Pool->Queue.empty())
         {
-            Declaration = &Parser->AttributeInformation[(size_t)Instance.InfoHandle];
-            ActualAttribute = &Instance;
+            Pool->Changed.wait(Guard);
         }
-        else
+        
+        if (Pool->Stop)
         {
-            ActualAttribute = Instance.Alias;
-            Declaration = &Parser->AttributeInformation[(size_t)ActualAttribute->InfoHandle];
+            return;
         }
         
-        inspect_data_item DictItem = NewDictItem();
-        inspect_dict &Dict = *DictItem.Dict;
+        import_task *Task = Pool->Queue.front();
+        Pool->Queue.pop_front();
         
-        if (!ResolveArguments(&Declaration->ArgumentList, &ActualAttribute->Arguments, &Dict))
+        // The parser may have needed it before any thread got to it and parsed it itself.
+        if (Task->Status != ImportTask_Queued)
         {
-            FreeDataItem(&DictItem);
-            return false;
+            continue;
         }
         
-        Insert(&List->AttributeData, &ActualAttribute->IdentifierToken.Token, &DictItem);
+        Task->Status = ImportTask_Running;
+        Guard.unlock();
+        FinishImportTask(Pool, Task);
+        Guard.lock();
     }
-    
-    return true;
 }
 
 static
-bool ResolveAttribute(inspect_parser *Parser, attribute_instance *Instance)
+import_task *WaitForImport(import_pool *Pool, const char *Path)
 {
-    for (attribute_handle Handle = 0;
-         Handle < (int)Parser->AttributeInformation.size();
-         ++Handle)
+    // Every import should have been found when its file was scanned, this only matters
+    // if the scan and the parser disagree on what an import is.
+    import_task *Task = QueueImport(Pool, Path);
+    
+    std::unique_lock<std::mutex> Guard(Pool->Lock);
+    if (Task->Status == ImportTask_Queued)
     {
-        attribute_declaration &Declaration = Parser->AttributeInformation[(uint64)Handle];
-        if (CompareTokenNames(&Declaration.Name.Token,
-                              &Instance->IdentifierToken.Token))
-        {
-            Instance->InfoHandle = Handle;
-        }
+        Task->Status = ImportTask_Running;
+        Guard.unlock();
+        FinishImportTask(Pool, Task);
+        return Task;
     }
     
-    if (Instance->InfoHandle == INVALID_ATTRIBUTE_HANDLE)
+    while (Task->Status != ImportTask_Done)
     {
-        PrintLocation(Instance->IdentifierToken.Line,
-                      Instance->IdentifierToken.Column,
-                      Instance->IdentifierToken.Filename);
-        printf("Unrecognized Attribute \"%.*s\"\n",
-               (int)Instance->IdentifierToken.Token.Length,
-               Instance->IdentifierToken.Token.Text);
-        return false;
+        Pool->Changed.wait(Guard);
     }
     
-    return true;
+    return Task;
 }
 
-static
-bool LinkAttribute(inspect_parser *Parser, attribute_instance *Instance)
+static inline
+void AppendAttributeLists(inspect_parser *Parser, std::vector<attribute_list *> *AttributeLists,
+                          size_t *Appended, size_t End)
 {
-    for(attribute_alias &Alias : Parser->AttributeAliases)
+    for (; *Appended < End; ++*Appended)
     {
-        if (CompareTokenNames(&Instance->IdentifierToken.Token,
-                              &Alias.Alias.Token))
-        {
-            Instance->Alias = &Alias.Value;
-            return true;
-        }
+        Parser->UnresolvedAttributeLists.push_back((*AttributeLists)[*Appended]);
     }
-    
-    PrintLocation(Instance->IdentifierToken.Line,
-                  Instance->IdentifierToken.Column,
-                  Instance->IdentifierToken.Filename);
-    printf("Could not resolve attribute alias \"%.*s\"\n",
-           (int)Instance->IdentifierToken.Token.Length,
-           Instance->IdentifierToken.Token.Text);
-    return false;
 }
 
+// Adds every recorded declaration of a file as if it had been parsed right here,
+// including the files it imports.
 static
-bool ResolveAttributes(inspect_parser *Parser)
+bool ReplayDeclarations(inspect_parser *Parser,
+                        std::vector<imported_declaration> *Declarations,
+                        std::vector<attribute_list *> *AttributeLists)
 {
-    for (attribute_alias &Alias : Parser->AttributeAliases)
-    {
-        if (!ResolveAttribute(Parser, &Alias.Value))
-        {
-            return false;
-        }
-    }
-    
-    for (attribute_list *List : Parser->UnresolvedAttributeLists)
+    size_t Appended = 0;
+    for (imported_declaration &Declaration : *Declarations)
     {
-        for (attribute_instance &Instance : List->Attributes)
+        AppendAttributeLists(Parser, AttributeLists, &Appended, Declaration.AttributeListsEnd);
+        
+        bool Added = true;
+        switch (Declaration.Kind)
         {
-            if (Instance.Aliased)
+            case Imported_TypeInfo:
             {
-                if (!LinkAttribute(Parser, &Instance))
-                {
-                    return false;
-                }
+                Added = AddTypeInfo(Parser, Declaration.TypeInfo, &Declaration.Name);
+                break;
             }
             
-            else
+            case Imported_Attribute:
             {
-                if (!ResolveAttribute(Parser, &Instance))
-                {
-                    return false;
-                }
+                Added = AddAttributeDeclaration(Parser, &Declaration.Attribute);
+                break;
+            }
+            
+            case Imported_Alias:
+            {
+                Added = AddAttributeAlias(Parser, &Declaration.Alias);
+                break;
+            }
+            
+            case Imported_Import:
+            {
+                Added = OpenImport(Parser, &Declaration.Import, strdup(Declaration.ImportPath.c_str()));
+                break;
             }
         }
         
-        if (!BuildAttributeData(Parser, List))
+        if (!Added)
         {
             return false;
         }
     }
     
+    AppendAttributeLists(Parser, AttributeLists, &Appended, AttributeLists->size());
     return true;
 }
 
+// Adds everything the file declared, then the errors it ran into.
 static
-bool ResolveType(inspect_parser *Parser, inspect_data_item Unresolved)
+bool MergeImport(inspect_parser *Parser, import_task *Task)
 {
-    inspect_dict *UnresolvedTypeDict = Unresolved.Dict;
-    inspect_list &TypeList = *Parser->TypeInfoList.List;
+    inspect_parser *Imported = Task->Parser;
+    Task->Merged = true;
     
-    for(;;)
+    // The declarations point into the file, it has to live as long as this parser does.
+    Parser->LexerStorage.insert(Parser->LexerStorage.end(),
+                                Imported->LexerStorage.begin(),
+                                Imported->LexerStorage.end());
+    Imported->LexerStorage.clear();
+    
+    if (!ReplayDeclarations(Parser, &Task->Declarations, &Imported->UnresolvedAttributeLists))
     {
-        // We only need to resolve the innermost type of
-        // pointer or references.
-        
-        bool IsPointer = UnresolvedTypeDict->Lookup.at("IsPointer").Bool;
-        bool IsReference = UnresolvedTypeDict->Lookup.at("IsReference").Bool;
-        
-        if (IsPointer || IsReference)
-        {
-            // The first item in the type info list is the PTR type info.
-            Insert(UnresolvedTypeDict, "Info", CreateReference(TypeList[0].Dict));
-            Unresolved = UnresolvedTypeDict->Lookup.at("InnerType");
-            UnresolvedTypeDict = Unresolved.Dict;
-        }
-        else
-        {
-            break;
-        }
+        return false;
     }
     
-    const char *TypeName = UnresolvedTypeDict->Lookup.at("Name").String;
-    bool Found = false;
-    for (inspect_data_item &TypeItem : TypeList)
+    if (!Task->Errors.empty())
     {
-        const char *DeclaredTypeName = TypeItem.Dict->Lookup.at("Name").String;
-        if (strcmp(DeclaredTypeName, TypeName) == 0)
-        {
-            Found = true;
-            
-            Insert(UnresolvedTypeDict, "Info", CreateReference(TypeItem.Dict));
-            break;
-        }
+        PrintError("%s", Task->Errors.c_str());
     }
     
-    if (!Found)
+    return Task->Parsed;
+}
+
+// Adds the declarations of the file's module instead of parsing it, if it has one that
+// is up to date.
+static
+bool TryLoadModule(inspect_parser *Parser, const char *Filepath, bool *Added)
+{
+    inspect_lexer *Lexer = new inspect_lexer;
+    std::vector<imported_declaration> Declarations;
+    std::vector<attribute_list *> AttributeLists;
+    if (!LoadModule(Filepath, Lexer, &Declarations, &AttributeLists))
     {
-        PrintLocation(Unresolved.OptionalSourceToken.Line,
-                      Unresolved.OptionalSourceToken.Column,
-                      Unresolved.OptionalSourceToken.Filename);
-        printf("Unrecognized type \"%s\"\n",
-               TypeName);
+        delete Lexer;
         return false;
     }
+    
+    Parser->LexerStorage.push_back(Lexer);
+    *Added = ReplayDeclarations(Parser, &Declarations, &AttributeLists);
+    return true;
+}
 
-    inspect_list *Args = UnresolvedTypeDict->Lookup.at("Args").List;
-    for (inspect_data_item &Item : *Args)
+void ParseImportsInParallel(inspect_parser *Parser)
+{
+    import_pool *Pool = new import_pool;
+    Pool->Stop = false;
+    Pool->Reader = Parser->Reader;
+    
+    // The files parsed so far are never parsed by a task.
+    for (const std::string &Path : Parser->ParsedFiles)
     {
-        if (!ResolveType(Parser, Item))
-        {
-            return false;
-        }
+        Pool->Tasks.emplace(Path, nullptr);
     }
     
-    return true;
+    // The pool parses them, the lexer threads don't need to look ahead at them too.
+    if (Parser->Pipeline)
+    {
+        Parser->Pipeline->FollowImports.store(false, std::memory_order_relaxed);
+        StopUnclaimedLexWorkers(Parser->Pipeline);
+    }
+    
+    unsigned ThreadCount = std::thread::hardware_concurrency();
+    if (ThreadCount == 0)
+    {
+        ThreadCount = 1;
+    }
+    
+    for (unsigned I = 0; I < ThreadCount; ++I)
+    {
+        Pool->Threads.emplace_back(RunImportThread, Pool);
+    }
+    
+    Parser->ImportPool = Pool;
+    QueueImports(Pool, Parser->Lexer);
 }
 
 static
-bool ResolveTypes(inspect_parser *Parser)
+void FreeImportPool(import_pool *Pool)
 {
-    inspect_list &StructList = *Parser->StructList.List;
+    {
+        std::lock_guard<std::mutex> Guard(Pool->Lock);
+        Pool->Stop = true;
+    }
+    
+    Pool->Changed.notify_all();
+    for (std::thread &Thread : Pool->Threads)
+    {
+        Thread.join();
+    }
     
-    for (inspect_data_item &StructItem : StructList)
+    for (auto &Entry : Pool->Tasks)
     {
-        inspect_list &FieldList = *StructItem.Dict->Lookup.at("Fields").List;
+        import_task *Task = Entry.second;
+        if (!Task)
+        {
+            continue;
+        }
         
-        for (inspect_data_item &FieldItem : FieldList)
+        if (Task->Parser)
         {
-            inspect_dict *FieldDict = FieldItem.Dict;
-            inspect_data_item TypeItem = FieldDict->Lookup.at("Type");
-            if (!ResolveType(Parser, TypeItem))
+            // Only files that were never merged still have their lexer, and own what
+            // they declared.
+            for (inspect_lexer *Lexer : Task->Parser->LexerStorage)
             {
-                return false;
+                FreeLexer(Lexer);
+                delete Lexer;
             }
             
-            bool IsMethod = FieldDict->Lookup.at("IsMethod").Bool;
-            if (IsMethod)
+            if (!Task->Merged)
             {
-                inspect_list *ArgumentList = FieldDict->Lookup.at("MethodArguments").List;
-                for (inspect_data_item &ArgumentItem : *ArgumentList)
+                for (imported_declaration &Declaration : Task->Declarations)
                 {
-                    inspect_dict *ArgumentDict = ArgumentItem.Dict;
-                    inspect_data_item ArgumentType = ArgumentDict->Lookup.at("Type");
-                    if (!ResolveType(Parser, ArgumentType))
+                    if (Declaration.Kind == Imported_TypeInfo)
                     {
-                        return false;
+                        FreeDataItem(&Declaration.TypeInfo);
                     }
                 }
+                
+                for (attribute_list *List : Task->Parser->UnresolvedAttributeLists)
+                {
+                    delete List;
+                }
             }
+            
+            delete Task->Parser;
         }
-    }
-    
-    return true;
-}
-
-static inline
-void InitializeTypeInfoList(inspect_list *List)
-{
-    // Later we get the PTR type info from accessing the first
-    // element in the list.
-    // Its important that this is the first thing inserted into the list!
-    List->push_back(CreateTypeInfoItem("Pointer", "TD_PTR", nullptr));
-}
-
-bool CreateParser(const char *Filename, inspect_parser *Parser)
-{
-    inspect_lexer *NewLexer = new inspect_lexer;
-    Parser->LexerStorage.push_back(NewLexer);
-    if(!CreateLexer(Filename, NewLexer))
-    {
-        return false;
-    }
-    
-    CreateTokenStack(&Parser->Stack);
-    
-    CreateLexerStack(&Parser->LexerStack);
-    Parser->Lexer = NewLexer;
-    
-    Parser->StructList = NewListItem();
-    Parser->TypeInfoList = NewListItem();
-    InitializeTypeInfoList(Parser->TypeInfoList.List);
-    return true;
-}
-
-void FreeParser(inspect_parser *Parser)
-{
-    for(inspect_lexer *Lexer : Parser->LexerStorage)
-    {
-        FreeLexer(Lexer);
-        delete Lexer;
+        
+        delete Task;
     }
 }
 
@@ -1719,7 +2800,7 @@ bool ShouldGenerateStructs(inspect_parser *Parser)
 {
     // We only want to write out struct information
     // if we are not parsing import files.
-    return Parser->LexerStack.Top == -1;
+    return Parser->LexerStack.Top == -1 && !Parser->Task;
 }
 
 static void
@@ -1730,6 +2811,11 @@ FreeType(type *Type)
         FreeType(Type->InnerType);
         delete Type->InnerType;
     }
+    
+    for (type &Arg : Type->Args.Args)
+    {
+        FreeType(&Arg);
+    }
 }
 
 static void
@@ -1739,6 +2825,11 @@ FreeField(field *Field)
     // it doesn't belong to the field.
     
     FreeType(&Field->Type);
+    
+    for (typed_argument_declaration &Argument : Field->Arguments.Arguments)
+    {
+        FreeType(&Argument.Type);
+    }
 }
 
 static void
@@ -1750,10 +2841,14 @@ FreeStruct(defined_struct *Struct)
     }
 }
 
-bool ParseInspect(inspect_parser *Parser, inspect_data *Data)
+// Parses every top-level declaration, following imports.
+static
+bool ParseDeclarations(inspect_parser *Parser)
 {
     for(;;)
     {
+        ReleaseTokens(Parser);
+        
         if (CheckNext(Parser, ITokenType_End))
         {
             if (!ReturnFromFile(Parser))
@@ -1784,16 +2879,28 @@ bool ParseInspect(inspect_parser *Parser, inspect_data *Data)
         }
         
         defined_struct Struct;
-        if (TryParseStruct(Parser, &Struct))
+        if (CheckAt(Parser, ITokenType_Struct))
         {
+            // Past "struct" it can't be anything else. A field that fails to parse has
+            // already printed why, and the whole run fails.
+            if (!TryParseStruct(Parser, &Struct))
+            {
+                FreeStruct(&Struct);
+                return false;
+            }
+            
             inspect_data_item StructType = CreateTypeInfoItem(&Struct, PendingAttributes);
+            if (!AddTypeInfo(Parser, StructType, &Struct.Identifier))
+            {
+                FreeStruct(&Struct);
+                return false;
+            }
             
             if (ShouldGenerateStructs(Parser))
             {
                 Parser->StructList.List->push_back(CreateStructItem(&Struct, StructType.Dict, PendingAttributes));
             }
             
-            Parser->TypeInfoList.List->push_back(StructType);
             PendingAttributes = 0;
             FreeStruct(&Struct);
             
@@ -1803,20 +2910,30 @@ bool ParseInspect(inspect_parser *Parser, inspect_data *Data)
         declared_type TypeInfo;
         if (TryParseDeclareType(Parser, &TypeInfo))
         {
-            Parser->TypeInfoList.List->push_back(CreateTypeInfoItem(&TypeInfo, PendingAttributes));
+            if (!AddTypeInfo(Parser, CreateTypeInfoItem(&TypeInfo, PendingAttributes), &TypeInfo.TypeName))
+            {
+                return false;
+            }
+            
             PendingAttributes = 0;
         }
         
         attribute_alias Alias;
         if (TryParseAliasAttribute(Parser, &Alias))
         {
-            Parser->AttributeAliases.push_back(Alias);
+            if (!AddAttributeAlias(Parser, &Alias))
+            {
+                return false;
+            }
         }
         
         attribute_declaration AttributeInfo;
         if (TryParseDeclareAttribute(Parser, &AttributeInfo))
         {
-            Parser->AttributeInformation.push_back(AttributeInfo);
+            if (!AddAttributeDeclaration(Parser, &AttributeInfo))
+            {
+                return false;
+            }
         }
         
         import_file ImportFile;
@@ -1831,17 +2948,25 @@ bool ParseInspect(inspect_parser *Parser, inspect_data *Data)
         if (PendingAttributes != nullptr)
         {
             attribute_instance &First = PendingAttributes->Attributes.front();
-            PrintLocation(First.IdentifierToken.Line,
-                          First.IdentifierToken.Column,
-                          First.IdentifierToken.Filename);
-            printf("Attribute list cannot be defined here. First attribute \"%.*s\"\n",
-                   (int)First.IdentifierToken.Token.Length,
-                   First.IdentifierToken.Token.Text);
+            PrintLocation(&First.IdentifierToken);
+            PrintError("Attribute list cannot be defined here. First attribute \"%.*s\"\n",
+                       (int)First.IdentifierToken.Length,
+                       TokenText(&First.IdentifierToken));
             PendingAttributes = 0;
             return false;
         }
     }
     
+    return true;
+}
+
+bool ParseInspect(inspect_parser *Parser, inspect_data *Data)
+{
+    if (!ParseDeclarations(Parser))
+    {
+        return false;
+    }
+    
     if (!ResolveTypes(Parser))
     {
         return false;
@@ -1854,5 +2979,83 @@ bool ParseInspect(inspect_parser *Parser, inspect_data *Data)
     
     Insert(Data->GlobalScope.Dict, "Structs", &Parser->StructList);
     Insert(Data->GlobalScope.Dict, "Types", &Parser->TypeInfoList);
+    Data->AttributeHandles = Parser->AttributeIndex;
+    
+    // The model owns all of it from here on, the parser can still look at the lists.
+    Parser->StructList.IsReference = true;
+    Parser->TypeInfoList.IsReference = true;
+    
+    Data->AttributeLists.insert(Data->AttributeLists.end(),
+                                Parser->UnresolvedAttributeLists.begin(),
+                                Parser->UnresolvedAttributeLists.end());
+    Parser->UnresolvedAttributeLists.clear();
+    
+    for (auto &Entry : Parser->SharedAttributeData)
+    {
+        Data->SharedAttributeData.push_back(Entry.second);
+    }
+    
+    Parser->SharedAttributeData.clear();
+    
+    // Templates compare model strings against literals all the time.
+    FreezeModel(Data);
     return true;
 }
+
+bool CompileModule(const char *Filename)
+{
+    inspect_lexer *Lexer = new inspect_lexer;
+    if (!CreateLexer(Filename, Lexer))
+    {
+        printf("Unable to open file \"%s\"\n", Filename);
+        delete Lexer;
+        return false;
+    }
+    
+    import_task Task;
+    Task.Path = Filename;
+    
+    inspect_parser Parser;
+    InitializeTaskParser(&Parser, Lexer, &Task);
+    
+    // Some errors don't stop the parse, a module would lose them. They are collected
+    // so the file is only compiled without any.
+    ErrorCapture = &Task.Errors;
+    bool Compiled = ParseDeclarations(&Parser);
+    ErrorCapture = nullptr;
+    FreeTokenStack(&Parser.Stack);
+    
+    if (!Task.Errors.empty())
+    {
+        PrintError("%s", Task.Errors.c_str());
+        Compiled = false;
+    }
+    
+    if (Compiled)
+    {
+        std::string ModulePath = GetModulePath(Filename);
+        Compiled = WriteModule(ModulePath.c_str(), Lexer, &Task.Declarations,
+                               &Parser.UnresolvedAttributeLists);
+        if (Compiled)
+        {
+            puts(ModulePath.c_str());
+        }
+    }
+    
+    for (imported_declaration &Declaration : Task.Declarations)
+    {
+        if (Declaration.Kind == Imported_TypeInfo)
+        {
+            FreeDataItem(&Declaration.TypeInfo);
+        }
+    }
+    
+    for (attribute_list *List : Parser.UnresolvedAttributeLists)
+    {
+        delete List;
+    }
+    
+    FreeLexer(Lexer);
+    delete Lexer;
+    return Compiled;
+}
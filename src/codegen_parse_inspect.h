@@ -1,9 +1,17 @@
 #pragma once
 
 #include "codegen_lex_inspect.h"
+#include "codegen_lex_pipeline.h"
 #include "codegen_inspect_data.h"
 #include "token_stack.h"
 #include <vector>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
 
 struct type;
 struct type_args
@@ -67,6 +75,7 @@ struct lex_state
 {
     itoken_info At;
     inspect_lexer *Lexer;
+    lex_worker *Worker;
 };
 
 struct lexer_stack
@@ -93,22 +102,132 @@ struct attribute_alias
     attribute_instance Value;
 };
 
+enum imported_declaration_kind
+{
+    Imported_TypeInfo,
+    Imported_Attribute,
+    Imported_Alias,
+    Imported_Import,
+};
+
+// A top-level declaration of a file parsed on another thread, it is only added to the
+// index once every file imported before it is.
+struct imported_declaration
+{
+    imported_declaration_kind Kind;
+    
+    inspect_data_item TypeInfo; // Imported_TypeInfo, declared types and structs.
+    itoken_info Name;
+    
+    attribute_declaration Attribute;
+    attribute_alias Alias;
+    
+    import_file Import;
+    std::string ImportPath;
+    
+    // How many of the file's attribute lists were parsed by the end of this declaration.
+    size_t AttributeListsEnd;
+};
+
+enum import_task_status
+{
+    ImportTask_Queued,
+    ImportTask_Running,
+    ImportTask_Done,
+};
+
+struct inspect_parser;
+
+struct import_task
+{
+    std::string Path;
+    import_task_status Status;
+    
+    // Has its own lexer and token stack, it only records what it parses.
+    inspect_parser *Parser;
+    bool Opened;
+    bool Parsed;
+    bool Merged;
+    
+    std::vector<imported_declaration> Declarations;
+    std::string Errors;
+};
+
+// Parses every imported file on a pool of threads, see ParseImportsInParallel.
+struct import_pool
+{
+    std::mutex Lock;
+    std::condition_variable Changed;
+    bool Stop;
+    
+    // Every file that was found imported, by path. Null for files that aren't parsed by
+    // a task, like the root file.
+    std::unordered_map<std::string, import_task *> Tasks;
+    std::deque<import_task *> Queue;
+    std::vector<std::thread> Threads;
+    
+    // The parser's, called on any of the threads.
+    source_reader *Reader;
+};
+
+struct type_index_entry
+{
+    inspect_dict *Info;
+    itoken_info Declaration; // Filename is null for built in types.
+};
+
 struct inspect_parser
 {
     token_stack<itoken_info> Stack;
     
+    // Nothing looks back past the start of a top-level declaration, so normally the
+    // stack only holds the tokens of the declaration being parsed. Set this to keep every
+    // token, e.g. to lex a file up front and then parse from the stack.
+    bool RetainTokens;
+    
     std::vector<inspect_lexer *> LexerStorage;
     lexer_stack LexerStack;
     
     inspect_lexer *Lexer;
     itoken_info At;
     
+    // Only for a parser made with CreatePipelinedParser, which owns the lexers of every
+    // file through the pipeline instead of LexerStorage. Tokens of Lexer come from Worker.
+    lex_pipeline *Pipeline;
+    lex_worker *Worker;
+    
+    // Only for a parser that ParseImportsInParallel was called on.
+    import_pool *ImportPool;
+    
+    // Null to read files from disk, see CreateParser.
+    source_reader *Reader;
+    
+    // Set on the parser of an imported file parsed by the pool. The declarations are
+    // recorded in the task instead of added, the parser that imported it adds them.
+    import_task *Task;
+    
     inspect_data_item StructList;
     inspect_data_item TypeInfoList;
+    std::unordered_map<std::string, type_index_entry> TypeIndex;
     std::vector<attribute_declaration> AttributeInformation;
+    std::unordered_map<std::string, attribute_handle> AttributeIndex;
     
     std::vector<attribute_list *> UnresolvedAttributeLists;
     std::vector<attribute_alias> AttributeAliases;
+    std::unordered_map<std::string, size_t> AliasIndex;
+    
+    // Resolved attribute data keyed by attribute handle and argument values. Every
+    // attribute list with an identical attribute (or the same alias) references the
+    // one immutable dict in here. ParseInspect hands these, the attribute lists and the
+    // struct and type lists over to the model.
+    std::unordered_map<std::string, inspect_dict *> SharedAttributeData;
+    
+    // Threads types and attributes are resolved on, 0 for one per core.
+    unsigned ResolveThreads;
+    
+    // Paths of every file parsed so far, so each file is only parsed once no matter
+    // how many times it is imported.
+    std::unordered_set<std::string> ParsedFiles;
 };
 
 bool ParseInspect(inspect_parser *Parser, inspect_data *Data);
@@ -123,7 +242,38 @@ static inline
 void FreeInspectData(inspect_data *Data)
 {
     FreeDataItem(&Data->GlobalScope);
+    
+    for (inspect_dict *Dict : Data->SharedAttributeData)
+    {
+        FreeInspectDict(Dict);
+        delete Dict;
+    }
+    
+    for (attribute_list *List : Data->AttributeLists)
+    {
+        delete List;
+    }
+    
+    Data->SharedAttributeData.clear();
+    Data->AttributeLists.clear();
+    
+    FreeInternTable(&Data->Strings);
 }
 
-bool CreateParser(const char *Filename, inspect_parser *Parser);
-void FreeParser(inspect_parser *Parser);
\ No newline at end of file
+// Files are read through Reader if there is one, for sources that aren't on disk. Modules
+// are files too, so imports are always parsed then.
+bool CreateParser(const char *Filename, inspect_parser *Parser, source_reader *Reader = nullptr);
+
+// Lexes every file on its own thread while parsing, imports start being lexed as soon as
+// the import is lexed. Only worth it for very large files, the result is the same.
+bool CreatePipelinedParser(const char *Filename, inspect_parser *Parser);
+
+// Imports are then parsed on a pool of threads as soon as they are found, and added in
+// the order they are imported when the parser gets to them. Errors and output are the
+// same as when parsing them one after another.
+void ParseImportsInParallel(inspect_parser *Parser);
+void FreeParser(inspect_parser *Parser);
+
+// Parses Filename on its own and writes its module next to it, see codegen_module.h.
+// Imports of the file load the module instead of parsing it from then on.
+bool CompileModule(const char *Filename);
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "codegen_parse_base.h"
 #include "codegen_inspect_data.h"
 #include "codegen_parse_inspect.h"
+#include "codegen_parse_write.h"
 #include "token_stack.h"
 #include "compiler_utils.h"
 
@@ -43,21 +44,10 @@ parser_state SaveParserInfo(write_parser *Parser);
 static inline
 void RestoreParserInfo(write_parser *Parser, parser_state *State);
 
-bool CreateParser(write_parser *Parser, const char *Filename, const char *OutputFilename)
+// Sets up the state that is per template.
+static
+void StartTemplate(write_parser *Parser)
 {
-    if (!CreateLexer(&Parser->Lexer, Filename))
-    {
-        return false;
-    }
-    
-    CreateTokenStack(&Parser->Stack);
-    
-    Parser->Output = fopen(OutputFilename, "w");
-    if (!Parser->Output)
-    {
-        return false;
-    }
-    
     Parser->AutoClearNewLineStack = 0;
     Parser->AutoClearNewLineTop = 0;
     Parser->TabsToRemove = 0;
@@ -70,17 +60,116 @@ bool CreateParser(write_parser *Parser, const char *Filename, const char *Output
     Parser->Flags = 0;
     Parser->Flags |= (WP_ShouldAdjustTabs | WP_UseSpacesInsteadOfTabs); // should be an option?
     
+    Parser->Probe.Offset = -1;
+    Parser->Probe.Hit = false;
+    Parser->Probe.HasModel = false;
+    
+    Parser->LValueOwner = nullptr;
+}
+
+static
+bool StartTemplate(write_parser *Parser, const char *OutputFilename)
+{
+    Parser->Output = fopen(OutputFilename, "w");
+    if (!Parser->Output)
+    {
+        return false;
+    }
+    
+    Parser->OutputText = nullptr;
+    StartTemplate(Parser);
+    return true;
+}
+
+static
+void StartTemplate(write_parser *Parser, std::string *OutputText)
+{
+    Parser->Output = nullptr;
+    Parser->OutputText = OutputText;
+    OutputText->clear();
+    StartTemplate(Parser);
+}
+
+static
+void InitializeParser(write_parser *Parser)
+{
+    CreateTokenStack(&Parser->Stack);
+    
     Parser->OutputBufferSize = DEFAULT_OUTPUT_SIZE;
     Parser->OutputBuffer = (char *)malloc(Parser->OutputBufferSize);
+}
+
+bool CreateParser(write_parser *Parser, const char *Filename, const char *OutputFilename)
+{
+    if (!CreateLexer(&Parser->Lexer, Filename))
+    {
+        return false;
+    }
     
+    InitializeParser(Parser);
+    return StartTemplate(Parser, OutputFilename);
+}
+
+bool CreateParser(write_parser *Parser, const char *Filename, source_reader *Reader,
+                  std::string *Output)
+{
+    if (!CreateLexer(&Parser->Lexer, Filename, Reader))
+    {
+        return false;
+    }
+    
+    InitializeParser(Parser);
+    StartTemplate(Parser, Output);
     return true;
 }
 
+// Everything that was cached about the previous template points into its tokens.
+static
+void ReplaceTemplate(write_parser *Parser, write_lexer *Lexer)
+{
+    FreeLexer(&Parser->Lexer);
+    Parser->Lexer = *Lexer;
+    
+    ResetTokenStack(&Parser->Stack);
+    Parser->AttributeHandleCache.clear();
+    Parser->LookupCache.clear();
+    Parser->StringLiteralCache.clear();
+    FreeInternTable(&Parser->Literals);
+}
+
+// Moves a parser that already evaluated a template on to the next one, keeping the
+// token chunks and the output buffer. Closing the previous output is up to the caller.
+bool ResetParser(write_parser *Parser, const char *Filename, const char *OutputFilename)
+{
+    write_lexer Lexer;
+    if (!CreateLexer(&Lexer, Filename))
+    {
+        return false;
+    }
+    
+    ReplaceTemplate(Parser, &Lexer);
+    return StartTemplate(Parser, OutputFilename);
+}
+
+bool ResetParser(write_parser *Parser, const char *Filename, source_reader *Reader,
+                 std::string *Output)
+{
+    write_lexer Lexer;
+    if (!CreateLexer(&Lexer, Filename, Reader))
+    {
+        return false;
+    }
+    
+    ReplaceTemplate(Parser, &Lexer);
+    StartTemplate(Parser, Output);
+    return true;
+}
 
 void FreeParser(write_parser *Parser)
 {
     FreeLexer(&Parser->Lexer);
     FreeTokenStack(&Parser->Stack);
+    FreeInternTable(&Parser->Literals);
     
     free(Parser->OutputBuffer);
 }
@@ -88,7 +177,7 @@ void FreeParser(write_parser *Parser)
 static inline
 wtoken_info Current(write_parser *Parser)
 {
-    return Parser->Stack.Tokens[Parser->Stack.Top];
+    return TokenAt(&Parser->Stack, Parser->Stack.Top);
 }
 
 static
@@ -99,26 +188,24 @@ bool PushToken(write_parser *Parser, wtoken_info *Result)
     if (Parser->Stack.Top < Parser->Stack.Populated)
     {
         // Have already added this token.
-        *Result = Parser->Stack.Tokens[Parser->Stack.Top];
+        *Result = TokenAt(&Parser->Stack, Parser->Stack.Top);
         return true;
     }
     
     if (Parser->Stack.Top == Parser->Stack.Capacity)
     {
-        Resize(&Parser->Stack);
+        Grow(&Parser->Stack);
     }
     
     NextTokenInfo(&Parser->Lexer, Result);
-    if (Result->Token.Type == WTokenType_IncompleteString)
+    if (Result->Type == WTokenType_IncompleteString)
     {
-        PrintLocation(Parser->Lexer.Line,
-                      Parser->Lexer.Column,
-                      Parser->Lexer.Filename);
-        printf("Incomplete string\n");
+        PrintLocation(Result);
+        PrintError("Incomplete string\n");
         return false;
     }
     
-    Parser->Stack.Tokens[Parser->Stack.Top] = *Result;
+    TokenAt(&Parser->Stack, Parser->Stack.Top) = *Result;
     ++Parser->Stack.Populated;
     return true;
 }
@@ -147,8 +234,8 @@ static constexpr char *ListSizeKeyword = "Size";
 static inline
 bool GetListVariable(wtoken_info *Identifier, inspect_list *List, inspect_data_item *Result)
 {
-    if (ConstexprStrlen(ListSizeKeyword) == Identifier->Token.Length &&
-        strncmp(ListSizeKeyword, Identifier->Token.Text, Identifier->Token.Length) == 0)
+    if (ConstexprStrlen(ListSizeKeyword) == Identifier->Length &&
+        strncmp(ListSizeKeyword, TokenText(Identifier), Identifier->Length) == 0)
     {
         *Result = NewIntItem((int)List->size());
         return true;
@@ -157,12 +244,49 @@ bool GetListVariable(wtoken_info *Identifier, inspect_list *List, inspect_data_i
     return false;
 }
 
+// Only dicts with a shape are cached, scopes change from one evaluation to the next.
 static inline
-bool GetVariable(wtoken_info *Identifier, inspect_data_item *Scope, inspect_data_item *Result)
+bool LookupCached(write_parser *Parser, inspect_dict *Dict, wtoken_info *Identifier,
+                  int TokenIndex, inspect_data_item *Result, inspect_dict **Owner)
 {
+    if (Dict->Shape == Shape_None)
+    {
+        return Lookup(Dict, Identifier, Result, Owner);
+    }
+    
+    std::vector<lookup_cache_entry> &Cache = Parser->LookupCache;
+    if ((size_t)TokenIndex >= Cache.size())
+    {
+        Cache.resize((size_t)TokenIndex + 1, { Shape_None, -1 });
+    }
+    
+    lookup_cache_entry &Entry = Cache[(size_t)TokenIndex];
+    if (Entry.Shape != Dict->Shape)
+    {
+        Entry.Shape = Dict->Shape;
+        Entry.Slot = FindSlot(Dict, TokenText(Identifier), Identifier->Length);
+    }
+    
+    if (Entry.Slot >= 0 && IsSlotSet(Dict, (uint32)Entry.Slot))
+    {
+        *Result = BorrowItem(&Dict->Slots[(size_t)Entry.Slot]);
+        *Owner = Dict;
+        return true;
+    }
+    
+    return Lookup(Dict, Identifier, Result, Owner);
+}
+
+// Owner is the dict the variable is in, or null if it isn't an L-Value. TokenIndex is
+// the index of the identifier.
+static inline
+bool GetVariable(write_parser *Parser, wtoken_info *Identifier, int TokenIndex,
+                 inspect_data_item *Scope, inspect_data_item *Result, inspect_dict **Owner)
+{
+    *Owner = nullptr;
     if (Scope->Type == Type_Dict)
     {
-        return Lookup(Scope->Dict, &Identifier->Token, Result);
+        return LookupCached(Parser, Scope->Dict, Identifier, TokenIndex, Result, Owner);
     }
     else if (Scope->Type == Type_List)
     {
@@ -180,8 +304,8 @@ bool GetVariable(wtoken_info *Identifier, inspect_data_item *Scope, inspect_data
 static
 void HandleUnexpectedEnd(wtoken_info *Info)
 {
-    PrintLocation(Info->Line, Info->Column, Info->Filename);
-    printf("Unexpected end of file.\n");
+    PrintLocation(Info);
+    PrintError("Unexpected end of file.\n");
 }
 
 static
@@ -198,28 +322,28 @@ bool TryEvaluateReference(write_parser *Parser,
 
 static void HandleFailedVariablePathResolution(wtoken_info AfterDot)
 {
-    PrintLocation(AfterDot.Line, AfterDot.Column, AfterDot.Filename);
-    if (AfterDot.Token.Type == WTokenType_Identifier)
+    PrintLocation(&AfterDot);
+    if (AfterDot.Type == WTokenType_Identifier)
     {
-        printf("Invalid identifier \"%.*s\"\n",
-               (int)AfterDot.Token.Length,
-               AfterDot.Token.Text);
+        PrintError("Invalid identifier \"%.*s\"\n",
+                   (int)AfterDot.Length,
+                   TokenText(&AfterDot));
     }
     else
     {
-        printf("Expected identifier\n");
+        PrintError("Expected identifier\n");
     }
 }
 
 static inline
 bool IsScopeStarter(wtoken_info *Token)
 {
-    return Token->Token.Type == WTokenType_ForEach ||
-        Token->Token.Type == WTokenType_For ||
-        Token->Token.Type == WTokenType_If ||
-        Token->Token.Type == WTokenType_Define ||
-        Token->Token.Type == WTokenType_Definitions ||
-        Token->Token.Type == WTokenType_BeginTab;
+    return Token->Type == WTokenType_ForEach ||
+        Token->Type == WTokenType_For ||
+        Token->Type == WTokenType_If ||
+        Token->Type == WTokenType_Define ||
+        Token->Type == WTokenType_Definitions ||
+        Token->Type == WTokenType_BeginTab;
 }
 
 static inline
@@ -231,10 +355,10 @@ bool SkipPastMatchingEnd(write_parser *Parser)
     int ScopesStarted = 0;
     for (;;)
     {
-        if (Next.Token.Type == WTokenType_EOF)
+        if (Next.Type == WTokenType_EOF)
         {
-            PrintLocation(Begin.Line, Begin.Column, Begin.Filename);
-            printf("EOF reached before scope closed. Are you missing an end?\n");
+            PrintLocation(&Begin);
+            PrintError("EOF reached before scope closed. Are you missing an end?\n");
             return false;
         }
         
@@ -243,7 +367,7 @@ bool SkipPastMatchingEnd(write_parser *Parser)
             ++ScopesStarted;
         }
         
-        if (Next.Token.Type == WTokenType_End)
+        if (Next.Type == WTokenType_End)
         {
             if (ScopesStarted == 0)
             {
@@ -279,7 +403,7 @@ bool TryEvaluateDefine(write_parser *Parser,
                        inspect_dict *Scope)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_Define)
+    if (CurrentToken.Type != WTokenType_Define)
     {
         return false;
     }
@@ -290,10 +414,10 @@ bool TryEvaluateDefine(write_parser *Parser,
         return false;
     }
     
-    if (Name.Token.Type != WTokenType_Identifier)
+    if (Name.Type != WTokenType_Identifier)
     {
-        PrintLocation(Name.Line, Name.Column, Name.Filename);
-        printf("Invalid identifier \"%.*s\"\n", (int)Name.Token.Length, Name.Token.Text);
+        PrintLocation(&Name);
+        PrintError("Invalid identifier \"%.*s\"\n", (int)Name.Length, TokenText(&Name));
         return false;
     }
     
@@ -302,7 +426,7 @@ bool TryEvaluateDefine(write_parser *Parser,
         return false;
     }
     
-    if (CurrentToken.Token.Type != WTokenType_LeftParen)
+    if (CurrentToken.Type != WTokenType_LeftParen)
     {
         return false;
     }
@@ -315,17 +439,17 @@ bool TryEvaluateDefine(write_parser *Parser,
     inspect_data_item ProcedureItem = NewProcedureItem();
     inspect_procedure &Procedure = *ProcedureItem.Procedure;
     
-    if (CurrentToken.Token.Type != WTokenType_RightParen)
+    if (CurrentToken.Type != WTokenType_RightParen)
     {
         for (;;)
         {
-            if (CurrentToken.Token.Type != WTokenType_Identifier)
+            if (CurrentToken.Type != WTokenType_Identifier)
             {
                 FreeDataItem(&ProcedureItem);
-                PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-                printf("Expected identifier, got \"%.*s\"\n",
-                       (int)CurrentToken.Token.Length,
-                       CurrentToken.Token.Text);
+                PrintLocation(&CurrentToken);
+                PrintError("Expected identifier, got \"%.*s\"\n",
+                           (int)CurrentToken.Length,
+                           TokenText(&CurrentToken));
                 return false;
             }
             
@@ -337,28 +461,30 @@ bool TryEvaluateDefine(write_parser *Parser,
                 return false;
             }
             
-            if (CurrentToken.Token.Type == WTokenType_RightParen)
+            if (CurrentToken.Type == WTokenType_RightParen)
             {
                 if (!PushToken(Parser, &CurrentToken))
                 {
+                    FreeDataItem(&ProcedureItem);
                     return false;
                 }
                 
                 break;
             }
             
-            if (CurrentToken.Token.Type != WTokenType_Comma)
+            if (CurrentToken.Type != WTokenType_Comma)
             {
                 FreeDataItem(&ProcedureItem);
-                PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-                printf("Expected \",\", got \"%.*s\"\n",
-                       (int)CurrentToken.Token.Length,
-                       CurrentToken.Token.Text);
+                PrintLocation(&CurrentToken);
+                PrintError("Expected \",\", got \"%.*s\"\n",
+                           (int)CurrentToken.Length,
+                           TokenText(&CurrentToken));
                 return false;
             }
             
             if (!PushToken(Parser, &CurrentToken))
             {
+                FreeDataItem(&ProcedureItem);
                 return false;
             }
         }
@@ -367,6 +493,7 @@ bool TryEvaluateDefine(write_parser *Parser,
     {
         if (!PushToken(Parser, &CurrentToken))
         {
+            FreeDataItem(&ProcedureItem);
             return false;
         }
     }
@@ -381,7 +508,7 @@ bool TryEvaluateDefine(write_parser *Parser,
         return false;
     }
     
-    Insert(Scope, &Name.Token, &ProcedureItem);
+    Insert(Scope, &Name, &ProcedureItem);
     return true;
 }
 
@@ -391,7 +518,7 @@ bool TryEvaluateParanthesis(write_parser *Parser,
                             inspect_data_item *Result)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_LeftParen)
+    if (CurrentToken.Type != WTokenType_LeftParen)
     {
         return false;
     }
@@ -409,10 +536,10 @@ bool TryEvaluateParanthesis(write_parser *Parser,
     
     wtoken_info RightParen = Current(Parser);
     
-    if (RightParen.Token.Type != WTokenType_RightParen)
+    if (RightParen.Type != WTokenType_RightParen)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf("Unmatched parenthesis\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Unmatched parenthesis\n");
         return false;
     }
     
@@ -426,7 +553,7 @@ bool TryEvaluateParanthesis(write_parser *Parser,
 
 #if 0
 static inline
-bool CompareCStringAndToken(const char *CString, write_token *Token)
+bool CompareCStringAndToken(const char *CString, wtoken_info *Token)
 {
     size_t I;
     for (I = 0; I < Token->Length; ++I)
@@ -436,7 +563,7 @@ bool CompareCStringAndToken(const char *CString, write_token *Token)
             return false;
         }
         
-        if (CString[I] != Token->Text[I])
+        if (CString[I] != TokenText(Token)[I])
         {
             return false;
         }
@@ -453,7 +580,7 @@ bool TryEvaluateIndexer(write_parser *Parser,
                         inspect_data_item *Result)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_LeftSquare)
+    if (CurrentToken.Type != WTokenType_LeftSquare)
     {
         return false;
     }
@@ -473,35 +600,34 @@ bool TryEvaluateIndexer(write_parser *Parser,
     if (Indice.Type != Type_Int &&
         Indice.Type != Type_String)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf ("Invalid index. Expression must evaluate to an integer or a string.\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Invalid index. Expression must evaluate to an integer or a string.\n");
         return false;
     }
     
     inspect_data_item Indexed;
     if (Indice.Type == Type_Int)
     {
-        Indexed = ToIndex->List->at((size_t)Indice.Int);
+        Indexed = BorrowItem(&ToIndex->List->at((size_t)Indice.Int));
     }
     else // Indice.Type == Type_String
     {
         // Look up the attribute value
-        if (!Lookup(&ToIndex->Attributes->AttributeData, Indice.String, &Indexed))
+        if (ToIndex->Type != Type_Dict || !ToIndex->Dict->Attributes ||
+            !Lookup(&ToIndex->Dict->Attributes->AttributeData, Indice.String, Indice.StringLength, &Indexed))
         {
-            PrintLocation(CurrentToken.Line,
-                          CurrentToken.Column,
-                          CurrentToken.Filename);
-            printf ("Unable to find attribute \"%s\"\n", Indexed.String);
+            PrintLocation(&CurrentToken);
+            PrintError("Unable to find attribute \"%.*s\"\n", (int)Indice.StringLength, Indice.String);
             return false;
         }
     }
     
     CurrentToken = Current(Parser);
     
-    if (CurrentToken.Token.Type != WTokenType_RightSquare)
+    if (CurrentToken.Type != WTokenType_RightSquare)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf("Expected \"]\"\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Expected \"]\"\n");
         return false;
     }
     
@@ -510,7 +636,7 @@ bool TryEvaluateIndexer(write_parser *Parser,
         return false;
     }
     
-    if (CurrentToken.Token.Type == WTokenType_Dot)
+    if (CurrentToken.Type == WTokenType_Dot)
     {
         if (!PushToken(Parser))
         {
@@ -542,14 +668,16 @@ bool TryEvaluateReference(write_parser *Parser,
                           inspect_data_item *Result)
 {
     wtoken_info Identifier = Current(Parser);
+    int IdentifierIndex = Parser->Stack.Top;
     
-    if (Identifier.Token.Type != WTokenType_Identifier)
+    if (Identifier.Type != WTokenType_Identifier)
     {
         return false;
     }
     
     inspect_data_item IdentifierItem;
-    if (!GetVariable(&Identifier, PathScope, &IdentifierItem))
+    inspect_dict *Owner;
+    if (!GetVariable(Parser, &Identifier, IdentifierIndex, PathScope, &IdentifierItem, &Owner))
     {
         return false;
     }
@@ -564,7 +692,7 @@ bool TryEvaluateReference(write_parser *Parser,
     {
         return true;
     }
-    else if (Next.Token.Type == WTokenType_Dot)
+    else if (Next.Type == WTokenType_Dot)
     {
         wtoken_info AfterDot;
         if (!PushToken(Parser, &AfterDot))
@@ -584,30 +712,46 @@ bool TryEvaluateReference(write_parser *Parser,
     else
     {
         *Result = IdentifierItem;
+        if (Owner)
+        {
+            Result->IsLValue = true;
+            Parser->LValueOwner = Owner;
+            Parser->LValueName = Identifier;
+        }
         
         return true;
     }
 }
 
+static inline
+std::string GetLValueName(write_parser *Parser)
+{
+    return StringFromToken(&Parser->LValueName);
+}
+
+// The model is shared by every render of it, so what came from it is still an L-Value but
+// can't be stored into.
 static
-std::string FindLValueName(inspect_data_item *Item)
+bool CheckLValueWritable(write_parser *Parser, wtoken_info *Operator)
 {
-    // NOTE(Brian): We should have confirmed that this item is
-    // and L-Value before we called this function.
-    assert(Item->Owner != nullptr);
-    
-    for (auto It = Item->Owner->Lookup.begin(); It != Item->Owner->Lookup.end(); It++)
+    if (Parser->LValueOwner->ReadOnly)
     {
-        if (It->second.UID == Item->UID)
-        {
-            return It->first;
-        }
+        PrintLocation(Operator);
+        PrintError("Can't assign to \"%.*s\", model values are read-only\n",
+                   (int)Parser->LValueName.Length,
+                   TokenText(&Parser->LValueName));
+        return false;
     }
     
-    // NOTE(Brian): We shouldn't be calling this function unless we know the value
-    // in the dictionary.
-    assert(false);
-    return {};
+    return true;
+}
+
+// Operands of the same builtin type are the common case, operators evaluate those
+// themselves and only go through the type's operation interface for the rest.
+static inline
+bool BothOfType(inspect_data_item *Left, inspect_data_item *Right, inspect_item_type Type)
+{
+    return Left->Type == Type && Right->Type == Type;
 }
 
 static
@@ -615,10 +759,10 @@ void PrintInvalidOperation(wtoken_info *ExpressionToken,
                            inspect_data_item *ExpressionItem,
                            const char *Operator)
 {
-    PrintLocation(ExpressionToken->Line, ExpressionToken->Column, ExpressionToken->Filename);
-    printf("Operator \"%s\" not valid on type \"%s\"\n",
-           Operator,
-           InspectItemTypeToString(ExpressionItem->Type));
+    PrintLocation(ExpressionToken);
+    PrintError("Operator \"%s\" not valid on type \"%s\"\n",
+               Operator,
+               InspectItemTypeToString(ExpressionItem->Type));
 }
 
 static
@@ -626,20 +770,20 @@ void PrintInvalidCast(inspect_item_type Type,
                       inspect_data_item *Item,
                       wtoken_info *ItemToken)
 {
-    PrintLocation(ItemToken->Line, ItemToken->Column, ItemToken->Filename);
-    printf("Invalid cast from type \"%s\" to \"%s\"\n",
-           InspectItemTypeToString(Type),
-           InspectItemTypeToString(Item->Type));
+    PrintLocation(ItemToken);
+    PrintError("Invalid cast from type \"%s\" to \"%s\"\n",
+               InspectItemTypeToString(Type),
+               InspectItemTypeToString(Item->Type));
 }
 
 inline static
 int NumberTokenToInt(wtoken_info *Number)
 {
     int final = 0;
-    for (size_t i = 0; i < Number->Token.Length; ++i)
+    for (size_t i = 0; i < Number->Length; ++i)
     {
         final *= 10;
-        final += (Number->Token.Text[i] - 48);
+        final += (TokenText(Number)[i] - 48);
     }
     
     return final;
@@ -650,13 +794,12 @@ bool TryParseIntegerLiteral(write_parser *Parser,
                             inspect_data_item *Result)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_Number)
+    if (CurrentToken.Type != WTokenType_Number)
     {
         return false;
     }
     
     *Result = NewIntItem(NumberTokenToInt(&CurrentToken));
-    Parser->ItemStack.PushItem(*Result);
     return PushToken(Parser);
 }
 
@@ -665,13 +808,31 @@ bool TryParseStringLiteral(write_parser *Parser,
                            inspect_data_item *Result)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_String)
+    if (CurrentToken.Type != WTokenType_String)
     {
         return false;
     }
     
-    *Result = NewStringItem(&CurrentToken);
-    Parser->ItemStack.PushItem(*Result);
+    std::vector<inspect_data_item> &Cache = Parser->StringLiteralCache;
+    size_t TokenIndex = (size_t)Parser->Stack.Top;
+    if (TokenIndex >= Cache.size())
+    {
+        Cache.resize(TokenIndex + 1, NewVoidItem());
+    }
+    
+    if (Cache[TokenIndex].Type != Type_String)
+    {
+        // A literal that isn't in the model's table can't equal any of the model's
+        // strings, so comparing by pointer still works with two tables.
+        char *Text = TokenText(&CurrentToken);
+        inspect_data_item &Literal = Cache[TokenIndex];
+        if (!FindInternedString(Parser->ModelStrings, Text, CurrentToken.Length, &Literal))
+        {
+            Literal = InternString(&Parser->Literals, Text, CurrentToken.Length);
+        }
+    }
+    
+    *Result = Cache[TokenIndex];
     return PushToken(Parser);
 }
 
@@ -712,7 +873,7 @@ bool TryEvaluatePreIncrement(write_parser *Parser,
                              inspect_data_item *Result)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_PlusPlus)
+    if (CurrentToken.Type != WTokenType_PlusPlus)
     {
         return TryEvaluateSimple(Parser, Scope, Result);
     }
@@ -729,14 +890,19 @@ bool TryEvaluatePreIncrement(write_parser *Parser,
         return false;
     }
     
-    if (ToIncrement.Owner == nullptr)
+    if (!ToIncrement.IsLValue)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf ("Pre-increment must be followed by an L-Value\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Pre-increment must be followed by an L-Value\n");
         return false;
     }
     
-    inspect_data_operation_interface *Interface = GetInterface(ToIncrement.Type);
+    if (!CheckLValueWritable(Parser, &CurrentToken))
+    {
+        return false;
+    }
+    
+    const inspect_data_operation_interface *Interface = GetInterface(ToIncrement.Type);
     if (!Interface->CanExecuteOperation(Increment_Op))
     {
         PrintInvalidOperation(&CurrentToken, &ToIncrement, "++");
@@ -745,9 +911,9 @@ bool TryEvaluatePreIncrement(write_parser *Parser,
     
     *Result = Interface->Increment(&ToIncrement);
     
-    std::string AssignmentName = FindLValueName(&ToIncrement);
-    FreeIfExists(ToIncrement.Owner, AssignmentName.c_str());
-    Insert(ToIncrement.Owner, AssignmentName.c_str(), Result);
+    std::string AssignmentName = GetLValueName(Parser);
+    FreeIfExists(Parser->LValueOwner, AssignmentName.c_str());
+    Insert(Parser->LValueOwner, AssignmentName.c_str(), Result);
     NewFrame.TryReleaseItem(Result); // NOTE(Brian): The item is now "owned" by the scope.
     
     return true;
@@ -759,7 +925,7 @@ bool TryEvaluatePreDecrement(write_parser *Parser,
                              inspect_data_item *Result)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_MinusMinus)
+    if (CurrentToken.Type != WTokenType_MinusMinus)
     {
         return TryEvaluatePreIncrement(Parser, Scope, Result);
     }
@@ -776,14 +942,19 @@ bool TryEvaluatePreDecrement(write_parser *Parser,
         return false;
     }
     
-    if (ToIncrement.Owner == nullptr)
+    if (!ToIncrement.IsLValue)
+    {
+        PrintLocation(&CurrentToken);
+        PrintError("Pre-decrement must be followed by an L-Value\n");
+        return false;
+    }
+    
+    if (!CheckLValueWritable(Parser, &CurrentToken))
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf ("Pre-decrement must be followed by an L-Value\n");
         return false;
     }
     
-    inspect_data_operation_interface *Interface = GetInterface(ToIncrement.Type);
+    const inspect_data_operation_interface *Interface = GetInterface(ToIncrement.Type);
     if (!Interface->CanExecuteOperation(Increment_Op))
     {
         PrintInvalidOperation(&CurrentToken, &ToIncrement, "--");
@@ -792,9 +963,9 @@ bool TryEvaluatePreDecrement(write_parser *Parser,
     
     *Result = Interface->Decrement(&ToIncrement);
     
-    std::string AssignmentName = FindLValueName(&ToIncrement);
-    FreeIfExists(ToIncrement.Owner, AssignmentName.c_str());
-    Insert(ToIncrement.Owner, AssignmentName.c_str(), Result);
+    std::string AssignmentName = GetLValueName(Parser);
+    FreeIfExists(Parser->LValueOwner, AssignmentName.c_str());
+    Insert(Parser->LValueOwner, AssignmentName.c_str(), Result);
     NewFrame.TryReleaseItem(Result); // NOTE(Brian): The item is now "owned" by the scope.
     
     return true;
@@ -812,20 +983,25 @@ bool TryEvaluatePostIncrement(write_parser *Parser,
     }
     
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_MinusMinus)
+    if (CurrentToken.Type != WTokenType_MinusMinus)
     {
         *Result = ToIncrement;
         return true;
     }
     
-    if (ToIncrement.Owner == nullptr)
+    if (!ToIncrement.IsLValue)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf ("Post-decrement must be preceded by an L-Value\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Post-decrement must be preceded by an L-Value\n");
         return false;
     }
     
-    inspect_data_operation_interface *Interface = GetInterface(ToIncrement.Type);
+    if (!CheckLValueWritable(Parser, &CurrentToken))
+    {
+        return false;
+    }
+    
+    const inspect_data_operation_interface *Interface = GetInterface(ToIncrement.Type);
     if (!Interface->CanExecuteOperation(Increment_Op))
     {
         PrintInvalidOperation(&CurrentToken, &ToIncrement, "--");
@@ -835,9 +1011,9 @@ bool TryEvaluatePostIncrement(write_parser *Parser,
     *Result = ToIncrement;
     inspect_data_item NewValue = Interface->Decrement(&ToIncrement);
     
-    std::string AssignmentName = FindLValueName(&ToIncrement);
-    FreeIfExists(ToIncrement.Owner, AssignmentName.c_str());
-    Insert(ToIncrement.Owner, AssignmentName.c_str(), &NewValue);
+    std::string AssignmentName = GetLValueName(Parser);
+    FreeIfExists(Parser->LValueOwner, AssignmentName.c_str());
+    Insert(Parser->LValueOwner, AssignmentName.c_str(), &NewValue);
     
     return PushToken(Parser);
 }
@@ -854,20 +1030,25 @@ bool TryEvaluatePostDecrement(write_parser *Parser,
     }
     
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_MinusMinus)
+    if (CurrentToken.Type != WTokenType_MinusMinus)
     {
         *Result = ToDecrement;
         return true;
     }
     
-    if (ToDecrement.Owner == nullptr)
+    if (!ToDecrement.IsLValue)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf ("Post-decrement must be preceded by an L-Value\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Post-decrement must be preceded by an L-Value\n");
         return false;
     }
     
-    inspect_data_operation_interface *Interface = GetInterface(ToDecrement.Type);
+    if (!CheckLValueWritable(Parser, &CurrentToken))
+    {
+        return false;
+    }
+    
+    const inspect_data_operation_interface *Interface = GetInterface(ToDecrement.Type);
     if (!Interface->CanExecuteOperation(Decrement_Op))
     {
         PrintInvalidOperation(&CurrentToken, &ToDecrement, "--");
@@ -877,9 +1058,9 @@ bool TryEvaluatePostDecrement(write_parser *Parser,
     *Result = ToDecrement;
     inspect_data_item NewValue = Interface->Decrement(&ToDecrement);
     
-    std::string AssignmentName = FindLValueName(&ToDecrement);
-    FreeIfExists(ToDecrement.Owner, AssignmentName.c_str());
-    Insert(ToDecrement.Owner, AssignmentName.c_str(), &NewValue);
+    std::string AssignmentName = GetLValueName(Parser);
+    FreeIfExists(Parser->LValueOwner, AssignmentName.c_str());
+    Insert(Parser->LValueOwner, AssignmentName.c_str(), &NewValue);
     
     return PushToken(Parser);
 }
@@ -890,7 +1071,7 @@ bool TryEvaluateNegative(write_parser *Parser,
                          inspect_data_item *Result)
 {
     wtoken_info LeftToken = Current(Parser);
-    if (LeftToken.Token.Type != WTokenType_Minus)
+    if (LeftToken.Type != WTokenType_Minus)
     {
         return TryEvaluatePostDecrement(Parser, Scope, Result);
     }
@@ -901,7 +1082,7 @@ bool TryEvaluateNegative(write_parser *Parser,
         return false;
     }
     
-    if (Next.Token.Type == WTokenType_EOF)
+    if (Next.Type == WTokenType_EOF)
     {
         HandleUnexpectedEnd(&Next);
         return false;
@@ -913,7 +1094,13 @@ bool TryEvaluateNegative(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *Interface = GetInterface(RightItem.Type);
+    if (RightItem.Type == Type_Int)
+    {
+        *Result = NewIntItem(-RightItem.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *Interface = GetInterface(RightItem.Type);
     if (!Interface->CanExecuteOperation(Negative_Op))
     {
         PrintInvalidOperation(&LeftToken, &RightItem, "-");
@@ -930,7 +1117,7 @@ bool TryEvaluateNot(write_parser *Parser,
                     inspect_data_item *Result)
 {
     wtoken_info LeftToken = Current(Parser);
-    if (LeftToken.Token.Type != WTokenType_Exclamation)
+    if (LeftToken.Type != WTokenType_Exclamation)
     {
         return TryEvaluateNegative(Parser, Scope, Result);
     }
@@ -941,7 +1128,7 @@ bool TryEvaluateNot(write_parser *Parser,
         return false;
     }
     
-    if (Next.Token.Type == WTokenType_EOF)
+    if (Next.Type == WTokenType_EOF)
     {
         HandleUnexpectedEnd(&Next);
         return false;
@@ -953,7 +1140,13 @@ bool TryEvaluateNot(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *Interface = GetInterface(RightItem.Type);
+    if (RightItem.Type == Type_Bool)
+    {
+        *Result = NewBoolItem(!RightItem.Bool);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *Interface = GetInterface(RightItem.Type);
     if (!Interface->CanExecuteOperation(Not_Op))
     {
         PrintInvalidOperation(&LeftToken, &RightItem, "!");
@@ -977,7 +1170,7 @@ bool TryEvaluateMultiplication(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_Asterisk)
+    if (Next.Type != WTokenType_Asterisk)
     {
         *Result = Left;
         return true;
@@ -996,7 +1189,13 @@ bool TryEvaluateMultiplication(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewIntItem(Left.Int * Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(Multiplication_Op))
     {
@@ -1011,7 +1210,7 @@ bool TryEvaluateMultiplication(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1037,7 +1236,7 @@ bool TryEvaluateDivision(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_ForwardSlash)
+    if (Next.Type != WTokenType_ForwardSlash)
     {
         *Result = Left;
         return true;
@@ -1056,7 +1255,13 @@ bool TryEvaluateDivision(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewIntItem(Left.Int / Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(Division_Op))
     {
@@ -1071,7 +1276,7 @@ bool TryEvaluateDivision(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1097,7 +1302,7 @@ bool TryEvaluateAddition(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_Plus)
+    if (Next.Type != WTokenType_Plus)
     {
         *Result = Left;
         return true;
@@ -1116,7 +1321,13 @@ bool TryEvaluateAddition(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewIntItem(Left.Int + Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(Addition_Op))
     {
@@ -1131,7 +1342,7 @@ bool TryEvaluateAddition(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1157,7 +1368,7 @@ bool TryEvaluateSubtraction(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_Minus)
+    if (Next.Type != WTokenType_Minus)
     {
         *Result = Left;
         return true;
@@ -1176,7 +1387,13 @@ bool TryEvaluateSubtraction(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewIntItem(Left.Int - Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(Subtraction_Op))
     {
@@ -1191,7 +1408,7 @@ bool TryEvaluateSubtraction(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1217,7 +1434,7 @@ bool TryEvaluateGreaterThanOrEquals(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_GreaterThanOrEquals)
+    if (Next.Type != WTokenType_GreaterThanOrEquals)
     {
         *Result = Left;
         return true;
@@ -1236,7 +1453,13 @@ bool TryEvaluateGreaterThanOrEquals(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewBoolItem(Left.Int >= Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(GreaterThan_Op))
     {
@@ -1253,7 +1476,7 @@ bool TryEvaluateGreaterThanOrEquals(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1281,7 +1504,7 @@ bool TryEvaluateLessThanOrEquals(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_LessThanOrEquals)
+    if (Next.Type != WTokenType_LessThanOrEquals)
     {
         *Result = Left;
         return true;
@@ -1300,7 +1523,13 @@ bool TryEvaluateLessThanOrEquals(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewBoolItem(Left.Int <= Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(LessThan_Op))
     {
@@ -1317,7 +1546,7 @@ bool TryEvaluateLessThanOrEquals(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1345,7 +1574,7 @@ bool TryEvaluateGreaterThan(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_GreaterThan)
+    if (Next.Type != WTokenType_GreaterThan)
     {
         *Result = Left;
         return true;
@@ -1364,7 +1593,13 @@ bool TryEvaluateGreaterThan(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewBoolItem(Left.Int > Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(GreaterThan_Op))
     {
@@ -1379,7 +1614,7 @@ bool TryEvaluateGreaterThan(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1405,7 +1640,7 @@ bool TryEvaluateLessThan(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_LessThan)
+    if (Next.Type != WTokenType_LessThan)
     {
         *Result = Left;
         return true;
@@ -1424,7 +1659,13 @@ bool TryEvaluateLessThan(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewBoolItem(Left.Int < Right.Int);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(LessThan_Op))
     {
@@ -1439,7 +1680,7 @@ bool TryEvaluateLessThan(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1465,7 +1706,7 @@ bool TryEvaluateEquality(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_Equals)
+    if (Next.Type != WTokenType_Equals)
     {
         *Result = Left;
         return true;
@@ -1484,7 +1725,28 @@ bool TryEvaluateEquality(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewBoolItem(Left.Int == Right.Int);
+        return true;
+    }
+    else if (BothOfType(&Left, &Right, Type_Bool))
+    {
+        *Result = NewBoolItem(Left.Bool == Right.Bool);
+        return true;
+    }
+    else if (BothOfType(&Left, &Right, Type_String))
+    {
+        *Result = NewBoolItem(StringsAreEqual(&Left, &Right));
+        return true;
+    }
+    else if (AreSharedAttributeData(&Left, &Right))
+    {
+        *Result = NewBoolItem(Left.Dict == Right.Dict);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(Equality_Op))
     {
@@ -1499,7 +1761,7 @@ bool TryEvaluateEquality(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1525,7 +1787,7 @@ bool TryEvaluateInEquality(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_NotEquals)
+    if (Next.Type != WTokenType_NotEquals)
     {
         *Result = Left;
         return true;
@@ -1544,7 +1806,28 @@ bool TryEvaluateInEquality(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Int))
+    {
+        *Result = NewBoolItem(Left.Int != Right.Int);
+        return true;
+    }
+    else if (BothOfType(&Left, &Right, Type_Bool))
+    {
+        *Result = NewBoolItem(Left.Bool != Right.Bool);
+        return true;
+    }
+    else if (BothOfType(&Left, &Right, Type_String))
+    {
+        *Result = NewBoolItem(!StringsAreEqual(&Left, &Right));
+        return true;
+    }
+    else if (AreSharedAttributeData(&Left, &Right))
+    {
+        *Result = NewBoolItem(Left.Dict != Right.Dict);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(Equality_Op))
     {
@@ -1559,7 +1842,7 @@ bool TryEvaluateInEquality(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1585,7 +1868,7 @@ bool TryEvaluateBooleanOr(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_BooleanOr)
+    if (Next.Type != WTokenType_BooleanOr)
     {
         *Result = Left;
         return true;
@@ -1604,7 +1887,13 @@ bool TryEvaluateBooleanOr(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Bool))
+    {
+        *Result = NewBoolItem(Left.Bool || Right.Bool);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(BooleanOr_Op))
     {
@@ -1619,7 +1908,7 @@ bool TryEvaluateBooleanOr(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1645,7 +1934,7 @@ bool TryEvaluateBooleanAnd(write_parser *Parser,
     }
     
     wtoken_info Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_BooleanAnd)
+    if (Next.Type != WTokenType_BooleanAnd)
     {
         *Result = Left;
         return true;
@@ -1664,7 +1953,13 @@ bool TryEvaluateBooleanAnd(write_parser *Parser,
         return false;
     }
     
-    inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
+    if (BothOfType(&Left, &Right, Type_Bool))
+    {
+        *Result = NewBoolItem(Left.Bool && Right.Bool);
+        return true;
+    }
+    
+    const inspect_data_operation_interface *LeftInterface = GetInterface(Left.Type);
     
     if (!LeftInterface->CanExecuteOperation(BooleanAnd_Op))
     {
@@ -1679,7 +1974,7 @@ bool TryEvaluateBooleanAnd(write_parser *Parser,
     else
     {
         inspect_data_item RightCasted;
-        inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
+        const inspect_data_operation_interface *RightInterface = GetInterface(Right.Type);
         if (!RightInterface->Cast(Left.Type, &Right, &RightCasted))
         {
             PrintInvalidCast(Left.Type, &Right, &RightToken);
@@ -1692,6 +1987,27 @@ bool TryEvaluateBooleanAnd(write_parser *Parser,
     return true;
 }
 
+// A value the expression pushed is owned, it is taken off the frame and the scope owns it
+// from then on. Anything else belongs to something else and the scope only borrows it.
+// Either way the expression itself only gets a borrow of what was stored.
+static
+void StoreAssignedValue(stack_frame *Frame,
+                        inspect_dict *AssignmentScope,
+                        const char *AssignmentName,
+                        inspect_data_item *NewValue,
+                        inspect_data_item *Result)
+{
+    inspect_data_item Stored = *NewValue;
+    if (!Frame->TryReleaseItem(NewValue))
+    {
+        Stored = BorrowItem(NewValue);
+    }
+    
+    FreeIfExists(AssignmentScope, AssignmentName);
+    Insert(AssignmentScope, AssignmentName, &Stored);
+    *Result = BorrowItem(&Stored);
+}
+
 static
 bool TryEvaluateAssignment(write_parser *Parser,
                            inspect_dict *Scope,
@@ -1706,23 +2022,28 @@ bool TryEvaluateAssignment(write_parser *Parser,
     {
         CurrentToken = Current(Parser);
         
-        if (CurrentToken.Token.Type != WTokenType_Assignment)
+        if (CurrentToken.Type != WTokenType_Assignment)
         {
             *Result = Item;
             return true;
         }
         
-        if (Item.Owner == nullptr)
+        if (!Item.IsLValue)
         {
-            PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-            printf("Invalid Operator \"=\". Assignment only valid on L-Values\n");
+            PrintLocation(&CurrentToken);
+            PrintError("Invalid Operator \"=\". Assignment only valid on L-Values\n");
             return false;
         }
         
-        AssignmentName = FindLValueName(&Item);
-        AssignmentScope = Item.Owner;
+        if (!CheckLValueWritable(Parser, &CurrentToken))
+        {
+            return false;
+        }
+        
+        AssignmentName = GetLValueName(Parser);
+        AssignmentScope = Parser->LValueOwner;
     }
-    else if (CurrentToken.Token.Type == WTokenType_Identifier)
+    else if (CurrentToken.Type == WTokenType_Identifier)
     {
         wtoken_info Next;
         if (!PushToken(Parser, &Next))
@@ -1730,16 +2051,16 @@ bool TryEvaluateAssignment(write_parser *Parser,
             return false;
         }
         
-        if (Next.Token.Type != WTokenType_Assignment)
+        if (Next.Type != WTokenType_Assignment)
         {
-            PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-            printf("Unknown identifier \"%.*s\"\n",
-                   (int)CurrentToken.Token.Length,
-                   CurrentToken.Token.Text);
+            PrintLocation(&CurrentToken);
+            PrintError("Unknown identifier \"%.*s\"\n",
+                       (int)CurrentToken.Length,
+                       TokenText(&CurrentToken));
             return false;
         }
         
-        AssignmentName = std::string(CurrentToken.Token.Text, CurrentToken.Token.Length);
+        AssignmentName = std::string(TokenText(&CurrentToken), CurrentToken.Length);
         AssignmentScope = Scope;
     }
     else
@@ -1759,10 +2080,18 @@ bool TryEvaluateAssignment(write_parser *Parser,
         return false;
     }
     
-    *Result = CreateCopyOrReference(&NewValue);
-    FreeIfExists(AssignmentScope, AssignmentName.c_str());
-    Insert(AssignmentScope, AssignmentName.c_str(), Result);
-    NewFrame.TryReleaseItem(Result); // NOTE(Brian): The item is now "owned" by the scope.
+    if (NewValue.Type == Type_String && !NewValue.IsInterned)
+    {
+        // Could be a view into the template, which doesn't live as long as the scope.
+        // Copied before the old value is freed, the new one might be a view of it.
+        inspect_data_item Copy = NewStringItem(NewValue.String, NewValue.StringLength);
+        FreeIfExists(AssignmentScope, AssignmentName.c_str());
+        Insert(AssignmentScope, AssignmentName.c_str(), &Copy);
+        *Result = BorrowItem(&Copy);
+        return true;
+    }
+    
+    StoreAssignedValue(&NewFrame, AssignmentScope, AssignmentName.c_str(), &NewValue, Result);
     return true;
 }
 
@@ -1790,7 +2119,7 @@ static
 bool TryEvaluateIf(write_parser *Parser, inspect_dict *Scope)
 {
     wtoken_info If = Current(Parser);
-    if (If.Token.Type != WTokenType_If)
+    if (If.Type != WTokenType_If)
     {
         return false;
     }
@@ -1805,16 +2134,16 @@ bool TryEvaluateIf(write_parser *Parser, inspect_dict *Scope)
     inspect_data_item IfResult;
     if(!TryEvaluateSubExpression(Parser, Scope, &IfResult, &NewFrame))
     {
-        PrintLocation(Next.Line, Next.Column, Next.Filename);
-        printf("Expected expression.\n");
+        PrintLocation(&Next);
+        PrintError("Expected expression.\n");
         return false;
     }
     else
     {
         if (IfResult.Type != Type_Bool)
         {
-            PrintLocation(Next.Line, Next.Column, Next.Filename);
-            printf("Expression does not evaluate to a bool\n");
+            PrintLocation(&Next);
+            PrintError("Expression does not evaluate to a bool\n");
             return false;
         }
         
@@ -1841,17 +2170,17 @@ static
 bool ContinuePastToken(write_parser *Parser, write_token_type Type, const char *TokenString)
 {
     wtoken_info CurrentToken = Current(Parser);
-    while (CurrentToken.Token.Type != Type)
+    while (CurrentToken.Type != Type)
     {
         if (!PushToken(Parser, &CurrentToken))
         {
             return false;
         }
         
-        if (CurrentToken.Token.Type == WTokenType_EOF)
+        if (CurrentToken.Type == WTokenType_EOF)
         {
-            PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-            printf("Expected \"%s\", found EOF\n", TokenString);
+            PrintLocation(&CurrentToken);
+            PrintError("Expected \"%s\", found EOF\n", TokenString);
             return false;
         }
     }
@@ -1871,10 +2200,10 @@ bool ContinueToModeSwitch(write_parser *Parser)
             return false;
         }
         
-        if (CurrentToken.Token.Type == WTokenType_EOF)
+        if (CurrentToken.Type == WTokenType_EOF)
         {
-            PrintLocation(FirstToken.Line, FirstToken.Column, FirstToken.Filename);
-            printf("Unexpected EOF\n");
+            PrintLocation(&FirstToken);
+            PrintError("Unexpected EOF\n");
             return false;
         }
     }
@@ -1898,8 +2227,8 @@ bool TryEvaluateForLoopCondition(write_parser *Parser,
     
     if (Item.Type != Type_Bool)
     {
-        PrintLocation(ExpressionBegin.Line, ExpressionBegin.Column, ExpressionBegin.Filename);
-        printf("Expression must evaluate to a boolean value\n");
+        PrintLocation(&ExpressionBegin);
+        PrintError("Expression must evaluate to a boolean value\n");
         return false;
     }
     
@@ -1921,55 +2250,37 @@ bool TryEvaluateForLoopIncrement(write_parser *Parser,
     return true;
 }
 
-static inline
-bool CompareITokenAndWToken(inspect_token *Inspect, write_token *Write)
+static
+attribute_handle GetAttributeHandle(write_parser *Parser, wtoken_info *Attribute, int TokenIndex)
 {
-    if (Inspect->Length != Write->Length)
+    std::vector<attribute_handle> &Cache = Parser->AttributeHandleCache;
+    if ((size_t)TokenIndex >= Cache.size())
     {
-        return false;
+        Cache.resize((size_t)TokenIndex + 1, UNCACHED_ATTRIBUTE_HANDLE);
     }
     
-    for (size_t I = 0; I < Inspect->Length; ++I)
+    if (Cache[(size_t)TokenIndex] == UNCACHED_ATTRIBUTE_HANDLE)
     {
-        if (Inspect->Text[I] != Write->Text[I])
-        {
-            return false;
-        }
+        auto It = Parser->AttributeHandles->find(StringFromToken(Attribute));
+        Cache[(size_t)TokenIndex] = It != Parser->AttributeHandles->end() ? It->second : INVALID_ATTRIBUTE_HANDLE;
     }
     
-    return true;
+    return Cache[(size_t)TokenIndex];
 }
 
 static
-bool ItemHasAttribute(inspect_data_item *Item,
-                      wtoken_info *Attribute)
+bool ItemHasAttribute(write_parser *Parser,
+                      inspect_data_item *Item,
+                      wtoken_info *Attribute,
+                      int TokenIndex)
 {
-    if (Item->Attributes == nullptr)
+    if (Item->Type != Type_Dict || Item->Dict->Attributes == nullptr)
     {
         return false;
     }
     
-    for (attribute_instance &Instance : Item->Attributes->Attributes)
-    {
-        if (Instance.Aliased)
-        {
-            if (CompareITokenAndWToken(&Instance.Alias->IdentifierToken.Token,
-                                       &Attribute->Token))
-            {
-                return true;
-            }
-        }
-        else
-        {
-            if (CompareITokenAndWToken(&Instance.IdentifierToken.Token,
-                                       &Attribute->Token))
-            {
-                return true;
-            }
-        }
-    }
-    
-    return false;
+    attribute_handle Handle = GetAttributeHandle(Parser, Attribute, TokenIndex);
+    return Handle != INVALID_ATTRIBUTE_HANDLE && IsAttributePresent(Item->Dict->Attributes, Handle);
 }
 
 static
@@ -1978,7 +2289,7 @@ bool TryEvaluateHasAttribute(write_parser *Parser,
                              inspect_data_item *Result)
 {
     wtoken_info HasAttributeName = Current(Parser);
-    if (HasAttributeName.Token.Type != WTokenType_HasAttribute)
+    if (HasAttributeName.Type != WTokenType_HasAttribute)
     {
         return false;
     }
@@ -1989,10 +2300,10 @@ bool TryEvaluateHasAttribute(write_parser *Parser,
         return false;
     }
     
-    if (CurrentToken.Token.Type != WTokenType_LeftParen)
+    if (CurrentToken.Type != WTokenType_LeftParen)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf("Expected \"(\"\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Expected \"(\"\n");
         return false;
     }
     
@@ -2009,10 +2320,10 @@ bool TryEvaluateHasAttribute(write_parser *Parser,
     }
     
     CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_Comma)
+    if (CurrentToken.Type != WTokenType_Comma)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf("Expected \",\"\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Expected \",\"\n");
         return false;
     }
     
@@ -2022,14 +2333,14 @@ bool TryEvaluateHasAttribute(write_parser *Parser,
         return false;
     }
     
-    if (StringToken.Token.Type != WTokenType_String)
+    int StringTokenIndex = Parser->Stack.Top;
+    
+    if (StringToken.Type != WTokenType_String)
     {
-        PrintLocation(StringToken.Line,
-                      StringToken.Column,
-                      StringToken.Filename);
-        printf("Expected string literal, found \"%.*s\"\n",
-               (int)StringToken.Token.Length,
-               StringToken.Token.Text);
+        PrintLocation(&StringToken);
+        PrintError("Expected string literal, found \"%.*s\"\n",
+                   (int)StringToken.Length,
+                   TokenText(&StringToken));
         return false;
     }
     
@@ -2038,14 +2349,14 @@ bool TryEvaluateHasAttribute(write_parser *Parser,
         return false;
     }
     
-    if (CurrentToken.Token.Type != WTokenType_RightParen)
+    if (CurrentToken.Type != WTokenType_RightParen)
     {
-        PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-        printf("Expected \")\"\n");
+        PrintLocation(&CurrentToken);
+        PrintError("Expected \")\"\n");
         return false;
     }
     
-    *Result = NewBoolItem(ItemHasAttribute(&Item, &StringToken));
+    *Result = NewBoolItem(ItemHasAttribute(Parser, &Item, &StringToken, StringTokenIndex));
     return PushToken(Parser);
 }
 
@@ -2055,7 +2366,7 @@ bool TryEvaluateProcedureCall(write_parser *Parser,
                               inspect_data_item *Result)
 {
     wtoken_info Identifier = Current(Parser);
-    if (Identifier.Token.Type != WTokenType_Identifier)
+    if (Identifier.Type != WTokenType_Identifier)
     {
         return false;
     }
@@ -2066,7 +2377,7 @@ bool TryEvaluateProcedureCall(write_parser *Parser,
         return false;
     }
     
-    if (CurrentToken.Token.Type != WTokenType_LeftParen)
+    if (CurrentToken.Type != WTokenType_LeftParen)
     {
         PopTokens(Parser, 1);
         return false;
@@ -2078,12 +2389,12 @@ bool TryEvaluateProcedureCall(write_parser *Parser,
     }
     
     inspect_data_item ProcedureItem;
-    if (!Lookup(Scope, &Identifier.Token, &ProcedureItem))
+    if (!Lookup(Scope, &Identifier, &ProcedureItem))
     {
-        PrintLocation(Identifier.Line, Identifier.Column, Identifier.Filename);
-        printf("Could not find procedure \"%.*s\"\n",
-               (int)Identifier.Token.Length,
-               Identifier.Token.Text);
+        PrintLocation(&Identifier);
+        PrintError("Could not find procedure \"%.*s\"\n",
+                   (int)Identifier.Length,
+                   TokenText(&Identifier));
         return false;
     }
     
@@ -2097,15 +2408,15 @@ bool TryEvaluateProcedureCall(write_parser *Parser,
     {
         for (int i = 0; i < (int)Procedure.Args.size(); ++i)
         {
-            if (CurrentToken.Token.Type == WTokenType_RightParen)
+            if (CurrentToken.Type == WTokenType_RightParen)
             {
                 FreeDataItem(&ProcedureScopeItem);
-                PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-                printf ("Call to %.*s requires %i arguments, but was given %i\n",
-                        (int)Identifier.Token.Length,
-                        Identifier.Token.Text,
-                        (int)Procedure.Args.size(),
-                        i);
+                PrintLocation(&CurrentToken);
+                PrintError("Call to %.*s requires %i arguments, but was given %i\n",
+                           (int)Identifier.Length,
+                           TokenText(&Identifier),
+                           (int)Procedure.Args.size(),
+                           i);
                 return false;
             }
             
@@ -2119,33 +2430,34 @@ bool TryEvaluateProcedureCall(write_parser *Parser,
             
             CurrentToken = Current(Parser);
             
-            Insert(&ProcedureScope, &Procedure.Args[(uint64)i].Token, &Argument);
+            Insert(&ProcedureScope, &Procedure.Args[(uint64)i], &Argument);
             
             if (i != (int)(Procedure.Args.size() - 1))
             {
-                if (CurrentToken.Token.Type != WTokenType_Comma)
+                if (CurrentToken.Type != WTokenType_Comma)
                 {
                     FreeDataItem(&ProcedureScopeItem);
-                    PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-                    printf("Expected \",\"\n");
+                    PrintLocation(&CurrentToken);
+                    PrintError("Expected \",\"\n");
                     return false;
                 }
                 
                 if (!PushToken(Parser))
                 {
+                    FreeDataItem(&ProcedureScopeItem);
                     return false;
                 }
             }
             else
             {
-                if (CurrentToken.Token.Type != WTokenType_RightParen)
+                if (CurrentToken.Type != WTokenType_RightParen)
                 {
                     FreeDataItem(&ProcedureScopeItem);
-                    PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-                    printf("Too many args for call to %.*s, expected %i\n",
-                           (int)Identifier.Token.Length,
-                           Identifier.Token.Text,
-                           (int)Procedure.Args.size());
+                    PrintLocation(&CurrentToken);
+                    PrintError("Too many args for call to %.*s, expected %i\n",
+                               (int)Identifier.Length,
+                               TokenText(&Identifier),
+                               (int)Procedure.Args.size());
                     return false;
                 }
             }
@@ -2153,14 +2465,14 @@ bool TryEvaluateProcedureCall(write_parser *Parser,
     }
     else
     {
-        if (CurrentToken.Token.Type != WTokenType_RightParen)
+        if (CurrentToken.Type != WTokenType_RightParen)
         {
             FreeDataItem(&ProcedureScopeItem);
-            PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-            printf("Too many args for call to %.*s, expected %i\n",
-                   (int)Identifier.Token.Length,
-                   Identifier.Token.Text,
-                   (int)Procedure.Args.size());
+            PrintLocation(&CurrentToken);
+            PrintError("Too many args for call to %.*s, expected %i\n",
+                       (int)Identifier.Length,
+                       TokenText(&Identifier),
+                       (int)Procedure.Args.size());
             return false;
         }
     }
@@ -2195,7 +2507,7 @@ static
 bool TryEvaluateForLoop(write_parser *Parser, inspect_dict *Scope)
 {
     wtoken_info For = Current(Parser);
-    if (For.Token.Type != WTokenType_For)
+    if (For.Type != WTokenType_For)
     {
         return false;
     }
@@ -2219,10 +2531,10 @@ bool TryEvaluateForLoop(write_parser *Parser, inspect_dict *Scope)
     }
     
     Next = Current(Parser);
-    if (Next.Token.Type != WTokenType_SemiColon)
+    if (Next.Type != WTokenType_SemiColon)
     {
-        PrintLocation(Next.Line, Next.Column, Next.Filename);
-        printf("Expected \";\"\n");
+        PrintLocation(&Next);
+        PrintError("Expected \";\"\n");
         FreeDataItem(&LocalScopeItem);
         return false;
     }
@@ -2244,8 +2556,8 @@ bool TryEvaluateForLoop(write_parser *Parser, inspect_dict *Scope)
     
     if (!ContinueToModeSwitch(Parser))
     {
-        PrintLocation(Next.Line, Next.Column, Next.Filename);
-        printf("Could not find body of for loop\n");
+        PrintLocation(&Next);
+        PrintError("Could not find body of for loop\n");
         FreeDataItem(&LocalScopeItem);
         return false;
     }
@@ -2294,7 +2606,7 @@ static
 bool TryEvaluateForEach(write_parser *Parser, inspect_dict *Scope)
 {
     wtoken_info For = Current(Parser);
-    if (For.Token.Type != WTokenType_ForEach)
+    if (For.Type != WTokenType_ForEach)
     {
         return false;
     }
@@ -2305,11 +2617,11 @@ bool TryEvaluateForEach(write_parser *Parser, inspect_dict *Scope)
         return false;
     }
     
-    if (Variable.Token.Type == WTokenType_EOF) HandleUnexpectedEnd(&Variable);
-    if (Variable.Token.Type != WTokenType_Identifier)
+    if (Variable.Type == WTokenType_EOF) HandleUnexpectedEnd(&Variable);
+    if (Variable.Type != WTokenType_Identifier)
     {
-        PrintLocation(Variable.Line, Variable.Column, Variable.Filename);
-        printf("Expected identifier.\n");
+        PrintLocation(&Variable);
+        PrintError("Expected identifier.\n");
         return false;
     }
     
@@ -2319,11 +2631,11 @@ bool TryEvaluateForEach(write_parser *Parser, inspect_dict *Scope)
         return false;
     }
     
-    if (In.Token.Type == WTokenType_EOF) HandleUnexpectedEnd(&In);
-    if (In.Token.Type != WTokenType_In)
+    if (In.Type == WTokenType_EOF) HandleUnexpectedEnd(&In);
+    if (In.Type != WTokenType_In)
     {
-        PrintLocation(In.Line, In.Column, In.Filename);
-        printf("Expected \"in\".");
+        PrintLocation(&In);
+        PrintError("Expected \"in\".");
         return false;
     }
     
@@ -2336,7 +2648,7 @@ bool TryEvaluateForEach(write_parser *Parser, inspect_dict *Scope)
     
     {
         stack_frame Frame(Parser);
-        if (Next.Token.Type == WTokenType_EOF) HandleUnexpectedEnd(&In);
+        if (Next.Type == WTokenType_EOF) HandleUnexpectedEnd(&In);
         if (!TryEvaluateSubExpression(Parser, Scope, &ListItem, &Frame))
         {
             return false;
@@ -2345,9 +2657,9 @@ bool TryEvaluateForEach(write_parser *Parser, inspect_dict *Scope)
     
     if (ListItem.Type != Type_List)
     {
-        wtoken_info ListToken = Parser->Stack.Tokens[Parser->Stack.Top - 1];
-        PrintLocation(ListToken.Line, ListToken.Column, ListToken.Filename);
-        printf("Expression did not evaluate to a list.");
+        wtoken_info ListToken = TokenAt(&Parser->Stack, Parser->Stack.Top - 1);
+        PrintLocation(&ListToken);
+        PrintError("Expression did not evaluate to a list.");
         return false;
     }
     
@@ -2363,20 +2675,22 @@ bool TryEvaluateForEach(write_parser *Parser, inspect_dict *Scope)
     int Return = Parser->Stack.Top;
     for (size_t i = 0; i < ListItem.List->size(); ++i)
     {
-        inspect_data_item Item = ListItem.List->at(i);
+        inspect_data_item Item = BorrowItem(&ListItem.List->at(i));
         
-        Insert(&LocalScope, &Variable.Token, &Item);
+        Insert(&LocalScope, &Variable, &Item);
         PushScopeLevel(Parser, false, true);
         if (!Evaluate(Parser, &LocalScope, WTokenType_End))
         {
+            FreeDataItem(&LocalScopeItem);
             return false;
         }
         PopScopeLevel(Parser, true);
         
         wtoken_info CurrentToken = Current(Parser);
-        if (CurrentToken.Token.Type == WTokenType_EOF)
+        if (CurrentToken.Type == WTokenType_EOF)
         {
             HandleUnexpectedEnd(&CurrentToken);
+            FreeDataItem(&LocalScopeItem);
             return false;
         }
         
@@ -2395,6 +2709,9 @@ bool TryEvaluateForEach(write_parser *Parser, inspect_dict *Scope)
 static
 void CommitTextForAdjustment(write_parser *Parser, const char *Format, ...);
 
+static
+void CommitSpanForAdjustment(write_parser *Parser, const char *Text, size_t Length);
+
 static
 bool TryEvaluateWriteout(write_parser *Parser, inspect_dict *Scope)
 {
@@ -2406,7 +2723,7 @@ bool TryEvaluateWriteout(write_parser *Parser, inspect_dict *Scope)
         if (RefValue.Type == Type_String)
         {
             // Should write to file here
-            CommitTextForAdjustment(Parser, RefValue.String);
+            CommitSpanForAdjustment(Parser, RefValue.String, RefValue.StringLength);
             return true;
         }
         else if (RefValue.Type == Type_Int)
@@ -2425,8 +2742,8 @@ bool TryEvaluateWriteout(write_parser *Parser, inspect_dict *Scope)
         }
         else
         {
-            PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-            printf("Reference cannot be converted to a string.\n");
+            PrintLocation(&CurrentToken);
+            PrintError("Reference cannot be converted to a string.\n");
             return false;
         }
     }
@@ -2438,7 +2755,7 @@ static
 bool TryEvaluateIgnoreNewLine(write_parser *Parser)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type == WTokenType_IgnoreNewLine)
+    if (CurrentToken.Type == WTokenType_IgnoreNewLine)
     {
         wtoken_info NewLine;
         if (!PushToken(Parser, &NewLine))
@@ -2446,7 +2763,7 @@ bool TryEvaluateIgnoreNewLine(write_parser *Parser)
             return false;
         }
         
-        if (NewLine.Token.Type != WTokenType_TextNewLine)
+        if (NewLine.Type != WTokenType_TextNewLine)
         {
             PopTokens(Parser, 1);
         }
@@ -2467,7 +2784,7 @@ static
 bool TryEvaluateDefinitionsBlock(write_parser *Parser, inspect_dict *Scope)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_Definitions)
+    if (CurrentToken.Type != WTokenType_Definitions)
     {
         return false;
     }
@@ -2496,7 +2813,7 @@ static
 bool TryEvaluateBeginTab(write_parser *Parser, inspect_dict *Scope)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_BeginTab)
+    if (CurrentToken.Type != WTokenType_BeginTab)
     {
         return false;
     }
@@ -2529,7 +2846,7 @@ static
 bool TryEvaluateBreakpoint(write_parser *Parser)
 {
     wtoken_info CurrentToken = Current(Parser);
-    if (CurrentToken.Token.Type != WTokenType_Breakpoint)
+    if (CurrentToken.Type != WTokenType_Breakpoint)
     {
         return false;
     }
@@ -2723,6 +3040,44 @@ const char *EatSpaces(write_parser *Parser, const char *String)
     return Result;
 }
 
+// The output is the file, or OutputText for a parser that writes to memory.
+static inline
+void PutOutput(write_parser *Parser, char C)
+{
+    if (Parser->OutputText)
+    {
+        Parser->OutputText->push_back(C);
+    }
+    else
+    {
+        fputc(C, Parser->Output);
+    }
+}
+
+static inline
+void PutOutput(write_parser *Parser, const char *Text)
+{
+    if (Parser->OutputText)
+    {
+        Parser->OutputText->append(Text);
+    }
+    else
+    {
+        fputs(Text, Parser->Output);
+    }
+}
+
+static inline
+long OutputOffset(write_parser *Parser)
+{
+    if (Parser->OutputText)
+    {
+        return (long)Parser->OutputText->size();
+    }
+    
+    return ftell(Parser->Output);
+}
+
 static inline
 void AddTabs(write_parser *Parser, int32 RequiredTabs)
 {
@@ -2738,7 +3093,7 @@ void AddTabs(write_parser *Parser, int32 RequiredTabs)
     
     for (int32 I = 0; I < RequiredTabs * Parser->TabSize; ++I)
     {
-        fputc(OutputChar, Parser->Output);
+        PutOutput(Parser, OutputChar);
     }
     
     Parser->TabsAdded += RequiredTabs;
@@ -2802,26 +3157,10 @@ const char *AdjustTab(write_parser *Parser, const char *Output)
     return Output;
 }
 
+// Writes the text in the output buffer, adjusting its tabs.
 static inline
-void CommitTextForAdjustment(write_parser *Parser, const char *Format, ...)
+void CommitOutputBuffer(write_parser *Parser)
 {
-    va_list Arguments;
-    va_start(Arguments, Format);
-    
-    int OutputSize = vsnprintf(Parser->OutputBuffer, Parser->OutputBufferSize,
-                               Format, Arguments);
-    
-    if ((size_t)OutputSize > Parser->OutputBufferSize)
-    {
-        free(Parser->OutputBuffer);
-        Parser->OutputBufferSize = (size_t)OutputSize;
-        Parser->OutputBuffer = (char *)malloc(Parser->OutputBufferSize);
-        vsnprintf(Parser->OutputBuffer, Parser->OutputBufferSize,
-                  Format, Arguments);
-    }
-    
-    va_end(Arguments);
-    
     const char *Output = AdjustTab(Parser, Parser->OutputBuffer);
     
     if (Parser->Flags & WP_UseSpacesInsteadOfTabs)
@@ -2832,29 +3171,69 @@ void CommitTextForAdjustment(write_parser *Parser, const char *Format, ...)
             {
                 for (int i = 0; i < Parser->TabSize; ++i)
                 {
-                    fputc(' ', Parser->Output);
+                    PutOutput(Parser, ' ');
                 }
             }
             else
             {
-                fputc(*C, Parser->Output);
+                PutOutput(Parser, *C);
             }
         }
     }
     else
     {
-        fputs(Output, Parser->Output);
+        PutOutput(Parser, Output);
     }
 }
 
+static inline
+void CommitTextForAdjustment(write_parser *Parser, const char *Format, ...)
+{
+    va_list Arguments;
+    va_start(Arguments, Format);
+    
+    int OutputSize = vsnprintf(Parser->OutputBuffer, Parser->OutputBufferSize,
+                               Format, Arguments);
+    
+    if ((size_t)OutputSize > Parser->OutputBufferSize)
+    {
+        free(Parser->OutputBuffer);
+        Parser->OutputBufferSize = (size_t)OutputSize;
+        Parser->OutputBuffer = (char *)malloc(Parser->OutputBufferSize);
+        vsnprintf(Parser->OutputBuffer, Parser->OutputBufferSize,
+                  Format, Arguments);
+    }
+    
+    va_end(Arguments);
+    
+    CommitOutputBuffer(Parser);
+}
+
+// Writes Length bytes of Text, which doesn't have to be terminated.
+static inline
+void CommitSpanForAdjustment(write_parser *Parser, const char *Text, size_t Length)
+{
+    if (Length + 1 > Parser->OutputBufferSize)
+    {
+        free(Parser->OutputBuffer);
+        Parser->OutputBufferSize = Length + 1;
+        Parser->OutputBuffer = (char *)malloc(Parser->OutputBufferSize);
+    }
+    
+    memcpy(Parser->OutputBuffer, Text, Length);
+    Parser->OutputBuffer[Length] = '\0';
+    
+    CommitOutputBuffer(Parser);
+}
+
 static inline
 int32 Tabs(write_parser *Parser, wtoken_info *Token)
 {
     int32 Spaces = 0;
     int32 Tabs = 0;
-    for (size_t I = 0; I < Token->Token.Length; ++I)
+    for (size_t I = 0; I < Token->Length; ++I)
     {
-        char C = Token->Token.Text[I];
+        char C = TokenText(Token)[I];
         if (C == '\t')
         {
             ++Tabs;
@@ -2872,25 +3251,67 @@ int32 Tabs(write_parser *Parser, wtoken_info *Token)
     return Tabs + (Spaces / Parser->TabSize);
 }
 
+static inline
+bool IsProbing(write_parser *Parser)
+{
+    return Parser->Probe.Offset >= 0 && !Parser->Probe.Hit;
+}
+
+// Blames the last evaluated token if the output has grown past the probed offset.
+// Nested Evaluate calls check first, so the innermost token gets the blame.
+static
+void UpdateProbe(write_parser *Parser, wtoken_info *LastToken, inspect_dict *Scope)
+{
+    if (OutputOffset(Parser) <= Parser->Probe.Offset)
+    {
+        return;
+    }
+    
+    Parser->Probe.Hit = true;
+    Parser->Probe.Token = *LastToken;
+    
+    // The scopes don't outlive the evaluation, so look for the model item now.
+    for (; Scope && !Parser->Probe.HasModel; Scope = Scope->Parent)
+    {
+        for (auto &Entry : Scope->Lookup)
+        {
+            inspect_data_item &Item = Entry.second;
+            if (Item.Type == Type_Dict && Item.Dict->SourceToken.File != NO_SOURCE_FILE)
+            {
+                Parser->Probe.HasModel = true;
+                Parser->Probe.Model = Item.Dict->SourceToken;
+                break;
+            }
+        }
+    }
+}
+
 static
 bool Evaluate(write_parser *Parser, inspect_dict *Scope, write_token_type Until)
 {
+    wtoken_info LastToken = Current(Parser);
+    
     for(;;)
     {
         wtoken_info CurrentToken = Current(Parser);
         
-        if (CurrentToken.Token.Type == Until)
+        if (IsProbing(Parser))
+        {
+            UpdateProbe(Parser, &LastToken, Scope);
+            LastToken = CurrentToken;
+        }
+        
+        if (CurrentToken.Type == Until)
         {
             return true;
         }
         
-        if (CurrentToken.Token.Type == WTokenType_Text)
+        if (CurrentToken.Type == WTokenType_Text)
         {
             int TabCount = Tabs(Parser, &CurrentToken);
             if (!TabCount)
             {
-                CommitTextForAdjustment(Parser, "%.*s", (int)CurrentToken.Token.Length,
-                                        CurrentToken.Token.Text);
+                CommitSpanForAdjustment(Parser, TokenText(&CurrentToken), CurrentToken.Length);
             }
             else
             {
@@ -2905,13 +3326,13 @@ bool Evaluate(write_parser *Parser, inspect_dict *Scope, write_token_type Until)
                 return false;
             }
         }
-        else if (CurrentToken.Token.Type == WTokenType_TextNewLine)
+        else if (CurrentToken.Type == WTokenType_TextNewLine)
         {
             SetLineBeginTabState(Parser);
             
             if (!ShouldIgnoreNewLine(Parser))
             {
-                fputc('\n', Parser->Output);
+                PutOutput(Parser, '\n');
             }
             
             wtoken_info Next;
@@ -2926,8 +3347,8 @@ bool Evaluate(write_parser *Parser, inspect_dict *Scope, write_token_type Until)
             {
                 if (!(Parser->Flags & WP_IllegalExpressionReported))
                 {
-                    PrintLocation(CurrentToken.Line, CurrentToken.Column, CurrentToken.Filename);
-                    printf("Illegal expression\n");
+                    PrintLocation(&CurrentToken);
+                    PrintError("Illegal expression\n");
                     Parser->Flags |= WP_IllegalExpressionReported;
                 }
                 
@@ -2937,8 +3358,11 @@ bool Evaluate(write_parser *Parser, inspect_dict *Scope, write_token_type Until)
     }
 }
 
-bool EvaluateTemplate(write_parser *Parser, inspect_dict *Scope)
+bool EvaluateTemplate(write_parser *Parser, inspect_data *Data, inspect_dict *Variables)
 {
+    Parser->AttributeHandles = &Data->AttributeHandles;
+    Parser->ModelStrings = &Data->Strings;
+    
     // Make the current token the first token.
     wtoken_info Next;
     if (!PushToken(Parser, &Next))
@@ -2946,10 +3370,18 @@ bool EvaluateTemplate(write_parser *Parser, inspect_dict *Scope)
         return false;
     }
     
-    if (!Evaluate(Parser, Scope, WTokenType_EOF))
+    // The template's variables and procedures go in a scope of its own, the model is
+    // only read so other templates can be evaluated against it at the same time.
+    inspect_data_item TemplateScope = NewDictItem();
+    TemplateScope.Dict->Parent = Data->GlobalScope.Dict;
+    
+    if (Variables)
     {
-        return false;
+        Variables->Parent = Data->GlobalScope.Dict;
+        TemplateScope.Dict->Parent = Variables;
     }
     
-    return true;
+    bool Evaluated = Evaluate(Parser, TemplateScope.Dict, WTokenType_EOF);
+    FreeDataItem(&TemplateScope);
+    return Evaluated;
 }
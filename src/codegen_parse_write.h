@@ -7,29 +7,42 @@
 
 struct write_parser;
 
+// Whether freeing the item frees anything.
+inline
+bool OwnsMemory(inspect_data_item *Item)
+{
+    return !Item->IsReference &&
+        (Item->Type == Type_String ||
+         Item->Type == Type_Dict ||
+         Item->Type == Type_List ||
+         Item->Type == Type_Procedure);
+}
+
+// Temporaries of the expressions being evaluated, one stack for the whole render. A frame
+// only remembers how far the stack went when it started and frees whatever was pushed
+// after that when it ends, so once the stack has grown as deep as the template needs
+// evaluating doesn't allocate.
 struct data_item_stack
 {
-    // NOTE(Brian): This will stop working if we recursively collect items.
-    std::vector<std::vector<inspect_data_item>> Stack;
-    
-    inline void PushFrame()
-    {
-        Stack.emplace_back();
-    }
+    std::vector<inspect_data_item> Items;
     
+    // Items that don't own anything aren't kept, there is nothing to free.
     inline void PushItem(inspect_data_item Item)
     {
-        Stack.back().push_back(Item);
+        if (OwnsMemory(&Item))
+        {
+            Items.push_back(Item);
+        }
     }
     
-    inline void PopFrame()
+    inline void Release(size_t Mark)
     {
-        for(inspect_data_item &Item : Stack.back())
+        for (size_t I = Mark; I < Items.size(); ++I)
         {
-            FreeDataItem(&Item);
+            FreeDataItem(&Items[I]);
         }
-        
-        Stack.pop_back();
+    
+        Items.resize(Mark);
     }
 };
 
@@ -41,12 +54,36 @@ enum write_parser_flags : uint32
 };
 
 #define DEFAULT_OUTPUT_SIZE 1024
+#define UNCACHED_ATTRIBUTE_HANDLE -2
+
+// Finds the template token that wrote the byte at a given offset of the output, and
+// the innermost model item (struct, field) in scope at the time. Disabled when Offset
+// is negative.
+struct output_probe
+{
+    long Offset;
+    bool Hit;
+    wtoken_info Token;
+    
+    bool HasModel;
+    itoken_info Model;
+};
+
+// How the key at one place in a template was found in the last dict it was looked up
+// in. Every object of a kind has the same shape, so the key of a segment like the
+// Descriptor of Field.Type.Info.Descriptor is the same slot every time through.
+struct lookup_cache_entry
+{
+    inspect_shape_id Shape; // Shape_None until the key was looked up in a shaped dict.
+    int32 Slot; // -1 if the key isn't in the shape.
+};
 
 struct write_parser
 {
     write_lexer Lexer;
     token_stack<wtoken_info> Stack; // TODO(Brian): This isn't really a stack... we should rename this.
     FILE *Output;
+    std::string *OutputText; // Written to instead of Output if set.
     
     // NOTE(Brian): Stack of temporary memory, not necassarily a variable stack.
     // the "Scope" dict passed along various parse functions acts more as a variable
@@ -67,53 +104,77 @@ struct write_parser
     
     size_t OutputBufferSize;
     char *OutputBuffer;
+    
+    output_probe Probe;
+    
+    // has_attribute names resolved to attribute handles, indexed by the token index
+    // of the name, so each has_attribute only does the hash lookup once.
+    std::unordered_map<std::string, attribute_handle> *AttributeHandles;
+    std::vector<attribute_handle> AttributeHandleCache;
+    
+    // Indexed by the token index of the key, like AttributeHandleCache.
+    std::vector<lookup_cache_entry> LookupCache;
+    
+    // The interned string of each string literal, indexed by its token index. Anything
+    // that isn't a string hasn't been evaluated yet.
+    std::vector<inspect_data_item> StringLiteralCache;
+    
+    // Literals are interned into the model's table if it has their text. Other templates
+    // may be evaluated against the same model at the same time, so it is only read, the
+    // rest go into the parser's own table.
+    intern_table *ModelStrings;
+    intern_table Literals;
+    
+    // The variable the last item with IsLValue set came from, an assignment or increment
+    // of the item stores into it.
+    inspect_dict *LValueOwner;
+    wtoken_info LValueName;
 };
 
 struct stack_frame
 {
     stack_frame(write_parser *Parser)
-        : Stack(&Parser->ItemStack)
+        : Stack(&Parser->ItemStack), Mark(Parser->ItemStack.Items.size())
     {
-        Stack->PushFrame();
     }
     
     stack_frame(const stack_frame &) = delete;
     
     ~stack_frame()
     {
-        Stack->PopFrame();
+        Stack->Release(Mark);
     }
     
-    inline void TryReleaseItem(inspect_data_item *Item)
+    // Keeps the item from being freed with the frame, it was stored somewhere. The value
+    // of an expression is the last thing it pushed if it was pushed at all. Returns true if
+    // it was, whoever it was stored with owns it now.
+    inline bool TryReleaseItem(inspect_data_item *Item)
     {
-        std::vector<inspect_data_item> &Frame = Stack->Stack.back();
-        for (auto It = Frame.begin();
-             It != Frame.end();
-             It++)
+        std::vector<inspect_data_item> &Items = Stack->Items;
+        if (Items.size() > Mark && IsSameValue(&Items.back(), Item))
         {
-            if (It->UID == Item->UID)
-            {
-                Frame.erase(It);
-                return;
-            }
+            Items.pop_back();
+            return true;
         }
+        
+        return false;
     }
     
     private:
     data_item_stack *Stack;
+    size_t Mark;
 };
 
-inline
-inspect_data_item NewStringItem(wtoken_info *Token)
-{
-    inspect_data_item Item;
-    Item.Type = Type_String;
-    Item.String = (char *)malloc(Token->Token.Length + 1);
-    memcpy(Item.String, Token->Token.Text, Token->Token.Length);
-    Item.String[Token->Token.Length] = '\0';
-    return Item;
-}
-
-bool EvaluateTemplate(write_parser *Parser, inspect_dict *Scope);
+// Variables, if given, are read by the template like the model's globals and hide those
+// with the same name. Neither is written to.
+bool EvaluateTemplate(write_parser *Parser, inspect_data *Data, inspect_dict *Variables = nullptr);
 void FreeParser(write_parser *Parser);
-bool CreateParser(write_parser *Parser, const char *Filename, const char *OutputFilename);
\ No newline at end of file
+bool CreateParser(write_parser *Parser, const char *Filename, const char *OutputFilename);
+bool ResetParser(write_parser *Parser, const char *Filename, const char *OutputFilename);
+
+// The template is read through Reader, or from disk if there is none, and evaluating
+// it replaces the contents of Output instead of writing a file.
+bool CreateParser(write_parser *Parser, const char *Filename, source_reader *Reader,
+                  std::string *Output);
+bool ResetParser(write_parser *Parser, const char *Filename, source_reader *Reader,
+                 std::string *Output);
\ No newline at end of file
@@ -0,0 +1,755 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "codegen_binary.h"
+#include "codegen_lex_base.h"
+#include "codegen_snapshot.h"
+#include "compiler_utils.h"
+
+static const char SnapshotMagic[8] = { 'C', 'G', 'S', 'N', 'A', 'P', '\0', '\0' };
+
+#define SNAPSHOT_REFERENCE 0x1
+
+// Every pointer in the model gets an index in one of these tables, 0 is null.
+struct snapshot_writer
+{
+    binary_writer Out;
+    
+    std::vector<std::string> Strings;
+    std::unordered_map<std::string, uint32> StringIds;
+    
+    std::vector<inspect_dict *> Dicts;
+    std::unordered_map<inspect_dict *, uint32> DictIds;
+    
+    std::vector<inspect_list *> Lists;
+    std::unordered_map<inspect_list *, uint32> ListIds;
+    
+    std::vector<attribute_list *> AttributeLists;
+    std::unordered_map<attribute_list *, uint32> AttributeListIds;
+    
+    // Procedures only come from templates, a model that has one can't be written.
+    bool HasProcedure;
+};
+
+struct snapshot_reader
+{
+    binary_reader In;
+    
+    std::vector<std::string> Strings;
+    std::vector<inspect_data_item> InternedStrings; // Same order as Strings.
+    std::vector<inspect_dict *> Dicts;
+    std::vector<inspect_list *> Lists;
+    std::vector<attribute_list *> AttributeLists;
+    
+    // Dicts minus the ones inside attribute lists.
+    std::vector<inspect_dict *> AllocatedDicts;
+};
+
+struct snapshot_input
+{
+    std::string Path;
+    uint64 Hash;
+};
+
+static
+bool HashFile(const char *Path, uint64 *Hash)
+{
+    FILE *File = fopen(Path, "rb");
+    if (!File)
+    {
+        return false;
+    }
+    
+    *Hash = fnv64(nullptr, 0);
+    uint8 Buffer[1 << 16];
+    size_t Read;
+    while ((Read = fread(Buffer, 1, sizeof(Buffer), File)) > 0)
+    {
+        *Hash = fnv64(Buffer, Read, *Hash);
+    }
+    
+    fclose(File);
+    return true;
+}
+
+static inline
+bool CompareInputs(const snapshot_input &First, const snapshot_input &Second)
+{
+    return First.Path < Second.Path;
+}
+
+// The key the snapshot is stored under, every input path and its contents.
+static
+uint64 HashInputs(std::vector<snapshot_input> *Inputs)
+{
+    uint32 Version = SNAPSHOT_VERSION;
+    uint64 Hash = fnv64(&Version, sizeof(Version));
+    for (snapshot_input &Input : *Inputs)
+    {
+        Hash = fnv64(Input.Path.c_str(), Input.Path.size() + 1, Hash);
+        Hash = fnv64(&Input.Hash, sizeof(Input.Hash), Hash);
+    }
+    
+    return Hash;
+}
+
+static
+uint32 GetStringId(snapshot_writer *Writer, const std::string &String)
+{
+    uint32 &Id = Writer->StringIds[String];
+    if (!Id)
+    {
+        Writer->Strings.push_back(String);
+        Id = (uint32)Writer->Strings.size();
+    }
+    
+    return Id;
+}
+
+static
+uint32 GetDictId(snapshot_writer *Writer, inspect_dict *Dict)
+{
+    if (!Dict)
+    {
+        return 0;
+    }
+    
+    uint32 &Id = Writer->DictIds[Dict];
+    if (!Id)
+    {
+        Writer->Dicts.push_back(Dict);
+        Id = (uint32)Writer->Dicts.size();
+    }
+    
+    return Id;
+}
+
+static
+uint32 GetListId(snapshot_writer *Writer, inspect_list *List)
+{
+    uint32 &Id = Writer->ListIds[List];
+    if (!Id)
+    {
+        Writer->Lists.push_back(List);
+        Id = (uint32)Writer->Lists.size();
+    }
+    
+    return Id;
+}
+
+static
+uint32 GetAttributeListId(snapshot_writer *Writer, attribute_list *List)
+{
+    if (!List)
+    {
+        return 0;
+    }
+    
+    uint32 &Id = Writer->AttributeListIds[List];
+    if (!Id)
+    {
+        Writer->AttributeLists.push_back(List);
+        Id = (uint32)Writer->AttributeLists.size();
+        GetDictId(Writer, &List->AttributeData);
+    }
+    
+    return Id;
+}
+
+// Gives everything the item points to an index, the tables are walked as they grow so
+// this reaches the whole model without recursing.
+static
+void NumberItem(snapshot_writer *Writer, inspect_data_item *Item)
+{
+    if (Item->Type == Type_String)
+    {
+        GetStringId(Writer, StringFromItem(Item));
+    }
+    else if (Item->Type == Type_Dict)
+    {
+        GetDictId(Writer, Item->Dict);
+    }
+    else if (Item->Type == Type_List)
+    {
+        GetListId(Writer, Item->List);
+    }
+    else if (Item->Type == Type_Procedure)
+    {
+        Writer->HasProcedure = true;
+    }
+}
+
+static
+void NumberModel(snapshot_writer *Writer, inspect_data *Data)
+{
+    NumberItem(Writer, &Data->GlobalScope);
+    for (auto &Entry : Data->AttributeHandles)
+    {
+        GetStringId(Writer, Entry.first);
+    }
+    
+    size_t NextDict = 0;
+    size_t NextList = 0;
+    while (NextDict < Writer->Dicts.size() || NextList < Writer->Lists.size())
+    {
+        for (; NextDict < Writer->Dicts.size(); ++NextDict)
+        {
+            inspect_dict *Dict = Writer->Dicts[NextDict];
+            GetDictId(Writer, Dict->Parent);
+            GetAttributeListId(Writer, Dict->Attributes);
+            for (uint32 Slot = 0; Slot < Dict->Slots.size(); ++Slot)
+            {
+                if (IsSlotSet(Dict, Slot))
+                {
+                    NumberItem(Writer, &Dict->Slots[Slot]);
+                }
+            }
+            
+            for (auto &Entry : Dict->Lookup)
+            {
+                GetStringId(Writer, Entry.first);
+                NumberItem(Writer, &Entry.second);
+            }
+        }
+        
+        for (; NextList < Writer->Lists.size(); ++NextList)
+        {
+            for (inspect_data_item &Item : *Writer->Lists[NextList])
+            {
+                NumberItem(Writer, &Item);
+            }
+        }
+    }
+}
+
+static
+void WriteItem(snapshot_writer *Writer, inspect_data_item *Item)
+{
+    uint8 Type = (uint8)Item->Type;
+    uint8 Flags = Item->IsReference ? SNAPSHOT_REFERENCE : 0;
+    WriteBytes(&Writer->Out, &Type, sizeof(Type));
+    WriteBytes(&Writer->Out, &Flags, sizeof(Flags));
+    
+    uint32 Value = 0;
+    if (Item->Type == Type_String)
+    {
+        Value = GetStringId(Writer, StringFromItem(Item));
+    }
+    else if (Item->Type == Type_Int)
+    {
+        Value = (uint32)Item->Int;
+    }
+    else if (Item->Type == Type_Bool)
+    {
+        Value = Item->Bool ? 1 : 0;
+    }
+    else if (Item->Type == Type_Dict)
+    {
+        Value = GetDictId(Writer, Item->Dict);
+    }
+    else if (Item->Type == Type_List)
+    {
+        Value = GetListId(Writer, Item->List);
+    }
+    
+    WriteU32(&Writer->Out, Value);
+}
+
+static
+void WriteModel(snapshot_writer *Writer, inspect_data *Data)
+{
+    WriteU32(&Writer->Out, (uint32)Writer->Strings.size());
+    for (std::string &String : Writer->Strings)
+    {
+        WriteString(&Writer->Out, String);
+    }
+    
+    // Attribute data dicts live inside their attribute list, so the table says which
+    // list each dict belongs to instead of having it allocated.
+    std::vector<uint32> Embedded(Writer->Dicts.size(), 0);
+    for (size_t I = 0; I < Writer->AttributeLists.size(); ++I)
+    {
+        Embedded[Writer->DictIds[&Writer->AttributeLists[I]->AttributeData] - 1] = (uint32)I + 1;
+    }
+    
+    WriteU32(&Writer->Out, (uint32)Writer->Dicts.size());
+    WriteBytes(&Writer->Out, Embedded.data(), Embedded.size() * sizeof(uint32));
+    WriteU32(&Writer->Out, (uint32)Writer->Lists.size());
+    WriteU32(&Writer->Out, (uint32)Writer->AttributeLists.size());
+    
+    WriteItem(Writer, &Data->GlobalScope);
+    
+    for (inspect_dict *Dict : Writer->Dicts)
+    {
+        // The source token isn't written, file indices only mean something in one run.
+        WriteU32(&Writer->Out, GetDictId(Writer, Dict->Parent));
+        WriteU32(&Writer->Out, GetAttributeListId(Writer, Dict->Attributes));
+        WriteU32(&Writer->Out, (Dict->ReadOnly ? 1 : 0) | (Dict->SharedAttributeData ? 2 : 0));
+        
+        WriteU32(&Writer->Out, (uint32)Dict->Shape);
+        WriteU32(&Writer->Out, Dict->SlotsSet);
+        for (uint32 Slot = 0; Slot < Dict->Slots.size(); ++Slot)
+        {
+            if (IsSlotSet(Dict, Slot))
+            {
+                WriteItem(Writer, &Dict->Slots[Slot]);
+            }
+        }
+        
+        WriteU32(&Writer->Out, (uint32)Dict->Lookup.size());
+        for (auto &Entry : Dict->Lookup)
+        {
+            WriteU32(&Writer->Out, GetStringId(Writer, Entry.first));
+            WriteItem(Writer, &Entry.second);
+        }
+    }
+    
+    for (inspect_list *List : Writer->Lists)
+    {
+        WriteU32(&Writer->Out, (uint32)List->size());
+        for (inspect_data_item &Item : *List)
+        {
+            WriteItem(Writer, &Item);
+        }
+    }
+    
+    for (attribute_list *List : Writer->AttributeLists)
+    {
+        WriteU32(&Writer->Out, GetDictId(Writer, &List->AttributeData));
+        WriteU32(&Writer->Out, (uint32)List->Presence.size());
+        WriteBytes(&Writer->Out, List->Presence.data(), List->Presence.size() * sizeof(uint64));
+    }
+    
+    WriteU32(&Writer->Out, (uint32)Data->AttributeHandles.size());
+    for (auto &Entry : Data->AttributeHandles)
+    {
+        WriteU32(&Writer->Out, GetStringId(Writer, Entry.first));
+        WriteU32(&Writer->Out, (uint32)Entry.second);
+    }
+}
+
+bool WriteSnapshot(const char *Path, const char *InputFile,
+                   inspect_parser *Parser, inspect_data *Data)
+{
+    std::vector<snapshot_input> Inputs;
+    for (const std::string &Parsed : Parser->ParsedFiles)
+    {
+        snapshot_input Input;
+        Input.Path = Parsed;
+        if (!HashFile(Parsed.c_str(), &Input.Hash))
+        {
+            printf("Unable to write snapshot \"%s\": can't read \"%s\"\n", Path, Parsed.c_str());
+            return false;
+        }
+        
+        Inputs.push_back(Input);
+    }
+    
+    std::sort(Inputs.begin(), Inputs.end(), CompareInputs);
+    
+    snapshot_writer Writer;
+    Writer.HasProcedure = false;
+    NumberModel(&Writer, Data);
+    if (Writer.HasProcedure)
+    {
+        printf("Unable to write snapshot \"%s\": the model contains a procedure.\n", Path);
+        return false;
+    }
+    
+    WriteBytes(&Writer.Out, SnapshotMagic, sizeof(SnapshotMagic));
+    WriteU32(&Writer.Out, SNAPSHOT_VERSION);
+    WriteU64(&Writer.Out, HashInputs(&Inputs));
+    WriteString(&Writer.Out, InputFile);
+    WriteU32(&Writer.Out, (uint32)Inputs.size());
+    for (snapshot_input &Input : Inputs)
+    {
+        WriteString(&Writer.Out, Input.Path);
+        WriteU64(&Writer.Out, Input.Hash);
+    }
+    
+    // The model goes after its own hash, so a damaged snapshot is never loaded.
+    size_t HashAt = BeginHashedSection(&Writer.Out);
+    WriteModel(&Writer, Data);
+    FinishHashedSection(&Writer.Out, HashAt);
+    
+    if (!WriteBinaryFile(Path, &Writer.Out))
+    {
+        printf("Unable to write snapshot \"%s\"\n", Path);
+        return false;
+    }
+    
+    return true;
+}
+
+// Table indices are checked the same way, 0 is null.
+template <typename T>
+static
+T *ReadId(snapshot_reader *Reader, std::vector<T *> *Table)
+{
+    uint32 Id = ReadU32(&Reader->In);
+    if (Id > Table->size())
+    {
+        Reader->In.Failed = true;
+        return nullptr;
+    }
+    
+    return Id ? (*Table)[Id - 1] : nullptr;
+}
+
+static
+const std::string *ReadStringId(snapshot_reader *Reader)
+{
+    uint32 Id = ReadU32(&Reader->In);
+    if (Id == 0 || Id > Reader->Strings.size())
+    {
+        Reader->In.Failed = true;
+        return nullptr;
+    }
+    
+    return &Reader->Strings[Id - 1];
+}
+
+static
+bool ReadItem(snapshot_reader *Reader, inspect_data_item *Item)
+{
+    uint8 Type = 0;
+    uint8 Flags = 0;
+    ReadBytes(&Reader->In, &Type, sizeof(Type));
+    ReadBytes(&Reader->In, &Flags, sizeof(Flags));
+    
+    if (Type >= Num_Inspect_Item_Types)
+    {
+        Reader->In.Failed = true;
+        return false;
+    }
+    
+    Item->Type = (inspect_item_type)Type;
+    Item->IsReference = (Flags & SNAPSHOT_REFERENCE) != 0;
+    
+    if (Item->Type == Type_String)
+    {
+        const std::string *String = ReadStringId(Reader);
+        if (String)
+        {
+            *Item = Reader->InternedStrings[(size_t)(String - Reader->Strings.data())];
+        }
+        else
+        {
+            Item->String = nullptr;
+            Item->StringLength = 0;
+        }
+    }
+    else if (Item->Type == Type_Int)
+    {
+        Item->Int = (int)ReadU32(&Reader->In);
+    }
+    else if (Item->Type == Type_Bool)
+    {
+        Item->Bool = ReadU32(&Reader->In) != 0;
+    }
+    else if (Item->Type == Type_Void)
+    {
+        ReadU32(&Reader->In);
+    }
+    else if (Item->Type == Type_Dict)
+    {
+        Item->Dict = ReadId(Reader, &Reader->Dicts);
+        if (!Item->Dict)
+        {
+            Reader->In.Failed = true;
+        }
+    }
+    else if (Item->Type == Type_List)
+    {
+        Item->List = ReadId(Reader, &Reader->Lists);
+        if (!Item->List)
+        {
+            Reader->In.Failed = true;
+        }
+    }
+    else
+    {
+        // Procedures are never written.
+        Reader->In.Failed = true;
+    }
+    
+    return !Reader->In.Failed;
+}
+
+static
+bool ReadModel(snapshot_reader *Reader, inspect_data *Data)
+{
+    uint32 StringCount = ReadU32(&Reader->In);
+    for (uint32 I = 0; I < StringCount && !Reader->In.Failed; ++I)
+    {
+        Reader->Strings.push_back(ReadString(&Reader->In));
+    }
+    
+    // The text the strings of the model pointed into isn't loaded, they all point into
+    // the intern table instead.
+    for (std::string &String : Reader->Strings)
+    {
+        inspect_data_item Interned = InternString(&Data->Strings, String.data(), String.size());
+        Reader->InternedStrings.push_back(Interned);
+    }
+    
+    // Everything is allocated up front, so items can point at tables that come later.
+    // Every table entry takes at least 4 bytes further on, which bounds the counts
+    // before anything is allocated for them.
+    size_t Remaining = BytesLeft(&Reader->In) / sizeof(uint32);
+    uint32 DictCount = ReadU32(&Reader->In);
+    if (Reader->In.Failed || DictCount > Remaining)
+    {
+        return false;
+    }
+    
+    std::vector<uint32> Embedded(DictCount);
+    ReadBytes(&Reader->In, Embedded.data(), Embedded.size() * sizeof(uint32));
+    uint32 ListCount = ReadU32(&Reader->In);
+    uint32 AttributeListCount = ReadU32(&Reader->In);
+    if (Reader->In.Failed || ListCount > Remaining || AttributeListCount > Remaining)
+    {
+        return false;
+    }
+    
+    for (uint32 I = 0; I < AttributeListCount; ++I)
+    {
+        Reader->AttributeLists.push_back(new attribute_list);
+    }
+    
+    for (uint32 I = 0; I < DictCount; ++I)
+    {
+        uint32 Owner = Embedded[I];
+        if (Owner > AttributeListCount)
+        {
+            return false;
+        }
+        
+        if (Owner)
+        {
+            Reader->Dicts.push_back(&Reader->AttributeLists[Owner - 1]->AttributeData);
+        }
+        else
+        {
+            Reader->AllocatedDicts.push_back(NewDict());
+            Reader->Dicts.push_back(Reader->AllocatedDicts.back());
+        }
+    }
+    
+    for (uint32 I = 0; I < ListCount; ++I)
+    {
+        Reader->Lists.push_back(new inspect_list);
+    }
+    
+    inspect_data_item GlobalScope;
+    if (!ReadItem(Reader, &GlobalScope) || GlobalScope.Type != Type_Dict)
+    {
+        return false;
+    }
+    
+    for (inspect_dict *Dict : Reader->Dicts)
+    {
+        Dict->Parent = ReadId(Reader, &Reader->Dicts);
+        Dict->Attributes = ReadId(Reader, &Reader->AttributeLists);
+        uint32 Flags = ReadU32(&Reader->In);
+        Dict->ReadOnly = (Flags & 1) != 0;
+        Dict->SharedAttributeData = (Flags & 2) != 0;
+        
+        uint32 Shape = ReadU32(&Reader->In);
+        uint32 SlotsSet = ReadU32(&Reader->In);
+        if (Reader->In.Failed || Shape >= (uint32)Num_Inspect_Shapes)
+        {
+            return false;
+        }
+        
+        uint32 SlotCount = InspectShapes[Shape].SlotCount;
+        if (SlotCount < 32 && (SlotsSet >> SlotCount) != 0)
+        {
+            return false;
+        }
+        
+        Dict->Shape = (inspect_shape_id)Shape;
+        Dict->SlotsSet = SlotsSet;
+        Dict->Slots.resize(SlotCount);
+        for (uint32 Slot = 0; Slot < SlotCount; ++Slot)
+        {
+            if (IsSlotSet(Dict, Slot))
+            {
+                ReadItem(Reader, &Dict->Slots[Slot]);
+            }
+        }
+        
+        uint32 Count = ReadU32(&Reader->In);
+        if (Reader->In.Failed || Count > BytesLeft(&Reader->In))
+        {
+            return false;
+        }
+        
+        Dict->Lookup.reserve(Count);
+        for (uint32 I = 0; I < Count && !Reader->In.Failed; ++I)
+        {
+            const std::string *Key = ReadStringId(Reader);
+            inspect_data_item Item;
+            if (ReadItem(Reader, &Item))
+            {
+                Dict->Lookup.emplace(*Key, Item);
+            }
+        }
+    }
+    
+    for (inspect_list *List : Reader->Lists)
+    {
+        uint32 Count = ReadU32(&Reader->In);
+        if (Reader->In.Failed || Count > BytesLeft(&Reader->In))
+        {
+            return false;
+        }
+        
+        List->reserve(Count);
+        for (uint32 I = 0; I < Count && !Reader->In.Failed; ++I)
+        {
+            inspect_data_item Item;
+            if (ReadItem(Reader, &Item))
+            {
+                List->push_back(Item);
+            }
+        }
+    }
+    
+    for (attribute_list *List : Reader->AttributeLists)
+    {
+        inspect_dict *AttributeData = ReadId(Reader, &Reader->Dicts);
+        Reader->In.Failed |= AttributeData != &List->AttributeData;
+        
+        uint32 Words = ReadU32(&Reader->In);
+        if (Reader->In.Failed || BytesLeft(&Reader->In) / sizeof(uint64) < Words)
+        {
+            return false;
+        }
+        
+        List->Presence.resize(Words);
+        ReadBytes(&Reader->In, List->Presence.data(), Words * sizeof(uint64));
+    }
+    
+    std::unordered_map<std::string, attribute_handle> AttributeHandles;
+    uint32 HandleCount = ReadU32(&Reader->In);
+    for (uint32 I = 0; I < HandleCount && !Reader->In.Failed; ++I)
+    {
+        const std::string *Name = ReadStringId(Reader);
+        attribute_handle Handle = (attribute_handle)ReadU32(&Reader->In);
+        if (Name)
+        {
+            AttributeHandles[*Name] = Handle;
+        }
+    }
+    
+    if (Reader->In.Failed || Reader->In.At != Reader->In.End)
+    {
+        return false;
+    }
+    
+    FreeDataItem(&Data->GlobalScope);
+    Data->GlobalScope = GlobalScope;
+    Data->AttributeHandles.swap(AttributeHandles);
+    
+    // No item owns the attribute lists or the attribute data they share, the model does.
+    std::unordered_set<inspect_dict *> Shared;
+    for (attribute_list *List : Reader->AttributeLists)
+    {
+        for (auto &Entry : List->AttributeData.Lookup)
+        {
+            if (Entry.second.Type == Type_Dict && Shared.insert(Entry.second.Dict).second)
+            {
+                Data->SharedAttributeData.push_back(Entry.second.Dict);
+            }
+        }
+        
+        Data->AttributeLists.push_back(List);
+    }
+    
+    return true;
+}
+
+bool LoadSnapshot(const char *Path, const char *InputFile, inspect_data *Data)
+{
+    std::vector<uint8> Bytes;
+    if (!ReadBinaryFile(Path, &Bytes))
+    {
+        return false;
+    }
+    
+    snapshot_reader Reader;
+    CreateBinaryReader(&Reader.In, &Bytes);
+    
+    char Magic[sizeof(SnapshotMagic)];
+    if (!ReadBytes(&Reader.In, Magic, sizeof(Magic)) ||
+        memcmp(Magic, SnapshotMagic, sizeof(Magic)) != 0 ||
+        ReadU32(&Reader.In) != SNAPSHOT_VERSION)
+    {
+        return false;
+    }
+    
+    uint64 Key = ReadU64(&Reader.In);
+    if (ReadString(&Reader.In) != InputFile)
+    {
+        return false;
+    }
+    
+    // Every input is hashed again, this is the only part of the input that is read.
+    std::vector<snapshot_input> Inputs;
+    uint32 InputCount = ReadU32(&Reader.In);
+    for (uint32 I = 0; I < InputCount && !Reader.In.Failed; ++I)
+    {
+        snapshot_input Input;
+        Input.Path = ReadString(&Reader.In);
+        uint64 Expected = ReadU64(&Reader.In);
+        if (Reader.In.Failed || !HashFile(Input.Path.c_str(), &Input.Hash) || Input.Hash != Expected)
+        {
+            return false;
+        }
+        
+        Inputs.push_back(Input);
+    }
+    
+    if (Reader.In.Failed || HashInputs(&Inputs) != Key)
+    {
+        return false;
+    }
+    
+    if (!CheckHashedSection(&Reader.In))
+    {
+        return false;
+    }
+    
+    if (!ReadModel(&Reader, Data))
+    {
+        // Only the tables and the interned strings, nothing else was allocated yet.
+        FreeInternTable(&Data->Strings);
+        
+        for (inspect_dict *Dict : Reader.AllocatedDicts)
+        {
+            delete Dict;
+        }
+        
+        for (inspect_list *List : Reader.Lists)
+        {
+            delete List;
+        }
+        
+        for (attribute_list *List : Reader.AttributeLists)
+        {
+            delete List;
+        }
+        
+        return false;
+    }
+    
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "codegen_parse_inspect.h"
+#include "codegen_inspect_data.h"
+
+// A snapshot is the resolved model, everything ParseInspect put into an inspect_data,
+// written out so the next run over the same files can skip lexing, parsing and
+// resolving altogether.
+//
+// Pointers are written as indices into the tables of dicts, lists and attribute lists
+// the file starts with, so it can be loaded anywhere. Loading reads the file in one go,
+// allocates every table entry and then fills them in, turning the indices back into
+// pointers along the way.
+//
+// The path and hash of every file that was parsed is written too. A snapshot is only
+// loaded if every one of those files is still the same, and only by the same version
+// of codegen that wrote it.
+
+// Has to change whenever the format does, or whatever ParseInspect puts in the model.
+#define SNAPSHOT_VERSION 6
+
+// Writes the model ParseInspect built into Data, before anything else is added to it.
+bool WriteSnapshot(const char *Path, const char *InputFile,
+                   inspect_parser *Parser, inspect_data *Data);
+
+// Loads the snapshot at Path into a newly created Data. Fails without printing anything
+// if there is no snapshot for InputFile or it is out of date, the input has to be
+// parsed instead.
+bool LoadSnapshot(const char *Path, const char *InputFile, inspect_data *Data);
@@ -3,7 +3,10 @@
 #include "codegen_inspect_data.cpp"
 #include "codegen_lex_base.cpp"
 #include "codegen_lex_inspect.cpp"
+#include "codegen_lex_pipeline.cpp"
 #include "codegen_parse_inspect.cpp"
+#include "codegen_module.cpp"
+#include "codegen_snapshot.cpp"
 
 #include "codegen_lex_write.cpp"
 #include "codegen_parse_write.cpp"
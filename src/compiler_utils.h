@@ -31,3 +31,17 @@ uint32 Constexprfnv32(const char *String)
     return Constexprfnv32((uint8 *)String, ConstexprStrlen(String));
 }
 
+
+// 64 bit FNV-1a from the same place, for hashing whole files. Pass the result back in as
+// Hash to keep hashing more data into it.
+inline
+uint64 fnv64(const void *Buffer, size_t Length, uint64 Hash = 14695981039346656037ull)
+{
+    const uint8 *Bytes = (const uint8 *)Buffer;
+    for (size_t I = 0; I < Length; ++I)
+    {
+        Hash = (Hash ^ Bytes[I]) * 1099511628211ull;
+    }
+    
+    return Hash;
+}
@@ -1,10 +1,21 @@
 
 # pragma once
 
+#include <string>
+#include <vector>
+#include "numeric_types.h"
+
 #ifdef _WIN32
 #include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
 
 #define PLATFORM_IS_DIRECTORY(DirectoryName) Win32IsDirectory(DirectoryName)
+#define PLATFORM_MAKE_DIRECTORY(DirectoryName) Win32MakeDirectory(DirectoryName)
+#define PLATFORM_WALL_CLOCK() Win32WallClock()
+#define PLATFORM_PEAK_MEMORY_USAGE() Win32PeakMemoryUsage()
+#define PLATFORM_NULL_DEVICE "NUL"
+#define PLATFORM_LIST_FILES(DirectoryName, Files) Win32ListFiles(DirectoryName, Files)
 
 inline
 bool Win32IsDirectory(const char *DirectoryName)
@@ -24,10 +35,83 @@ bool Win32IsDirectory(const char *DirectoryName)
     return false;
 }
 
-#elif __linux__ // THIS HAS NOT BEEN TESTED!!!
+inline
+bool Win32MakeDirectory(const char *DirectoryName)
+{
+    if (Win32IsDirectory(DirectoryName))
+    {
+        return true;
+    }
+    
+    return CreateDirectory(DirectoryName, 0) != 0;
+}
+
+// Names (not paths) of the regular files directly inside the directory, in no particular order.
+inline
+bool Win32ListFiles(const char *DirectoryName, std::vector<std::string> *Files)
+{
+    std::string Pattern = DirectoryName;
+    Pattern += "\\*";
+    
+    WIN32_FIND_DATA FindData;
+    HANDLE Find = FindFirstFile(Pattern.c_str(), &FindData);
+    if (Find == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    
+    do
+    {
+        if (!(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            Files->push_back(FindData.cFileName);
+        }
+    } while (FindNextFile(Find, &FindData));
+    
+    FindClose(Find);
+    return true;
+}
+
+// Seconds since some arbitrary point, only useful for measuring durations.
+inline
+float64 Win32WallClock()
+{
+    static LARGE_INTEGER Frequency;
+    if (Frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&Frequency);
+    }
+    
+    LARGE_INTEGER Counter;
+    QueryPerformanceCounter(&Counter);
+    return (float64)Counter.QuadPart / (float64)Frequency.QuadPart;
+}
+
+// Peak working set of the process in bytes.
+inline
+uint64 Win32PeakMemoryUsage()
+{
+    PROCESS_MEMORY_COUNTERS Counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters)))
+    {
+        return 0;
+    }
+    
+    return (uint64)Counters.PeakWorkingSetSize;
+}
+
+#elif __linux__
 #include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 #define PLATFORM_IS_DIRECTORY(DirectoryName) POSIXIsDirectory(DirectoryName)
+#define PLATFORM_MAKE_DIRECTORY(DirectoryName) POSIXMakeDirectory(DirectoryName)
+#define PLATFORM_WALL_CLOCK() POSIXWallClock()
+#define PLATFORM_PEAK_MEMORY_USAGE() POSIXPeakMemoryUsage()
+#define PLATFORM_NULL_DEVICE "/dev/null"
+#define PLATFORM_LIST_FILES(DirectoryName, Files) POSIXListFiles(DirectoryName, Files)
 
 inline
 bool POSIXIsDirectory(const char *DirectoryName)
@@ -39,7 +123,68 @@ bool POSIXIsDirectory(const char *DirectoryName)
     }
     
     closedir(Directory);
-    return false;
+    return true;
+}
+
+inline
+bool POSIXMakeDirectory(const char *DirectoryName)
+{
+    if (POSIXIsDirectory(DirectoryName))
+    {
+        return true;
+    }
+    
+    return mkdir(DirectoryName, 0755) == 0;
+}
+
+// Names (not paths) of the regular files directly inside the directory, in no particular order.
+inline
+bool POSIXListFiles(const char *DirectoryName, std::vector<std::string> *Files)
+{
+    DIR *Directory = opendir(DirectoryName);
+    if (!Directory)
+    {
+        return false;
+    }
+    
+    while (dirent *Entry = readdir(Directory))
+    {
+        std::string Path = DirectoryName;
+        Path += "/";
+        Path += Entry->d_name;
+        
+        struct stat Info;
+        if (stat(Path.c_str(), &Info) == 0 && S_ISREG(Info.st_mode))
+        {
+            Files->push_back(Entry->d_name);
+        }
+    }
+    
+    closedir(Directory);
+    return true;
+}
+
+// Seconds since some arbitrary point, only useful for measuring durations.
+inline
+float64 POSIXWallClock()
+{
+    timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (float64)Time.tv_sec + (float64)Time.tv_nsec / 1000000000.0;
+}
+
+// Peak resident set size of the process in bytes.
+inline
+uint64 POSIXPeakMemoryUsage()
+{
+    rusage Usage;
+    if (getrusage(RUSAGE_SELF, &Usage) != 0)
+    {
+        return 0;
+    }
+    
+    // ru_maxrss is reported in kilobytes on linux.
+    return (uint64)Usage.ru_maxrss * 1024;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+#include <stdlib.h>
+#include <atomic>
+#include "numeric_types.h"
+
+// Bounded queue of tokens between exactly one producer thread and one consumer thread.
+// Only the producer writes Tail and only the consumer writes Head, so neither side
+// ever takes a lock. Each side keeps its own copy of the other's index and only
+// reloads it when the ring looks full or empty, which keeps the two cores from
+// fighting over the same cache line on every token.
+template <typename T>
+struct token_ring
+{
+    static const uint32 Size = 1 << 14; // Must be a power of two.
+    T *Tokens;
+    
+    // Padding keeps the producer's and the consumer's indices on separate cache lines.
+    char Padding0[64];
+    std::atomic<uint32> Tail;
+    uint32 CachedHead; // Producer only.
+    
+    char Padding1[64];
+    std::atomic<uint32> Head;
+    uint32 CachedTail; // Consumer only.
+    
+    char Padding2[64];
+};
+
+template <typename T>
+void CreateTokenRing(token_ring<T> *Ring)
+{
+    Ring->Tokens = (T *)malloc(sizeof(T) * token_ring<T>::Size);
+    Ring->Tail.store(0, std::memory_order_relaxed);
+    Ring->Head.store(0, std::memory_order_relaxed);
+    Ring->CachedHead = 0;
+    Ring->CachedTail = 0;
+}
+
+// Producer side, fails if the consumer hasn't made room yet.
+template <typename T>
+bool TryPushToken(token_ring<T> *Ring, T *Token)
+{
+    uint32 Tail = Ring->Tail.load(std::memory_order_relaxed);
+    if (Tail - Ring->CachedHead == token_ring<T>::Size)
+    {
+        Ring->CachedHead = Ring->Head.load(std::memory_order_acquire);
+        if (Tail - Ring->CachedHead == token_ring<T>::Size)
+        {
+            return false;
+        }
+    }
+    
+    Ring->Tokens[Tail & (token_ring<T>::Size - 1)] = *Token;
+    Ring->Tail.store(Tail + 1, std::memory_order_release);
+    return true;
+}
+
+// Consumer side, fails if the producer hasn't pushed anything new yet.
+template <typename T>
+bool TryPopToken(token_ring<T> *Ring, T *Token)
+{
+    uint32 Head = Ring->Head.load(std::memory_order_relaxed);
+    if (Head == Ring->CachedTail)
+    {
+        Ring->CachedTail = Ring->Tail.load(std::memory_order_acquire);
+        if (Head == Ring->CachedTail)
+        {
+            return false;
+        }
+    }
+    
+    *Token = Ring->Tokens[Head & (token_ring<T>::Size - 1)];
+    Ring->Head.store(Head + 1, std::memory_order_release);
+    return true;
+}
+
+// Either side, how many tokens are in the ring right now. Only a hint, the other side may
+// have moved on by the time it is used.
+template <typename T>
+uint32 TokensInRing(token_ring<T> *Ring)
+{
+    return Ring->Tail.load(std::memory_order_acquire) - Ring->Head.load(std::memory_order_acquire);
+}
+
+template <typename T>
+void FreeTokenRing(token_ring<T> *Ring)
+{
+    free(Ring->Tokens);
+}
@@ -1,27 +1,49 @@
 #pragma once
 #include <stdlib.h>
+#include <string.h>
 
+// Tokens live in fixed size chunks that never move once allocated, so growing never
+// copies a token and an index stays valid for as long as the stack does.
 template <typename T>
 struct token_stack
 {
-    static const int Increment = 1024; // This seems fine.
-    static const int InitialSize = 4096; // Pretty big, doesn't hurt.
+    static const int ChunkShift = 12;
+    static const int ChunkSize = 1 << ChunkShift; // 4096 tokens per chunk.
+    static const int InitialChunkTableSize = 16;
     int Top;
     int Populated;
     int Capacity;
-    T *Tokens;
+    
+    // Only this table of chunk pointers is ever reallocated, doubling in size each time.
+    T **Chunks;
+    int ChunkCount;
+    int ChunkTableSize;
 };
 
 template <typename T>
-void Resize(token_stack<T> *Stack)
+inline
+T &TokenAt(token_stack<T> *Stack, int Index)
+{
+    return Stack->Chunks[Index >> token_stack<T>::ChunkShift][Index & (token_stack<T>::ChunkSize - 1)];
+}
+
+// Adds another chunk worth of capacity.
+template <typename T>
+void Grow(token_stack<T> *Stack)
 {
-    int NewCapacity = Stack->Capacity + token_stack<T>::Increment;
-    size_t BufferSize = sizeof(T) * NewCapacity;
-    T *Buffer = (T *)malloc(BufferSize);
+    if (Stack->ChunkCount == Stack->ChunkTableSize)
+    {
+        int NewTableSize = Stack->ChunkTableSize * 2;
+        T **Table = (T **)malloc(sizeof(T *) * NewTableSize);
+        
+        memcpy(Table, Stack->Chunks, sizeof(T *) * Stack->ChunkCount);
+        free(Stack->Chunks);
+        Stack->Chunks = Table;
+        Stack->ChunkTableSize = NewTableSize;
+    }
     
-    memcpy(Buffer, Stack->Tokens, sizeof(T) * Stack->Capacity);
-    free(Stack->Tokens);
-    Stack->Tokens = Buffer;
+    Stack->Chunks[Stack->ChunkCount++] = (T *)malloc(sizeof(T) * token_stack<T>::ChunkSize);
+    Stack->Capacity += token_stack<T>::ChunkSize;
 }
 
 template <typename T>
@@ -29,13 +51,39 @@ void CreateTokenStack(token_stack<T> *Stack)
 {
     Stack->Top = -1;
     Stack->Populated = 0;
+    Stack->Capacity = 0;
     
-    Stack->Tokens = (T *)malloc(sizeof(T) * token_stack<T>::InitialSize);
-    Stack->Capacity = token_stack<T>::InitialSize;
+    Stack->Chunks = (T **)malloc(sizeof(T *) * token_stack<T>::InitialChunkTableSize);
+    Stack->ChunkCount = 0;
+    Stack->ChunkTableSize = token_stack<T>::InitialChunkTableSize;
+    
+    Grow(Stack);
+}
+
+// Forgets every token but keeps the chunks, so the stack can be filled again from
+// another file without allocating.
+template <typename T>
+void ResetTokenStack(token_stack<T> *Stack)
+{
+    Stack->Top = -1;
+    Stack->Populated = 0;
+}
+
+// Goes back to before the first token, the tokens already pushed are read again
+// instead of being lexed.
+template <typename T>
+void RewindTokenStack(token_stack<T> *Stack)
+{
+    Stack->Top = -1;
 }
 
 template <typename T>
 void FreeTokenStack(token_stack<T> *Stack)
 {
-    free(Stack->Tokens);
-}
\ No newline at end of file
+    for (int I = 0; I < Stack->ChunkCount; ++I)
+    {
+        free(Stack->Chunks[I]);
+    }
+    
+    free(Stack->Chunks);
+}